@@ -0,0 +1,72 @@
+# Crypto throughput over every registered cipher and HMAC.
+#
+# Prints one JSON object per run so the output can be collected and
+# compared between builds, e.g.
+#
+#   python bench_crypto.py > before.json
+#   python bench_crypto.py --mode payload --sizes 64,1024 > after.json
+
+import json
+import optparse
+import os
+import sys
+
+import silc
+
+def cpu_count():
+    try:
+        return os.sysconf("SC_NPROCESSORS_ONLN")
+    except (AttributeError, ValueError):
+        return 1
+
+def main():
+    parser = optparse.OptionParser()
+    parser.add_option("--ciphers", default = None,
+                      help = "comma separated ciphers, default all")
+    parser.add_option("--hmacs", default = None,
+                      help = "comma separated HMACs, default all")
+    parser.add_option("--sizes", default = "16,256,1024,4096")
+    parser.add_option("--threads", default = None,
+                      help = "comma separated thread counts, default 1,4,ncpu")
+    parser.add_option("--mode", default = "raw,payload")
+    parser.add_option("--iterations", type = "int", default = 10000)
+    options, args = parser.parse_args()
+
+    if options.ciphers:
+        ciphers = options.ciphers.split(",")
+    else:
+        ciphers = silc.supported_ciphers()
+    if options.hmacs:
+        hmacs = options.hmacs.split(",")
+    else:
+        hmacs = silc.supported_hmacs()
+    sizes = [int(s) for s in options.sizes.split(",")]
+    if options.threads:
+        threads = [int(t) for t in options.threads.split(",")]
+    else:
+        threads = sorted(set([1, 4, cpu_count()]))
+    modes = options.mode.split(",")
+
+    for cipher in ciphers:
+        # "none" has no key and would only measure the HMAC
+        if cipher == "none":
+            continue
+        for hmac in hmacs:
+            for size in sizes:
+                for nthreads in threads:
+                    for mode in modes:
+                        try:
+                            result = silc.benchmark(cipher = cipher,
+                                                    hmac = hmac,
+                                                    size = size,
+                                                    iterations = options.iterations,
+                                                    threads = nthreads,
+                                                    mode = mode)
+                        except RuntimeError, e:
+                            print >> sys.stderr, "%s/%s: %s" % (cipher, hmac, e)
+                            continue
+                        print json.dumps(result, sort_keys = True)
+                        sys.stdout.flush()
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,79 @@
+# Callback dispatch throughput and latency without a server.
+#
+# SilcClient.loopback() feeds made up events through the native
+# callbacks into the Python methods below. Prints one JSON object per
+# run, like bench_crypto.py, e.g.
+#
+#   python bench_dispatch.py > before.json
+#   python bench_dispatch.py --events channel_message,join,leave,whois
+#   python bench_dispatch.py --filters 5000 --drop
+
+import json
+import optparse
+import sys
+
+import silc
+
+class BenchClient(silc.SilcClient):
+
+      # handlers do about what a small bot does with each event
+
+      def channel_message(self, sender, channel, flags, message):
+          self.last = (sender.nickname, channel.channel_name, len(message))
+
+      def private_message(self, sender, flags, message):
+          self.last = (sender.nickname, len(message))
+
+      def notify_join(self, user, channel):
+          self.last = (user.nickname, channel.channel_name)
+
+      def notify_leave(self, user, channel):
+          self.last = (user.nickname, channel.channel_name)
+
+      def command_reply_whois(self, user, nickname, username, realname,
+                              mode, idle):
+          self.last = (nickname, username)
+
+def main():
+    parser = optparse.OptionParser()
+    parser.add_option("--events", default = None,
+                      help = "comma separated event mix, default each "
+                             "event alone and all of them mixed")
+    parser.add_option("--sizes", default = "16,256,4096")
+    parser.add_option("--count", type = "int", default = 100000)
+    parser.add_option("--users", type = "int", default = 64)
+    parser.add_option("--channels", type = "int", default = 8)
+    parser.add_option("--filters", type = "int", default = 0,
+                      help = "add this many substring rules that never match")
+    parser.add_option("--drop", action = "store_true", default = False,
+                      help = "drop the messages no rule matches")
+    options, args = parser.parse_args()
+
+    all_events = "channel_message,private_message,join,leave,whois"
+    if options.events:
+        mixes = [options.events]
+    else:
+        mixes = all_events.split(",") + [all_events]
+    sizes = [int(s) for s in options.sizes.split(",")]
+
+    keys = silc.create_key_pair("bench.pub", "bench.prv", passphrase = "")
+    client = BenchClient(keys, "bench", "bench", "Dispatch Benchmark")
+    for i in range(options.filters):
+        client.add_filter(silc.FILTER_DROP, contains = "nomatch%d" % i)
+    if options.drop:
+        client.filter_default = silc.FILTER_DROP
+
+    for events in mixes:
+        for size in sizes:
+            # warm up the wrappers and the method lookups
+            client.loopback(events = events, count = 1000, size = size,
+                            users = options.users,
+                            channels = options.channels)
+            result = client.loopback(events = events, count = options.count,
+                                     size = size, users = options.users,
+                                     channels = options.channels)
+            print json.dumps(result, sort_keys = True)
+            sys.stdout.flush()
+
+if __name__ == "__main__":
+    main()
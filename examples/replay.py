@@ -0,0 +1,58 @@
+# Replays a recording made with SilcClient.record_start() into a client
+# and prints the replay rate and the callback statistics as JSON, e.g.
+#
+#   python replay.py netsplit.rec
+#   python replay.py --speed 1 netsplit.rec      # as fast as recorded
+#
+# To record, call client.record_start("netsplit.rec") once connected
+# and client.record_stop() before exiting.
+
+import json
+import optparse
+import sys
+
+import silc
+
+class ReplayClient(silc.SilcClient):
+
+      def channel_message(self, sender, channel, flags, message):
+          pass
+
+      def private_message(self, sender, flags, message):
+          pass
+
+      def notify_join(self, user, channel):
+          pass
+
+      def notify_leave(self, user, channel):
+          pass
+
+      def notify_signoff(self, user, message, channel):
+          pass
+
+      def command_reply_users(self, channel, users):
+          pass
+
+def main():
+    parser = optparse.OptionParser(usage = "%prog [options] recording...")
+    parser.add_option("--speed", type = "float", default = 0.0,
+                      help = "pace like the recording, 0 for flat out")
+    parser.add_option("--repeat", type = "int", default = 1)
+    options, args = parser.parse_args()
+    if not args:
+        parser.error("no recording given")
+
+    keys = silc.create_key_pair("replay.pub", "replay.prv", passphrase = "")
+    client = ReplayClient(keys, "replay", "replay", "Replay")
+
+    for filename in args:
+        client.stats(reset = True)
+        for i in range(options.repeat):
+            result = client.replay(filename, speed = options.speed)
+            result["file"] = filename
+            print json.dumps(result, sort_keys = True)
+        print json.dumps(client.stats(), sort_keys = True)
+        sys.stdout.flush()
+
+if __name__ == "__main__":
+    main()
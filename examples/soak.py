@@ -0,0 +1,142 @@
+# Long running leak check. Joins, talks, queries and leaves a channel in
+# a loop and watches the number of live pysilc objects, tuples and, on a
+# debug Python, the total reference count.
+#
+# Build the module with accounting first:
+#
+#   PYSILC_ACCOUNTING=1 python setup.py build
+#   python soak.py --server silc.example.com --channel '#soak' --minutes 30
+#
+# Exits 1 if any counter keeps growing after the warm up.
+
+import gc
+import optparse
+import sys
+import time
+
+import silc
+
+class SoakClient(silc.SilcClient):
+
+      def __init__(self, keys, options):
+          silc.SilcClient.__init__(self, keys, "soak", "soak", "Soak Test")
+          self.options = options
+          self.ready = False
+          self.channel = None
+          self.joining = False
+          self.rounds = 0
+
+      def running(self):
+          self.connect_to_server(self.options.server, self.options.port)
+
+      def connected(self):
+          self.ready = True
+
+      def disconnected(self, msg):
+          print >> sys.stderr, "* Disconnected: %s" % msg
+          sys.exit(2)
+
+      def failure(self):
+          print >> sys.stderr, "* Connection failed"
+          sys.exit(2)
+
+      def channel_message(self, sender, channel, flags, message):
+          pass
+
+      def command_reply_join(self, channel, name, topic, hmac, x, y, users):
+          self.joining = False
+          self.channel = channel
+          self.send_channel_message(channel, "soak %d" % self.rounds)
+          self.command_call("WHOIS %s" % self.user().nickname)
+          self.command_call("USERS %s" % self.options.channel)
+
+      def command_reply_users(self, channel, users):
+          self.command_call("LEAVE %s" % self.options.channel)
+
+      def command_reply_leave(self, channel):
+          self.channel = None
+          self.rounds += 1
+
+      def command_reply_failed(self, command, command_name, status, msg):
+          # try again on the next loop
+          if command_name == "JOIN":
+              self.joining = False
+
+      def round(self):
+          # one JOIN per round, the reply takes many loops to come back
+          if self.ready and self.channel is None and not self.joining:
+              self.joining = True
+              self.command_call("JOIN %s" % self.options.channel)
+
+def sample():
+    counts = {}
+    try:
+        counts.update(silc.live_objects())
+    except RuntimeError:
+        pass
+    gc.collect()
+    counts["tuple"] = len([o for o in gc.get_objects()
+                           if type(o) is tuple])
+    if hasattr(sys, "gettotalrefcount"):
+        counts["refs"] = sys.gettotalrefcount()
+    return counts
+
+def growing(history, slack):
+    """Counters that grew in every sample since the warm up."""
+    grown = []
+    for key in history[0]:
+        values = [h.get(key, 0) for h in history]
+        if values[-1] - values[0] > slack and \
+           all(b >= a for a, b in zip(values, values[1:])):
+            grown.append((key, values[0], values[-1]))
+    return grown
+
+def main():
+    parser = optparse.OptionParser()
+    parser.add_option("--server", default = "localhost")
+    parser.add_option("--port", type = "int", default = 706)
+    parser.add_option("--channel", default = "#soak")
+    parser.add_option("--minutes", type = "float", default = 10.0)
+    parser.add_option("--warmup", type = "float", default = 60.0,
+                      help = "seconds before samples are kept")
+    parser.add_option("--interval", type = "float", default = 10.0,
+                      help = "seconds between samples")
+    parser.add_option("--slack", type = "int", default = 16,
+                      help = "growth tolerated over the whole run")
+    options, args = parser.parse_args()
+
+    if not silc.ACCOUNTING:
+        print >> sys.stderr, "* pysilc built without PYSILC_ACCOUNTING, " \
+                             "only Python counters are checked"
+
+    keys = silc.create_key_pair("soak.pub", "soak.prv", passphrase = "")
+    client = SoakClient(keys, options)
+
+    start = time.time()
+    end = start + options.minutes * 60
+    next_sample = start + options.warmup
+    history = []
+
+    while time.time() < end:
+        client.run_one()
+        client.round()
+        if time.time() >= next_sample:
+            counts = sample()
+            history.append(counts)
+            print "%.0f rounds=%d %s" % (time.time() - start, client.rounds,
+                  " ".join(["%s=%d" % kv for kv in sorted(counts.items())]))
+            sys.stdout.flush()
+            next_sample += options.interval
+        time.sleep(0.01)
+
+    if len(history) < 3:
+        print >> sys.stderr, "* Too few samples, run for longer"
+        return 2
+
+    leaks = growing(history, options.slack)
+    for key, first, last in leaks:
+        print "LEAK %s %d -> %d" % (key, first, last)
+    return leaks and 1 or 0
+
+if __name__ == "__main__":
+    sys.exit(main())
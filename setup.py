@@ -1,5 +1,6 @@
 from distutils.core import setup, Extension
 from os.path import isfile
+import os
 
 try:
     if isfile("MANIFEST"):
@@ -7,9 +8,16 @@ try:
 except:
     pass
 
+# PYSILC_ACCOUNTING=1 python setup.py build counts live objects for
+# silc.live_objects() and examples/soak.py
+define_macros = []
+if os.environ.get("PYSILC_ACCOUNTING"):
+    define_macros.append(('PYSILC_ACCOUNTING', '1'))
+
 ext_modules = [
     Extension('silc', ['src/pysilc.c'],
               extra_compile_args = ['-g'],
+              define_macros = define_macros,
               library_dirs = ['/usr/local/lib', '/usr/lib/silc-toolkit'],
               include_dirs = ['/usr/include/silc-toolkit',
                               '/usr/local/include/silc-toolkit',
@@ -17,6 +25,25 @@ ext_modules = [
                               '/usr/local/include/silc'],
               libraries = ['silc', 'silcclient'],
               depends = ['src/pysilc_callbacks.c',
+                         'src/pysilc_id.c',
+                         'src/pysilc_keys.c',
+                         'src/pysilc_trust.c',
+                         'src/pysilc_signed.c',
+                         'src/pysilc_bench.c',
+                         'src/pysilc_ftp.c',
+                         'src/pysilc_reconnect.c',
+                         'src/pysilc_keepalive.c',
+                         'src/pysilc_connect.c',
+                         'src/pysilc_filter.c',
+                         'src/pysilc_queue.c',
+                         'src/pysilc_coalesce.c',
+                         'src/pysilc_route.c',
+                         'src/pysilc_keyagr.c',
+                         'src/pysilc_stats.c',
+                         'src/pysilc_trace.c',
+                         'src/pysilc_loopback.c',
+                         'src/pysilc_record.c',
+                         'src/pysilc_irc.c',
                          'src/pysilc_channel.c',
                          'src/pysilc_user.c',
                          'src/pysilc_macros.h',
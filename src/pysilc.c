@@ -14,12 +14,32 @@
 
 #include "pysilc.h"
 
+#include "pysilc_stats.c"
+#include "pysilc_trace.c"
+#include "pysilc_id.c"
 #include "pysilc_channel.c"
 #include "pysilc_user.c"
+#include "pysilc_keys.c"
+#include "pysilc_trust.c"
+#include "pysilc_signed.c"
+#include "pysilc_bench.c"
+#include "pysilc_ftp.c"
+#include "pysilc_keyagr.c"
+#include "pysilc_reconnect.c"
+#include "pysilc_keepalive.c"
+#include "pysilc_connect.c"
+#include "pysilc_filter.c"
+#include "pysilc_queue.c"
+#include "pysilc_coalesce.c"
+#include "pysilc_route.c"
+#include "pysilc_irc.c"
 #include "pysilc_callbacks.c"
+#include "pysilc_loopback.c"
+#include "pysilc_record.c"
 
 void initsilc() {
     PyObject *mod = Py_InitModule3("silc", pysilc_functions, pysilc_doc);
+    PyEval_InitThreads(); // key pair jobs call back from worker threads
     silc_pkcs_register_default();
     silc_hash_register_default();
     silc_cipher_register_default();
@@ -27,9 +47,59 @@ void initsilc() {
     PY_MOD_ADD_CLASS(mod, SilcClient);
     PY_MOD_ADD_CLASS(mod, SilcChannel);
     PY_MOD_ADD_CLASS(mod, SilcUser);
+    PY_MOD_ADD_CLASS(mod, SilcID);
+    PY_MOD_ADD_CLASS(mod, SilcKeys);
+    PY_MOD_ADD_CLASS(mod, SilcTrustStore);
+    PY_MOD_ADD_CLASS(mod, SilcChannelPrivateKey);
     PyModule_AddIntConstant(mod, "SILC_ID_CLIENT", SILC_ID_CLIENT);
     PyModule_AddIntConstant(mod, "SILC_ID_CHANNEL", SILC_ID_CHANNEL);
     PyModule_AddIntConstant(mod, "SILC_ID_SERVER", SILC_ID_SERVER);
+    PyModule_AddIntConstant(mod, "SILC_MESSAGE_FLAG_ACTION", SILC_MESSAGE_FLAG_ACTION);
+    PyModule_AddIntConstant(mod, "SILC_MESSAGE_FLAG_NOTICE", SILC_MESSAGE_FLAG_NOTICE);
+    PyModule_AddIntConstant(mod, "SILC_MESSAGE_FLAG_SIGNED", SILC_MESSAGE_FLAG_SIGNED);
+    PyModule_AddIntConstant(mod, "SILC_MESSAGE_FLAG_UTF8", SILC_MESSAGE_FLAG_UTF8);
+    PyModule_AddIntConstant(mod, "MESSAGE_SIGNATURE_VERIFIED", PYSILC_MESSAGE_SIGNATURE_VERIFIED);
+    PyModule_AddIntConstant(mod, "MESSAGE_SIGNATURE_FAILED", PYSILC_MESSAGE_SIGNATURE_FAILED);
+    PyModule_AddIntConstant(mod, "MESSAGE_SIGNATURE_UNVERIFIED", PYSILC_MESSAGE_SIGNATURE_UNVERIFIED);
+    PyModule_AddIntConstant(mod, "TRUST_UNKNOWN", PYSILC_TRUST_UNKNOWN);
+    PyModule_AddIntConstant(mod, "TRUST_TRUSTED", PYSILC_TRUST_TRUSTED);
+    PyModule_AddIntConstant(mod, "TRUST_MISMATCH", PYSILC_TRUST_MISMATCH);
+    PyModule_AddIntConstant(mod, "FILTER_ACCEPT", PYSILC_FILTER_ACCEPT);
+    PyModule_AddIntConstant(mod, "FILTER_DROP", PYSILC_FILTER_DROP);
+    PyModule_AddIntConstant(mod, "QUEUE_BLOCK", PYSILC_QUEUE_BLOCK);
+    PyModule_AddIntConstant(mod, "QUEUE_DROP_OLDEST", PYSILC_QUEUE_DROP_OLDEST);
+    PyModule_AddIntConstant(mod, "QUEUE_DROP_NEWEST", PYSILC_QUEUE_DROP_NEWEST);
+    PyModule_AddIntConstant(mod, "QUEUE_SAMPLE", PYSILC_QUEUE_SAMPLE);
+#ifdef PYSILC_ACCOUNTING
+    PyModule_AddIntConstant(mod, "ACCOUNTING", 1);
+#else
+    PyModule_AddIntConstant(mod, "ACCOUNTING", 0);
+#endif
+    PyModule_AddIntConstant(mod, "SILC_CLIENT_FILE_MONITOR_KEY_AGREEMENT", SILC_CLIENT_FILE_MONITOR_KEY_AGREEMENT);
+    PyModule_AddIntConstant(mod, "SILC_CLIENT_FILE_MONITOR_SEND", SILC_CLIENT_FILE_MONITOR_SEND);
+    PyModule_AddIntConstant(mod, "SILC_CLIENT_FILE_MONITOR_RECEIVE", SILC_CLIENT_FILE_MONITOR_RECEIVE);
+    PyModule_AddIntConstant(mod, "SILC_CLIENT_FILE_MONITOR_GET", SILC_CLIENT_FILE_MONITOR_GET);
+    PyModule_AddIntConstant(mod, "SILC_CLIENT_FILE_MONITOR_CLOSED", SILC_CLIENT_FILE_MONITOR_CLOSED);
+    PyModule_AddIntConstant(mod, "SILC_CLIENT_FILE_MONITOR_DISCONNECT", SILC_CLIENT_FILE_MONITOR_DISCONNECT);
+    PyModule_AddIntConstant(mod, "SILC_CLIENT_FILE_MONITOR_ERROR", SILC_CLIENT_FILE_MONITOR_ERROR);
+    PyModule_AddIntConstant(mod, "SILC_CLIENT_FILE_OK", SILC_CLIENT_FILE_OK);
+    PyModule_AddIntConstant(mod, "SILC_CLIENT_FILE_ERROR", SILC_CLIENT_FILE_ERROR);
+    PyModule_AddIntConstant(mod, "SILC_CLIENT_FILE_UNKNOWN_SESSION", SILC_CLIENT_FILE_UNKNOWN_SESSION);
+    PyModule_AddIntConstant(mod, "SILC_CLIENT_FILE_ALREADY_STARTED", SILC_CLIENT_FILE_ALREADY_STARTED);
+    PyModule_AddIntConstant(mod, "SILC_CLIENT_FILE_NO_SUCH_FILE", SILC_CLIENT_FILE_NO_SUCH_FILE);
+    PyModule_AddIntConstant(mod, "SILC_CLIENT_FILE_PERMISSION_DENIED", SILC_CLIENT_FILE_PERMISSION_DENIED);
+    PyModule_AddIntConstant(mod, "SILC_CLIENT_FILE_KEY_AGREEMENT_FAILED", SILC_CLIENT_FILE_KEY_AGREEMENT_FAILED);
+    PyModule_AddIntConstant(mod, "SILC_CLIENT_FILE_CONNECT_FAILED", SILC_CLIENT_FILE_CONNECT_FAILED);
+    PyModule_AddIntConstant(mod, "SILC_CLIENT_FILE_TIMEOUT", SILC_CLIENT_FILE_TIMEOUT);
+    PyModule_AddIntConstant(mod, "SILC_CLIENT_FILE_NO_MEMORY", SILC_CLIENT_FILE_NO_MEMORY);
+    PyModule_AddIntConstant(mod, "SILC_KEY_AGREEMENT_OK", SILC_KEY_AGREEMENT_OK);
+    PyModule_AddIntConstant(mod, "SILC_KEY_AGREEMENT_ERROR", SILC_KEY_AGREEMENT_ERROR);
+    PyModule_AddIntConstant(mod, "SILC_KEY_AGREEMENT_FAILURE", SILC_KEY_AGREEMENT_FAILURE);
+    PyModule_AddIntConstant(mod, "SILC_KEY_AGREEMENT_TIMEOUT", SILC_KEY_AGREEMENT_TIMEOUT);
+    PyModule_AddIntConstant(mod, "SILC_KEY_AGREEMENT_ABORTED", SILC_KEY_AGREEMENT_ABORTED);
+    PyModule_AddIntConstant(mod, "SILC_KEY_AGREEMENT_ALREADY_STARTED", SILC_KEY_AGREEMENT_ALREADY_STARTED);
+    PyModule_AddIntConstant(mod, "SILC_KEY_AGREEMENT_SELF_DENIED", SILC_KEY_AGREEMENT_SELF_DENIED);
+    PyModule_AddIntConstant(mod, "SILC_KEY_AGREEMENT_NO_MEMORY", SILC_KEY_AGREEMENT_NO_MEMORY);
 }
 
 static int PySilcClient_Init(PyObject *self, PyObject *args, PyObject *kwds)
@@ -71,6 +141,26 @@ static int PySilcClient_Init(PyObject *self, PyObject *args, PyObject *kwds)
 
     pyclient->silcconn = NULL;
 
+    pyclient->verify_signatures = 1;
+    if (_pysilc_signed_init(pyclient) < 0) {
+        PyErr_SetString(PyExc_AssertionError, "Failed to Initialise Message Signing");
+        return -1;
+    }
+    if (!(pyclient->channel_keys = _pysilc_channel_keys_alloc())) {
+        PyErr_SetString(PyExc_AssertionError, "Failed to Initialise Channel Keys");
+        return -1;
+    }
+    if (!(pyclient->ftp_sessions = _pysilc_ftp_sessions_alloc())) {
+        PyErr_SetString(PyExc_AssertionError, "Failed to Initialise File Transfers");
+        return -1;
+    }
+    pyclient->max_key_agreements = PYSILC_KEY_AGREEMENT_MAX;
+    pyclient->stats_enabled = 1;
+    if (!(pyclient->key_agreements = silc_dlist_init())) {
+        PyErr_SetString(PyExc_AssertionError, "Failed to Initialise Key Agreements");
+        return -1;
+    }
+
     memset(&(pyclient->params), 0, sizeof(pyclient->params));
 
     if (nickname)
@@ -99,14 +189,47 @@ static int PySilcClient_Init(PyObject *self, PyObject *args, PyObject *kwds)
     return 0;
 }
 
+/* Frees what connect_to_server() copied into the connection parameters
+   and resets them to the toolkit defaults, keeping the nickname. */
+static void _pysilc_client_params_clear(PySilcClient *pyclient)
+{
+    char *nickname = pyclient->params.nickname;
+
+    free(pyclient->params.local_ip);
+    free(pyclient->params.bind_ip);
+    free(pyclient->params.auth);
+    memset(&(pyclient->params), 0, sizeof(pyclient->params));
+    pyclient->params.nickname = nickname;
+}
+
 static void PySilcClient_Del(PyObject *obj)
 {
     PySilcClient *pyclient = (PySilcClient *)obj;
+    _pysilc_keyagr_clear(pyclient);
+    _pysilc_reconnect_free(pyclient);
+    _pysilc_keepalive_free(pyclient);
+    _pysilc_connect_free(pyclient);
+    _pysilc_filter_free(pyclient);
+    _pysilc_coalesce_free(pyclient);
+    _pysilc_route_free(pyclient);
+    _pysilc_queue_free(pyclient);
     if (pyclient->silcobj) {
         silc_client_stop(pyclient->silcobj, NULL, NULL);
         silc_client_free(pyclient->silcobj);
     }
+    _pysilc_client_params_clear(pyclient);
+    _pysilc_signed_free(pyclient);
+    if (pyclient->channel_keys)
+        silc_hash_table_free(pyclient->channel_keys);
+    if (pyclient->ftp_sessions)
+        silc_hash_table_free(pyclient->ftp_sessions);
     Py_XDECREF(pyclient->keys);
+    Py_XDECREF(pyclient->trust_store);
+    _pysilc_trace_free(pyclient);
+    _pysilc_loopback_free(pyclient);
+    _pysilc_record_close(pyclient);
+    _pysilc_replay_free(pyclient);
+    free(pyclient->resume_data);
     obj->ob_type->tp_free(obj);
 }
 
@@ -114,30 +237,110 @@ static PyObject *pysilc_client_connect_to_server(PyObject *self, PyObject *args,
 {
     SilcAsyncOperation op;
     unsigned int port = 706;
-    char *host;
-    static char *kwlist[] = {"host", "port", NULL};
+    PyObject *hosts;
+    double stagger = 0.25;
+    unsigned char *detach_data = NULL, *passphrase = NULL;
+    int detach_data_len = 0, passphrase_len = 0;
+    unsigned int rekey_secs = 0, timeout_secs = 0, keepalive_secs = 0;
+    unsigned int adaptive_keepalive = 0, local_port = 0;
+    PyObject *pfs = NULL, *udp = NULL, *no_authentication = NULL;
+    char *local_ip = NULL, *bind_ip = NULL;
+    static char *kwlist[] = {"host", "port", "detach_data", "rekey_secs",
+                             "pfs", "timeout_secs", "keepalive_secs",
+                             "adaptive_keepalive", "udp", "local_ip",
+                             "bind_ip", "local_port", "passphrase",
+                             "no_authentication", "stagger", NULL};
     PySilcClient *pyclient = (PySilcClient *)self;
 
-    if (!PyArg_ParseTupleAndKeywords(args, kwds, "s|I", kwlist, &host, &port))
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "O|Iz#IOIIIOzzIz#Od", kwlist,
+                                     &hosts, &port, &detach_data,
+                                     &detach_data_len, &rekey_secs, &pfs,
+                                     &timeout_secs, &keepalive_secs,
+                                     &adaptive_keepalive, &udp, &local_ip,
+                                     &bind_ip, &local_port, &passphrase,
+                                     &passphrase_len, &no_authentication,
+                                     &stagger))
         return NULL;
 
     if (!pyclient || !pyclient->silcobj) {
         PyErr_SetString(PyExc_RuntimeError, "SILC Client Not Initialised");
         return NULL;
     }
+    if (!(stagger >= 0)) {
+        PyErr_SetString(PyExc_ValueError, "stagger should not be negative");
+        return NULL;
+    }
+
+    // kept for the reconnects of auto_reconnect()
+    _pysilc_client_params_clear(pyclient);
+    pyclient->params.rekey_secs = rekey_secs;
+    pyclient->params.pfs = pfs && PyObject_IsTrue(pfs);
+    pyclient->params.timeout_secs = timeout_secs;
+    pyclient->params.udp = udp && PyObject_IsTrue(udp);
+    pyclient->params.local_port = local_port;
+    pyclient->params.no_authentication = no_authentication &&
+                                         PyObject_IsTrue(no_authentication);
+    if ((local_ip && !(pyclient->params.local_ip = strdup(local_ip))) ||
+        (bind_ip && !(pyclient->params.bind_ip = strdup(bind_ip))))
+        return PyErr_NoMemory();
+    if (passphrase) {
+        if (!(pyclient->params.auth = malloc(passphrase_len + 1)))
+            return PyErr_NoMemory();
+        memcpy(pyclient->params.auth, passphrase, passphrase_len + 1);
+        pyclient->params.auth_len = passphrase_len;
+        pyclient->params.auth_set = TRUE;
+    }
+
+    // the toolkit heartbeat would keep the connection from looking idle
+    if (_pysilc_keepalive_configure(pyclient, adaptive_keepalive) < 0)
+        return PyErr_NoMemory();
+    pyclient->params.keepalive_secs = adaptive_keepalive ? 0 : keepalive_secs;
+
+    // the toolkit keeps pointing at the data until the resume completes
+    free(pyclient->resume_data);
+    pyclient->resume_data = NULL;
+    if (detach_data && detach_data_len) {
+        if (!(pyclient->resume_data = malloc(detach_data_len)))
+            return PyErr_NoMemory();
+        memcpy(pyclient->resume_data, detach_data, detach_data_len);
+    }
+    pyclient->params.detach_data = pyclient->resume_data;
+    pyclient->params.detach_data_len = pyclient->resume_data ? detach_data_len : 0;
+
+    if (!PyString_Check(hosts)) {
+        switch (_pysilc_connect_race(pyclient, hosts, port, stagger)) {
+        case -1:
+            return NULL;
+        case 1:
+            return PyInt_FromLong(-1);
+        }
+        return PyInt_FromLong(0);
+    }
 
+    _pysilc_connect_free(pyclient);
     op = silc_client_connect_to_server(pyclient->silcobj,
          &(pyclient->params), pyclient->keys->public, pyclient->keys->private,
-         host, port, pyclient->conncallback, NULL);
+         PyString_AS_STRING(hosts), port, pyclient->conncallback, NULL);
 
-    if (!op) {
-        Py_INCREF(self);
+    if (!op)
         return PyInt_FromLong(-1);
-    }
 
     return PyInt_FromLong(0);
 }
 
+static void _pysilc_client_run_queued(PySilcClient *pyclient)
+{
+    if (!pyclient->queue) {
+        silc_client_run_one(pyclient->silcobj);
+        return;
+    }
+    _pysilc_queue_backpressure(pyclient);
+    silc_client_run_one(pyclient->silcobj);
+    if (pyclient->queue)
+        _pysilc_queue_drain(pyclient, pyclient->queue->budget);
+    _pysilc_queue_backpressure(pyclient);
+}
+
 static PyObject *pysilc_client_run_one(PyObject *self)
 {
     PySilcClient *pyclient = (PySilcClient *)self;
@@ -145,10 +348,37 @@ static PyObject *pysilc_client_run_one(PyObject *self)
            PyErr_SetString(PyExc_RuntimeError, "SILC Client Not Initialised");
            return NULL;
     }
-    silc_client_run_one(pyclient->silcobj);
+    if (pyclient->stats_enabled || pyclient->trace) {
+        SilcUInt64 start = _pysilc_stats_now();
+        pyclient->stats_loop_started = start;
+        _pysilc_client_run_queued(pyclient);
+        pyclient->stats_loop_ns += _pysilc_stats_now() - start;
+        pyclient->stats_loop_calls++;
+    }
+    else
+        _pysilc_client_run_queued(pyclient);
     Py_RETURN_NONE;
 }
 
+static PyObject *pysilc_client_fileno(PyObject *self)
+{
+    PySilcClient *pyclient = (PySilcClient *)self;
+    SilcStream stream;
+    SilcSocket sock;
+
+    if (!pyclient || !pyclient->silcconn || !pyclient->silcconn->stream) {
+           PyErr_SetString(PyExc_RuntimeError, "SILC Client Not Connected");
+           return NULL;
+    }
+
+    stream = silc_packet_stream_get_stream(pyclient->silcconn->stream);
+    if (!stream || !silc_socket_stream_get_info(stream, &sock, NULL, NULL, NULL)) {
+           PyErr_SetString(PyExc_RuntimeError, "SILC Connection Has No Socket");
+           return NULL;
+    }
+    return PyInt_FromLong(sock);
+}
+
 static PyObject *pysilc_client_remote_host(PyObject *self)
 {
     PySilcClient *pyclient = (PySilcClient *)self;
@@ -175,6 +405,105 @@ static PyObject *pysilc_client_user(PyObject *self)
     return myself;
 }
 
+static PyObject *pysilc_client_joined_channels(PyObject *self)
+{
+    PySilcClient *pyclient = (PySilcClient *)self;
+    SilcClientEntry myself;
+    SilcChannelEntry channel;
+    SilcChannelUser chu;
+    SilcHashTableList htl;
+    PyObject *channels, *pychannel;
+    Py_ssize_t i = 0;
+
+    if (!pyclient || !pyclient->silcconn || !pyclient->silcconn->local_entry) {
+           PyErr_SetString(PyExc_RuntimeError, "SILC Client Not Connected");
+           return NULL;
+    }
+
+    myself = pyclient->silcconn->local_entry;
+    if (!myself->channels)
+        return PyTuple_New(0);
+    if (!(channels = PyTuple_New(silc_hash_table_count(myself->channels))))
+        return NULL;
+
+    silc_hash_table_list(myself->channels, &htl);
+    while (silc_hash_table_get(&htl, (void *)&channel, (void *)&chu)) {
+        if (!(pychannel = PySilcChannel_New(channel))) {
+            silc_hash_table_list_reset(&htl);
+            Py_DECREF(channels);
+            return NULL;
+        }
+        PyTuple_SET_ITEM(channels, i++, pychannel);
+    }
+    silc_hash_table_list_reset(&htl);
+    return channels;
+}
+
+static PyObject *pysilc_client_channel_users(PyObject *self, PyObject *args)
+{
+    PySilcClient *pyclient = (PySilcClient *)self;
+    PySilcChannel *pychannel;
+    SilcClientEntry user;
+    SilcChannelUser chu;
+    SilcHashTableList htl;
+    PyObject *users, *pyuser;
+    Py_ssize_t i = 0;
+
+    if (!PyArg_ParseTuple(args, "O!", &PySilcChannel_Type, &pychannel))
+        return NULL;
+    if (!pyclient || !pyclient->silcconn) {
+           PyErr_SetString(PyExc_RuntimeError, "SILC Client Not Connected");
+           return NULL;
+    }
+    if (!pychannel->silcobj || !pychannel->silcobj->user_list)
+        return PyTuple_New(0);
+    if (!(users = PyTuple_New(silc_hash_table_count(pychannel->silcobj->user_list))))
+        return NULL;
+
+    silc_hash_table_list(pychannel->silcobj->user_list, &htl);
+    while (silc_hash_table_get(&htl, (void *)&user, (void *)&chu)) {
+        if (!(pyuser = PySilcUser_New(user))) {
+            silc_hash_table_list_reset(&htl);
+            Py_DECREF(users);
+            return NULL;
+        }
+        PyTuple_SET_ITEM(users, i++, pyuser);
+    }
+    silc_hash_table_list_reset(&htl);
+    return users;
+}
+
+
+static SilcChannelPrivateKey _pysilc_client_find_channel_key(PySilcClient *pyclient,
+                                                             PySilcChannel *channel,
+                                                             PyObject *key)
+{
+    SilcChannelPrivateKey silckey;
+    const char *name;
+
+    if (PyObject_TypeCheck(key, &PySilcChannelPrivateKey_Type)) {
+        if (!silc_hash_id_compare(&((PySilcChannelPrivateKey *)key)->channel_id,
+                                  &channel->silcobj->id,
+                                  SILC_32_TO_PTR(SILC_ID_CHANNEL))) {
+            PyErr_SetString(PyExc_ValueError, "Key belongs to another channel");
+            return NULL;
+        }
+        name = ((PySilcChannelPrivateKey *)key)->name;
+    }
+    else if (PyString_Check(key)) {
+        name = PyString_AsString(key);
+    }
+    else {
+        PyErr_SetString(PyExc_TypeError, "private_key should be a SilcChannelPrivateKey or String Type");
+        return NULL;
+    }
+
+    silckey = _pysilc_channel_keys_find(pyclient->channel_keys,
+                                        &channel->silcobj->id, name);
+    if (!silckey)
+        PyErr_Format(PyExc_KeyError, "No channel private key named %s", name);
+    return silckey;
+}
 
 static PyObject *pysilc_client_send_channel_message(PyObject *self, PyObject *args, PyObject *kwds)
 {
@@ -182,31 +511,49 @@ static PyObject *pysilc_client_send_channel_message(PyObject *self, PyObject *ar
     char *message = NULL;
     int length = 0;
     int result = 0;
-    PyObject *private_key = NULL; // TODO: ignored at the moment
+    PyObject *private_key = NULL;
+    SilcChannelPrivateKey key = NULL;
     unsigned int defaultFlags = SILC_MESSAGE_FLAG_UTF8;
     unsigned int flags = 0;
+    int sign = 0;
     PySilcClient *pyclient = (PySilcClient *)self;
 
-    static char *kwlist[] = {"channel", "msg", "private_key", "flags", NULL};
+    static char *kwlist[] = {"channel", "msg", "private_key", "flags", "sign", NULL};
 
-    if (!PyArg_ParseTupleAndKeywords(args, kwds, "Oes#|OI", kwlist, &channel, "utf-8", &message, &length, &private_key, &flags))
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "Oes#|OIi", kwlist, &channel, "utf-8", &message, &length, &private_key, &flags, &sign))
         return NULL;
 
-    if (!PyObject_IsInstance((PyObject *)channel, (PyObject *)&PySilcChannel_Type))
+    if (sign)
+        flags |= SILC_MESSAGE_FLAG_SIGNED;
+
+    // the "es#" conversion allocated message, so every return frees it
+    if (!PyObject_IsInstance((PyObject *)channel, (PyObject *)&PySilcChannel_Type)) {
+        PyErr_SetString(PyExc_TypeError, "channel should be a SilcChannel");
+        PyMem_Free(message);
         return NULL;
+    }
 
     if (!pyclient || !pyclient->silcobj) {
         PyErr_SetString(PyExc_RuntimeError, "SILC Client Not Initialised");
+        PyMem_Free(message);
         return NULL;
      }
 
+    if (private_key && private_key != Py_None) {
+        if (!(key = _pysilc_client_find_channel_key(pyclient, channel, private_key))) {
+            PyMem_Free(message);
+            return NULL;
+        }
+    }
+
     result = silc_client_send_channel_message(pyclient->silcobj,
                                               pyclient->silcconn,
                                               channel->silcobj,
-                                              NULL,
+                                              key,
                                               flags | defaultFlags,
-                                              NULL,
+                                              pyclient->sign_hash,
                                               message, length);
+    PyMem_Free(message);
 
     return PyInt_FromLong(result);
 }
@@ -220,18 +567,26 @@ static PyObject *pysilc_client_send_private_message(PyObject *self, PyObject *ar
     int result = 0;
     unsigned int defaultFlags = SILC_MESSAGE_FLAG_UTF8;
     unsigned int flags = 0;
+    int sign = 0;
     PySilcClient *pyclient = (PySilcClient *)self;
 
-    static char *kwlist[] = {"user", "message", "flags", NULL};
+    static char *kwlist[] = {"user", "message", "flags", "sign", NULL};
 
-    if (!PyArg_ParseTupleAndKeywords(args, kwds, "Oes#|I", kwlist, &user, "utf-8", &message, &length, &flags))
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "Oes#|Ii", kwlist, &user, "utf-8", &message, &length, &flags, &sign))
         return NULL;
 
-    if (!PyObject_IsInstance((PyObject *)user, (PyObject *)&PySilcUser_Type))
+    if (sign)
+        flags |= SILC_MESSAGE_FLAG_SIGNED;
+
+    if (!PyObject_IsInstance((PyObject *)user, (PyObject *)&PySilcUser_Type)) {
+        PyErr_SetString(PyExc_TypeError, "user should be a SilcUser");
+        PyMem_Free(message);
         return NULL;
+    }
 
     if (!pyclient || !pyclient->silcobj) {
         PyErr_SetString(PyExc_RuntimeError, "SILC Client Not Initialised");
+        PyMem_Free(message);
         return NULL;
      }
 
@@ -239,9 +594,10 @@ static PyObject *pysilc_client_send_private_message(PyObject *self, PyObject *ar
                                               pyclient->silcconn,
                                               user->silcobj,
                                               flags | defaultFlags,
-                                              NULL,
+                                              pyclient->sign_hash,
                                               message,
                                               length);
+    PyMem_Free(message);
 
     return PyInt_FromLong(result);
 }
@@ -260,6 +616,7 @@ static PyObject *pysilc_client_command_call(PyObject *self, PyObject *args, PyOb
     if (!PyArg_ParseTuple(args, "s", &message))
         return NULL;
 
+    _pysilc_reconnect_command(pyclient, message);
     result = silc_client_command_call(pyclient->silcobj, pyclient->silcconn, message);
     return PyInt_FromLong(result);
 }
@@ -315,20 +672,15 @@ static PyObject *pysilc_create_key_pair(PyObject *mod, PyObject *args, PyObject
 			&passphrase_obj, &pkcs_name, &key_length))
         return NULL;
 
-	if (passphrase_obj == Py_None) {
-		passphrase = NULL;
-	}
-	else if (PyString_Check(passphrase_obj)) {
-		passphrase = PyString_AsString(passphrase_obj);
-	}
-	else {
-		PyErr_SetString(PyExc_TypeError, "passphrase should either be None or String Type");
-		return NULL;
-	}
+    if (_pysilc_parse_passphrase(passphrase_obj, &passphrase) < 0)
+        return NULL;
 
-    bool result = silc_create_key_pair(pkcs_name, key_length, pub_filename,
-                                       prv_filename, pub_identifier, passphrase,
-                                       &public_key, &private_key, 0);
+    bool result;
+    Py_BEGIN_ALLOW_THREADS
+    result = silc_create_key_pair(pkcs_name, key_length, pub_filename,
+                                  prv_filename, pub_identifier, passphrase,
+                                  &public_key, &private_key, 0);
+    Py_END_ALLOW_THREADS
     if (!result) {
         PyErr_SetString(PyExc_RuntimeError, "Unable to generate keys.");
         return NULL;
@@ -352,21 +704,16 @@ static PyObject *pysilc_load_key_pair(PyObject *mod, PyObject *args, PyObject *k
             &pub_filename, &prv_filename, &passphrase_obj))
         return NULL;
 
-	if (passphrase_obj == Py_None) {
-		passphrase = NULL;
-	}
-	else if (PyString_Check(passphrase_obj)) {
-		passphrase = PyString_AsString(passphrase_obj);
-	}
-	else {
-		PyErr_SetString(PyExc_TypeError, "passphrase should either be None or String Type");
-		return NULL;
-	}
+    if (_pysilc_parse_passphrase(passphrase_obj, &passphrase) < 0)
+        return NULL;
 
 	// Use the passphrase passed.
-    bool result = silc_load_key_pair(pub_filename, prv_filename,
-                                     passphrase, &public_key,
-                                     &private_key);
+    bool result;
+    Py_BEGIN_ALLOW_THREADS
+    result = silc_load_key_pair(pub_filename, prv_filename,
+                                passphrase, &public_key,
+                                &private_key);
+    Py_END_ALLOW_THREADS
 
     if (!result) {
 		PyErr_SetString(PyExc_RuntimeError, "Unable to load keys.");
@@ -381,14 +728,19 @@ static PyObject *pysilc_add_channel_private_key(PyObject *self, PyObject *args)
   PySilcChannel *channel;
   const char *name;
   unsigned char *key;
-  SilcUInt32 key_len;
-  SilcChannelPrivateKey *ret_key = NULL;
+  int key_len;
+  SilcChannelPrivateKey ret_key = NULL;
   SilcBool result;
-    
-  if (!PyArg_ParseTuple(args, "Oss#", &channel, &name, &key, (int) &key_len))
+  PyObject *pykey;
+
+  if (!PyArg_ParseTuple(args, "Oss#", &channel, &name, &key, &key_len))
     return NULL;
   if (!PyObject_IsInstance((PyObject *)channel, (PyObject *)&PySilcChannel_Type))
     return NULL;
+  if (!pyclient->silcobj || !channel->silcobj) {
+    PyErr_SetString(PyExc_RuntimeError, "SILC Client Not Initialised");
+    return NULL;
+  }
   result = silc_client_add_channel_private_key(pyclient->silcobj,
                                                pyclient->silcconn,
                                                channel->silcobj,
@@ -397,6 +749,38 @@ static PyObject *pysilc_add_channel_private_key(PyObject *self, PyObject *args)
                                                NULL,
                                                key,
                                                key_len,
-                                               ret_key);
-  return Py_BuildValue("B", result);
+                                               &ret_key);
+  if (!result || !ret_key)
+    Py_RETURN_NONE;
+
+  _pysilc_channel_keys_add(pyclient->channel_keys, channel->silcobj, ret_key);
+  if (!(pykey = PySilcChannelPrivateKey_New(channel->silcobj, ret_key)))
+    return NULL;
+  return pykey;
+}
+
+static PyObject *pysilc_del_channel_private_key(PyObject *self, PyObject *args) {
+  PySilcClient *pyclient = (PySilcClient *)self;
+  PySilcChannel *channel;
+  PyObject *pykey;
+  SilcChannelPrivateKey key;
+  SilcBool result;
+
+  if (!PyArg_ParseTuple(args, "OO", &channel, &pykey))
+    return NULL;
+  if (!PyObject_IsInstance((PyObject *)channel, (PyObject *)&PySilcChannel_Type))
+    return NULL;
+  if (!pyclient->silcobj || !channel->silcobj) {
+    PyErr_SetString(PyExc_RuntimeError, "SILC Client Not Initialised");
+    return NULL;
+  }
+  if (!(key = _pysilc_client_find_channel_key(pyclient, channel, pykey)))
+    return NULL;
+
+  _pysilc_channel_keys_del(pyclient->channel_keys, &channel->silcobj->id,
+                           key->name);
+  result = silc_client_del_channel_private_key(pyclient->silcobj,
+                                               pyclient->silcconn,
+                                               channel->silcobj, key);
+  return PyBool_FromLong(result);
 }
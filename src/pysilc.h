@@ -27,15 +27,31 @@
 #include <silcclient.h>
 #include <silctypes.h>
 
+#define PYSILC_ID_MAX_LEN 32
+
 typedef struct {
     PyObject_HEAD
-//    SilcChannelId   *silcid;
+    SilcIdType      type;
+    SilcUInt32      len;
+    long            hash;
+    unsigned char   data[PYSILC_ID_MAX_LEN];
+} PySilcID;
+
+typedef struct {
+    PyObject_HEAD
+    PySilcID        *id;    // encoded channel id, built on first use
+    PyObject        *private_key; // key of the message it came with
     SilcChannelEntry silcobj;
 } PySilcChannel;
 
 typedef struct {
     PyObject_HEAD
-//    SilcClientId    *silcid;
+    SilcChannelID    channel_id;
+    char            *name;
+} PySilcChannelPrivateKey;
+
+typedef struct {
+    PyObject_HEAD
     SilcClientEntry  silcobj;
 } PySilcUser;
 
@@ -45,6 +61,134 @@ typedef struct {
     SilcPrivateKey  private;
 } PySilcKeys;
 
+// pysilc flags added above the 16 bit SILC message flags
+#define PYSILC_MESSAGE_SIGNATURE_VERIFIED   0x10000
+#define PYSILC_MESSAGE_SIGNATURE_FAILED     0x20000
+#define PYSILC_MESSAGE_SIGNATURE_UNVERIFIED 0x40000
+
+#define PYSILC_TRUST_UNKNOWN    0
+#define PYSILC_TRUST_TRUSTED    1
+#define PYSILC_TRUST_MISMATCH   2
+
+#define PYSILC_FILTER_ACCEPT    0
+#define PYSILC_FILTER_DROP      1
+
+#define PYSILC_QUEUE_BLOCK          0
+#define PYSILC_QUEUE_DROP_OLDEST    1
+#define PYSILC_QUEUE_DROP_NEWEST    2
+#define PYSILC_QUEUE_SAMPLE         3
+
+/* Events counted by client.stats(), one per Python callback. The
+   names are in _pysilc_stats_names. */
+typedef enum {
+    PYSILC_STAT_RUNNING = 0,
+    PYSILC_STAT_CONNECTED,
+    PYSILC_STAT_DISCONNECTED,
+    PYSILC_STAT_FAILURE,
+    PYSILC_STAT_SAY,
+    PYSILC_STAT_COMMAND,
+    PYSILC_STAT_CHANNEL_MESSAGE,
+    PYSILC_STAT_PRIVATE_MESSAGE,
+    PYSILC_STAT_NOTIFY_NONE,
+    PYSILC_STAT_NOTIFY_INVITE,
+    PYSILC_STAT_NOTIFY_JOIN,
+    PYSILC_STAT_NOTIFY_LEAVE,
+    PYSILC_STAT_NOTIFY_SIGNOFF,
+    PYSILC_STAT_NOTIFY_TOPIC_SET,
+    PYSILC_STAT_NOTIFY_NICK_CHANGE,
+    PYSILC_STAT_NOTIFY_CMODE_CHANGE,
+    PYSILC_STAT_NOTIFY_CUMODE_CHANGE,
+    PYSILC_STAT_NOTIFY_MOTD,
+    PYSILC_STAT_NOTIFY_CHANNEL_CHANGE,
+    PYSILC_STAT_NOTIFY_SERVER_SIGNOFF,
+    PYSILC_STAT_NOTIFY_KICKED,
+    PYSILC_STAT_NOTIFY_KILLED,
+    PYSILC_STAT_NOTIFY_ERROR,
+    PYSILC_STAT_NOTIFY_WATCH,
+    PYSILC_STAT_COMMAND_REPLY_WHOIS,
+    PYSILC_STAT_COMMAND_REPLY_WHOWAS,
+    PYSILC_STAT_COMMAND_REPLY_IDENTIFY,
+    PYSILC_STAT_COMMAND_REPLY_NICK,
+    PYSILC_STAT_COMMAND_REPLY_LIST,
+    PYSILC_STAT_COMMAND_REPLY_TOPIC,
+    PYSILC_STAT_COMMAND_REPLY_INVITE,
+    PYSILC_STAT_COMMAND_REPLY_KILL,
+    PYSILC_STAT_COMMAND_REPLY_INFO,
+    PYSILC_STAT_COMMAND_REPLY_STATS,
+    PYSILC_STAT_COMMAND_REPLY_PING,
+    PYSILC_STAT_COMMAND_REPLY_OPER,
+    PYSILC_STAT_COMMAND_REPLY_JOIN,
+    PYSILC_STAT_COMMAND_REPLY_MOTD,
+    PYSILC_STAT_COMMAND_REPLY_CMODE,
+    PYSILC_STAT_COMMAND_REPLY_CUMODE,
+    PYSILC_STAT_COMMAND_REPLY_KICK,
+    PYSILC_STAT_COMMAND_REPLY_BAN,
+    PYSILC_STAT_COMMAND_REPLY_DETACH,
+    PYSILC_STAT_COMMAND_REPLY_WATCH,
+    PYSILC_STAT_COMMAND_REPLY_SILCOPER,
+    PYSILC_STAT_COMMAND_REPLY_LEAVE,
+    PYSILC_STAT_COMMAND_REPLY_USERS,
+    PYSILC_STAT_COMMAND_REPLY_SERVICE,
+    PYSILC_STAT_COMMAND_REPLY_FAILED,
+    PYSILC_STAT_VERIFY_PUBLIC_KEY,
+    PYSILC_STAT_ASK_PASSPHRASE,
+    PYSILC_STAT_KEY_AGREEMENT,
+    PYSILC_STAT_KEY_AGREEMENT_COMPLETED,
+    PYSILC_STAT_FTP,
+    PYSILC_STAT_FILE_MONITOR,
+    PYSILC_STAT_FILE_ASK_NAME,
+    PYSILC_STAT_NOTIFY_JOIN_BATCH,
+    PYSILC_STAT_NOTIFY_LEAVE_BATCH,
+    PYSILC_STAT_NOTIFY_SIGNOFF_BATCH,
+    PYSILC_STAT_MAX
+} PySilcStatEvent;
+
+// log2 latency buckets in microseconds, the last one is open ended
+#define PYSILC_STAT_BUCKETS 24
+
+/* Live object accounting, compiled in with PYSILC_ACCOUNTING (set the
+   environment variable of the same name when running setup.py). */
+typedef enum {
+    PYSILC_LIVE_USER = 0,
+    PYSILC_LIVE_CHANNEL,
+    PYSILC_LIVE_ID,
+    PYSILC_LIVE_KEYS,
+    PYSILC_LIVE_CHANNEL_PRIVATE_KEY,
+    PYSILC_LIVE_CLIENT_ENTRY_REF,   // toolkit entries we hold a reference to
+    PYSILC_LIVE_MAX
+} PySilcLiveKind;
+
+#ifdef PYSILC_ACCOUNTING
+static long pysilc_live[PYSILC_LIVE_MAX];
+#define PYSILC_LIVE_INC(kind) (pysilc_live[kind]++)
+#define PYSILC_LIVE_DEC(kind) (pysilc_live[kind]--)
+#else
+#define PYSILC_LIVE_INC(kind) do { } while (0)
+#define PYSILC_LIVE_DEC(kind) do { } while (0)
+#endif
+
+typedef struct {
+    SilcUInt64 calls;
+    SilcUInt64 errors;
+    SilcUInt64 python_ns;       // time spent in the Python callback
+    SilcUInt64 python_max_ns;
+    SilcUInt64 native_ns;       // time from the toolkit callback to Python
+    SilcUInt32 histogram[PYSILC_STAT_BUCKETS];
+} PySilcStat;
+
+
+typedef struct {
+    PyObject_HEAD
+    char            *path;
+    SilcHash         sha1;
+    unsigned char   *map;       // read-only shared mapping of the file
+    size_t           map_len;
+    const unsigned char *records;
+    SilcUInt32       count;
+    time_t           mtime;
+    ino_t            ino;
+} PySilcTrustStore;
+
 typedef struct {
     PyObject_HEAD
 
@@ -57,6 +201,9 @@ typedef struct {
     PyObject *notify_join;
     PyObject *notify_leave;
     PyObject *notify_signoff;
+    PyObject *notify_join_batch;
+    PyObject *notify_leave_batch;
+    PyObject *notify_signoff_batch;
     PyObject *notify_topic_set;
     PyObject *notify_nick_change;
     PyObject *notify_cmode_change;
@@ -97,14 +244,50 @@ typedef struct {
     PyObject *command_reply_failed; // custom handler
 
     PySilcKeys *keys;
+    PyObject *trust_store;
+
+    int verify_signatures;
+    SilcHash sign_hash;
+    SilcHashTable signer_keys;  // client id -> verified SilcPublicKey
+    SilcHashTable channel_keys; // (channel id, name) -> SilcChannelPrivateKey
+    SilcHashTable ftp_sessions; // session id -> PySilcFtpSession
+
+    PyObject *ftp;
+    PyObject *file_monitor;
+    PyObject *file_ask_name;
+
+    PyObject *key_agreement;
+    PyObject *key_agreement_completed;
+    SilcDList key_agreements;   // queued PySilcKeyAgreement requests
+    int key_agreements_active;
+    int max_key_agreements;
+
+    int stats_enabled;
+    SilcUInt64 stats_entered;       // when the current toolkit callback began
+    SilcUInt64 stats_loop_started;  // when the current run_one began
+    SilcUInt64 stats_loop_calls;
+    SilcUInt64 stats_loop_ns;       // time in run_one, callbacks included
+    SilcUInt64 stats_python_ns;     // time in callbacks, for the loop share
+    PySilcStat stats[PYSILC_STAT_MAX];
+    struct _PySilcTrace *trace;     // event ring buffer, NULL when off
+    struct _PySilcLoopback *loopback; // fake entries for loopback()
+    struct _PySilcRecord *record;   // event recording, NULL when off
+    struct _PySilcReplay *replay;   // entries rebuilt by replay()
+    struct _PySilcReconnect *reconnect; // supervisor, NULL when off
+    struct _PySilcKeepalive *keepalive; // adaptive keepalive, NULL when off
+    struct _PySilcConnectRace *race;    // candidate servers being raced
+    struct _PySilcFilter *filter;       // inbound message rules
+    int filter_default;                 // action when no rule matches
+    struct _PySilcCoalesce *coalesce;   // batched notifies, NULL when off
+    struct _PySilcRoutes *routes;       // per channel and user handlers
+    struct _PySilcQueue *queue;         // prioritized calls, NULL when off
+    int inbound_blocked;                // socket not read, queue is full
 
     // TODO: not used
     PyObject *get_auth_method,
         *verify_public_key,
         *ask_passphrase,
         *failure,
-        *key_agreement,
-        *ftp,
         *detach;
 
     SilcClient                   silcobj;
@@ -112,6 +295,8 @@ typedef struct {
     SilcClientConnectCallback    conncallback;
     SilcClientOperations         callbacks;
     SilcClientConnectionParams   params;
+    unsigned char *resume_data;     // detach data until the resume completes
+    int resumed;                    // the connection resumed a detached one
 
 } PySilcClient;
 
@@ -119,6 +304,14 @@ typedef struct {
 
 static PyObject *pysilc_create_key_pair(PyObject *mod, PyObject *args, PyObject *kwds);
 static PyObject *pysilc_load_key_pair(PyObject *mod, PyObject *args, PyObject *kwds);
+static PyObject *pysilc_create_key_pair_async(PyObject *mod, PyObject *args, PyObject *kwds);
+static PyObject *pysilc_load_key_pair_async(PyObject *mod, PyObject *args, PyObject *kwds);
+static PyObject *pysilc_benchmark(PyObject *mod, PyObject *args, PyObject *kwds);
+static PyObject *pysilc_supported_ciphers(PyObject *mod);
+static PyObject *pysilc_supported_hmacs(PyObject *mod);
+static PyObject *pysilc_live_objects(PyObject *mod);
+static PyObject *pysilc_irc_prefix(PyObject *mod, PyObject *args, PyObject *kwds);
+static PyObject *pysilc_irc_channel(PyObject *mod, PyObject *args);
 
 static PyMethodDef pysilc_functions[] = {
     {
@@ -144,18 +337,120 @@ static PyMethodDef pysilc_functions[] = {
         "(eg. \"\"), then an empty passphrase will be passed."
     },
 
+    {
+        "create_key_pair_async",
+        (PyCFunction)pysilc_create_key_pair_async,
+        METH_VARARGS|METH_KEYWORDS,
+        "create_key_pair_async(callback, public_filename, private_filename,\n"
+        "                      identifier = None, passphrase = None,\n"
+        "                      pkcs_name = None, key_length = 2048)\n\n"
+        "Create a key pair on a worker thread and return immediately.\n"
+        "The thread can not prompt, so with passphrase None the private\n"
+        "key is written without one. When done, callback(keys, error) is called from that thread with\n"
+        "either a SilcKeys object and None or None and an error string."
+    },
+
+    {
+        "load_key_pair_async",
+        (PyCFunction)pysilc_load_key_pair_async,
+        METH_VARARGS|METH_KEYWORDS,
+        "load_key_pair_async(callback, public_filename, private_filename,\n"
+        "                    passphrase)\n\n"
+        "Load a key pair on a worker thread and return immediately.\n"
+        "The passphrase must be a string since the worker can not prompt\n"
+        "for it. callback(keys, error) is called as for\n"
+        "create_key_pair_async."
+    },
+
+    {
+        "benchmark",
+        (PyCFunction)pysilc_benchmark,
+        METH_VARARGS|METH_KEYWORDS,
+        "benchmark(cipher = \"aes-256-cbc\", hmac = \"hmac-sha1-96\",\n"
+        "          size = 256, iterations = 10000, threads = 1,\n"
+        "          mode = \"payload\") -> dict\n\n"
+        "Measure crypto throughput with the GIL released. Each of\n"
+        "'threads' threads processes 'iterations' messages of 'size'\n"
+        "bytes. Mode \"raw\" encrypts and MACs the data, mode \"payload\"\n"
+        "encodes and parses a channel message payload as the send and\n"
+        "receive paths do. Returns the totals and rates as a dict."
+    },
+
+    {
+        "supported_ciphers",
+        (PyCFunction)pysilc_supported_ciphers,
+        METH_NOARGS,
+        "supported_ciphers() -> list\n\n"
+        "Names of the registered ciphers."
+    },
+
+    {
+        "supported_hmacs",
+        (PyCFunction)pysilc_supported_hmacs,
+        METH_NOARGS,
+        "supported_hmacs() -> list\n\n"
+        "Names of the registered HMACs."
+    },
+
+    {
+        "live_objects",
+        (PyCFunction)pysilc_live_objects,
+        METH_NOARGS,
+        "live_objects() -> dict\n\n"
+        "Number of live SilcUser, SilcChannel, SilcID, SilcKeys and\n"
+        "SilcChannelPrivateKey wrappers and of toolkit client entries\n"
+        "referenced by pysilc. With a debug build of Python 'refs' is\n"
+        "the total reference count. Only available when built with\n"
+        "PYSILC_ACCOUNTING, see ACCOUNTING."
+    },
+
+    {
+        "irc_prefix",
+        (PyCFunction)pysilc_irc_prefix,
+        METH_VARARGS|METH_KEYWORDS,
+        "irc_prefix(user, ident = \"\") -> string\n\n"
+        "IRC message prefix nick!ident+username@hostname of a SilcUser."
+    },
+
+    {
+        "irc_channel",
+        (PyCFunction)pysilc_irc_channel,
+        METH_VARARGS,
+        "irc_channel(channel) -> string\n\n"
+        "IRC name of a SilcChannel, its name with a leading '#'."
+    },
+
     {NULL, NULL, 0, NULL},
 };
 
 char *pysilc_doc = "Python SILC Toolkit Bindings.";
 
+/*  ---------------- pysilc id ------------- */
+
+static PyObject *PySilcID_New(SilcIdType type, const unsigned char *data, SilcUInt32 len);
+static PyObject *PySilcID_FromId(const void *id, SilcIdType type);
+static PyObject *PySilcID_TypeNew(PyTypeObject *type, PyObject *args, PyObject *kwds);
+static void      PySilcID_Del(PyObject *object);
+static long      PySilcID_Hash(PyObject *self);
+static PyObject *PySilcID_RichCompare(PyObject *self, PyObject *other, int op);
+static PyObject *PySilcID_Str(PyObject *self);
+static PyObject *PySilcID_Repr(PyObject *self);
+static PyObject *_pysilc_id_richcompare(PySilcID *a, PySilcID *b, int op);
+
+static PyMemberDef pysilc_id_members[] = {
+    {"type", T_USHORT, offsetof(PySilcID, type), READONLY,
+     "One of SILC_ID_CLIENT, SILC_ID_CHANNEL or SILC_ID_SERVER."},
+    {NULL, 0, 0, 0, NULL},
+};
+
 /*  ---------------- pysilc channel ------------- */
 
 static PyObject *PySilcChannel_New(SilcChannelEntry channel);
 static void      PySilcChannel_Del(PyObject *object);
 static PyObject *PySilcChannel_GetAttr(PyObject *self, PyObject *name);
 static PyObject *PySilcChannel_Str(PyObject *self);
-static int PySilcChannel_Compare(PyObject *self, PyObject *other);
+static long PySilcChannel_Hash(PyObject *self);
+static PyObject *PySilcChannel_RichCompare(PyObject *self, PyObject *other, int op);
 
 static PyMethodDef pysilc_channel_methods[] = {
     {NULL, NULL, 0, NULL},
@@ -165,13 +460,27 @@ static PyMemberDef pysilc_channel_members[] = {
     {NULL, 0, 0, 0, NULL},
 };
 
+/*  ---------------- pysilc channel private key ------------- */
+
+static PyObject *PySilcChannelPrivateKey_New(SilcChannelEntry channel,
+                                             SilcChannelPrivateKey key);
+static void PySilcChannelPrivateKey_Del(PyObject *object);
+static PyObject *PySilcChannelPrivateKey_Str(PyObject *self);
+
+static PyMemberDef pysilc_channel_private_key_members[] = {
+    {"name", T_STRING, offsetof(PySilcChannelPrivateKey, name), READONLY,
+     "Name of the key."},
+    {NULL, 0, 0, 0, NULL},
+};
+
 /*  ---------------- pysilc user object  ------------- */
 
 static PyObject *PySilcUser_New(SilcClientEntry user);
 static void PySilcUser_Del(PyObject *object);
 static PyObject *PySilcUser_GetAttr(PyObject *self, PyObject *name);
 static PyObject *PySilcUser_Str(PyObject *self);
-static int PySilcUser_Compare(PyObject *self, PyObject *other);
+static long PySilcUser_Hash(PyObject *self);
+static PyObject *PySilcUser_RichCompare(PyObject *self, PyObject *other, int op);
 
 static PyMethodDef pysilc_user_methods[] = {
     {NULL, NULL, 0, NULL},
@@ -186,14 +495,84 @@ static PyMemberDef pysilc_user_members[] = {
 static PyObject *PySilcKeys_New(SilcPublicKey public, SilcPrivateKey private);
 static void PySilcKeys_Del(PyObject *object);
 
-/*static PyMethodDef pysilc_keys_methods[] = {
+static PyObject *pysilc_keys_from_bytes(PyObject *cls, PyObject *args, PyObject *kwds);
+static PyObject *pysilc_keys_export_public(PyObject *self);
+static PyObject *pysilc_keys_export_private(PyObject *self, PyObject *args, PyObject *kwds);
+
+static PyMethodDef pysilc_keys_methods[] = {
+    {
+        "from_bytes",
+        (PyCFunction)pysilc_keys_from_bytes,
+        METH_VARARGS | METH_KEYWORDS | METH_CLASS,
+        "from_bytes(public, private, passphrase = None) -> SilcKeys\n\n"
+        "Load a key pair from strings holding the contents of the public\n"
+        "and private key files. 'public' may also be a raw encoded public\n"
+        "key."
+    },
+    {
+        "export_public",
+        (PyCFunction)pysilc_keys_export_public,
+        METH_NOARGS,
+        "export_public() -> string\n\n"
+        "Return the public key in the public key file format."
+    },
+    {
+        "export_private",
+        (PyCFunction)pysilc_keys_export_private,
+        METH_VARARGS | METH_KEYWORDS,
+        "export_private(passphrase = None) -> string\n\n"
+        "Return the private key in the private key file format, encrypted\n"
+        "with 'passphrase'."
+    },
     {NULL, NULL, 0, NULL},
-};*/
+};
 
 /*static PyMemberDef pysilc_keys_members[] = {
     {NULL, 0, 0, 0, NULL},
 };*/
 
+/*  ---------------- pysilc trust store ------------- */
+
+static int  PySilcTrustStore_Init(PyObject *self, PyObject *args, PyObject *kwds);
+static void PySilcTrustStore_Del(PyObject *object);
+static Py_ssize_t PySilcTrustStore_Len(PyObject *self);
+static PyObject *pysilc_trust_store_lookup(PyObject *self, PyObject *args);
+static PyObject *pysilc_trust_store_add(PyObject *self, PyObject *args);
+static PyObject *pysilc_trust_store_reload(PyObject *self);
+
+static PyMethodDef pysilc_trust_store_methods[] = {
+    {
+        "lookup",
+        (PyCFunction)pysilc_trust_store_lookup,
+        METH_VARARGS,
+        "lookup(name, fingerprint) -> int\n\n"
+        "Look up the 20 byte SHA-1 'fingerprint' of a public key for a\n"
+        "host or user 'name'. Returns TRUST_TRUSTED, TRUST_MISMATCH if\n"
+        "the name is known with other keys only, or TRUST_UNKNOWN."
+    },
+    {
+        "add",
+        (PyCFunction)pysilc_trust_store_add,
+        METH_VARARGS,
+        "add(name, fingerprint)\n\n"
+        "Trust 'fingerprint' for 'name'. The file is rewritten and\n"
+        "atomically replaced, other processes pick it up on their next\n"
+        "lookup."
+    },
+    {
+        "reload",
+        (PyCFunction)pysilc_trust_store_reload,
+        METH_NOARGS,
+        "reload()\n\n"
+        "Map the store file again."
+    },
+    {NULL, NULL, 0, NULL},
+};
+
+static PySequenceMethods pysilc_trust_store_as_sequence = {
+    PySilcTrustStore_Len, /* sq_length */
+};
+
 /*  ---------------- pysilc client ------------- */
 
 static int  PySilcClient_Init(PyObject *self, PyObject *args, PyObject *kwds);
@@ -206,16 +585,75 @@ static PyObject *pysilc_client_command_call(PyObject *self, PyObject *args, PyOb
 static PyObject *pysilc_client_set_away_message(PyObject *self, PyObject *args);
 static PyObject *pysilc_client_run_one(PyObject *self);
 static PyObject *pysilc_client_remote_host(PyObject *self);
+static PyObject *pysilc_client_fileno(PyObject *self);
+static PyObject *pysilc_client_irc_send(PyObject *self, PyObject *args);
+static PyObject *pysilc_client_auto_reconnect(PyObject *self, PyObject *args, PyObject *kwds);
+static PyObject *pysilc_client_keepalive_info(PyObject *self);
+static PyObject *pysilc_client_add_filter(PyObject *self, PyObject *args, PyObject *kwds);
+static PyObject *pysilc_client_remove_filter(PyObject *self, PyObject *args);
+static PyObject *pysilc_client_clear_filters(PyObject *self);
+static PyObject *pysilc_client_filters(PyObject *self);
+static PyObject *pysilc_client_coalesce_notifies(PyObject *self, PyObject *args);
+static PyObject *pysilc_client_on_channel_message(PyObject *self, PyObject *args);
+static PyObject *pysilc_client_on_private_message(PyObject *self, PyObject *args);
+static PyObject *pysilc_client_prioritize_events(PyObject *self, PyObject *args, PyObject *kwds);
+static PyObject *pysilc_client_limit_events(PyObject *self, PyObject *args, PyObject *kwds);
+static PyObject *pysilc_client_events_pending(PyObject *self);
+static PyObject *pysilc_client_event_queue_info(PyObject *self);
 static PyObject *pysilc_client_user(PyObject *self);
+static PyObject *pysilc_client_joined_channels(PyObject *self);
+static PyObject *pysilc_client_channel_users(PyObject *self, PyObject *args);
 static PyObject *pysilc_add_channel_private_key(PyObject *self, PyObject *args);
+static PyObject *pysilc_del_channel_private_key(PyObject *self, PyObject *args);
+static PyObject *pysilc_client_file_send(PyObject *self, PyObject *args, PyObject *kwds);
+static PyObject *pysilc_client_file_receive(PyObject *self, PyObject *args, PyObject *kwds);
+static PyObject *pysilc_client_file_close(PyObject *self, PyObject *args);
+static PyObject *pysilc_client_file_sessions(PyObject *self);
+static PyObject *pysilc_client_send_key_agreement(PyObject *self, PyObject *args, PyObject *kwds);
+static PyObject *pysilc_client_perform_key_agreement(PyObject *self, PyObject *args, PyObject *kwds);
+static PyObject *pysilc_client_abort_key_agreement(PyObject *self, PyObject *args);
+static PyObject *pysilc_client_del_private_message_key(PyObject *self, PyObject *args);
+static PyObject *pysilc_client_stats(PyObject *self, PyObject *args, PyObject *kwds);
+static PyObject *pysilc_client_trace_start(PyObject *self, PyObject *args, PyObject *kwds);
+static PyObject *pysilc_client_trace_stop(PyObject *self);
+static PyObject *pysilc_client_trace_dump(PyObject *self, PyObject *args);
+static PyObject *pysilc_client_loopback(PyObject *self, PyObject *args, PyObject *kwds);
+static PyObject *pysilc_client_record_start(PyObject *self, PyObject *args);
+static PyObject *pysilc_client_record_stop(PyObject *self);
+static PyObject *pysilc_client_replay(PyObject *self, PyObject *args, PyObject *kwds);
 
 static PyMethodDef pysilc_client_methods[] = {
     {
         "connect_to_server",
         (PyCFunction)pysilc_client_connect_to_server,
         METH_VARARGS | METH_KEYWORDS,
-        "connect_to_server(host, port = 706) -> int\n\n"
-        "Connect to SILC server. Returns -1 on error."
+        "connect_to_server(host, port = 706, detach_data = None,\n"
+        "                  rekey_secs = 0, pfs = False, timeout_secs = 0,\n"
+        "                  keepalive_secs = 0, adaptive_keepalive = 0,\n"
+        "                  udp = False, local_ip = None, bind_ip = None,\n"
+        "                  local_port = 0, passphrase = None,\n"
+        "                  no_authentication = False, stagger = 0.25) -> int\n\n"
+        "Connect to SILC server. Returns -1 on error. 'host' may also be a\n"
+        "list of candidate host names, addresses or (host, port) tuples:\n"
+        "they are connected to in parallel, each 'stagger' seconds after\n"
+        "the previous one or as soon as one fails, and the first to answer\n"
+        "is used while the others are given up. With the\n"
+        "'detach_data' given to command_reply_detach after a DETACH\n"
+        "command, possibly by another process, the detached session is\n"
+        "resumed with its channels instead of starting a new one. The\n"
+        "same keys must be used.\n\n"
+        "The other arguments are the toolkit connection parameters, 0 and\n"
+        "None meaning the toolkit default: the rekey interval and whether\n"
+        "rekeys use PFS, the key exchange timeout, the heartbeat interval,\n"
+        "UDP with its local address and port, the address to bind to, the\n"
+        "server passphrase, which skips get_auth_method, and connecting\n"
+        "without authentication. They are used for the reconnects of\n"
+        "auto_reconnect() as well.\n\n"
+        "A nonzero 'adaptive_keepalive' replaces the heartbeat: the server\n"
+        "is PINGed only after the connection has been idle for a while,\n"
+        "starting at 15 seconds and growing up to 'adaptive_keepalive'\n"
+        "seconds while the PINGs are answered. An unanswered PING closes\n"
+        "the connection, see keepalive_info()."
     },
     {
         "run_one",
@@ -229,18 +667,19 @@ static PyMethodDef pysilc_client_methods[] = {
         (PyCFunction)pysilc_client_send_channel_message,
         METH_VARARGS | METH_KEYWORDS,
         "send_channel_message(channel, messsage, private_key = None,\n"
-        "                     flags = 0)\n\n"
+        "                     flags = 0, sign = False)\n\n"
         "Send a message (Unicode string) to a channel (SilcChannel object).\n"
-        "TODO: flags and private_key support not implemented.\n"
+        "If 'sign' is true the message is signed with the client key.\n"
+        "'private_key' is a SilcChannelPrivateKey or the name of a key\n"
+        "added with add_channel_private_key.\n"
     },
     {
         "send_private_message",
         (PyCFunction)pysilc_client_send_private_message,
         METH_VARARGS | METH_KEYWORDS,
-        "send_private_message(user, messsage, private_key = None,\n"
-        "                     flags = 0)\n\n"
+        "send_private_message(user, messsage, flags = 0, sign = False)\n\n"
         "Send a message (Unicode string) to a user (SilcUser object).\n"
-        "TODO: flags and private_key support not implemented.\n"
+        "If 'sign' is true the message is signed with the client key.\n"
     },
     {
         "command_call",
@@ -264,6 +703,167 @@ static PyMethodDef pysilc_client_methods[] = {
         "remote_host() -> string\n\n"
         "Get remote hostname."
     },
+    {
+        "fileno",
+        (PyCFunction)pysilc_client_fileno,
+        METH_NOARGS,
+        "fileno() -> int\n\n"
+        "Socket of the server connection, for select(). Call run_one()\n"
+        "when it is readable, and at least every second or so for the\n"
+        "toolkit timers."
+    },
+    {
+        "auto_reconnect",
+        (PyCFunction)pysilc_client_auto_reconnect,
+        METH_VARARGS | METH_KEYWORDS,
+        "auto_reconnect(servers, delay = 1.0, max_delay = 60.0)\n\n"
+        "Reconnect by itself when the connection is lost. 'servers' are\n"
+        "host names or (host, port) tuples; a dropped connection is retried\n"
+        "on the same server at once, then each failure moves to the next\n"
+        "one and doubles the wait, from 'delay' up to 'max_delay' seconds\n"
+        "with random jitter. The channels the client is on are rejoined\n"
+        "with their passphrases all at once after reconnecting. The\n"
+        "connected and disconnected callbacks are still called. None turns\n"
+        "it off, e.g. before QUIT."
+    },
+    {
+        "keepalive_info",
+        (PyCFunction)pysilc_client_keepalive_info,
+        METH_NOARGS,
+        "keepalive_info() -> dict\n\n"
+        "State of the adaptive keepalive, or None when it is off: the\n"
+        "current idle interval and its maximum, the longest interval that\n"
+        "was answered and the shortest that was not, in seconds, the\n"
+        "smoothed round trip time and its variation, and the number of\n"
+        "PINGs sent and timed out."
+    },
+    {
+        "add_filter",
+        (PyCFunction)pysilc_client_add_filter,
+        METH_VARARGS | METH_KEYWORDS,
+        "add_filter(action = FILTER_ACCEPT, channel = None, sender = None,\n"
+        "           flags = 0, prefix = None, contains = None,\n"
+        "           regex = None, target = None, tag = None) -> int\n\n"
+        "Add a rule for incoming channel and private messages, checked\n"
+        "before anything is passed to Python. A rule matches messages on\n"
+        "'channel' (never private ones) from the 'sender' nickname, both\n"
+        "compared without case, having all the 'flags', starting with\n"
+        "'prefix', containing 'contains' and matching 'regex', a string\n"
+        "holding a POSIX extended regular expression, not re syntax;\n"
+        "None leaves a field out. The first matching rule decides:\n"
+        "FILTER_DROP discards the message, FILTER_ACCEPT delivers it to\n"
+        "'target' instead of channel_message or private_message when given,\n"
+        "with 'tag' as an extra last argument when given. Messages no rule\n"
+        "matches take filter_default. Returns the rule id."
+    },
+    {
+        "remove_filter",
+        (PyCFunction)pysilc_client_remove_filter,
+        METH_VARARGS,
+        "remove_filter(id) -> bool\n\n"
+        "Remove a rule added with add_filter()."
+    },
+    {
+        "clear_filters",
+        (PyCFunction)pysilc_client_clear_filters,
+        METH_NOARGS,
+        "clear_filters()\n\n"
+        "Remove all the add_filter() rules."
+    },
+    {
+        "filters",
+        (PyCFunction)pysilc_client_filters,
+        METH_NOARGS,
+        "filters() -> list\n\n"
+        "The add_filter() rules in order, as dicts of their fields, id and\n"
+        "the number of messages they matched."
+    },
+    {
+        "coalesce_notifies",
+        (PyCFunction)pysilc_client_coalesce_notifies,
+        METH_VARARGS,
+        "coalesce_notifies(window)\n\n"
+        "Collect JOIN, LEAVE and SIGNOFF notifies for 'window' seconds and\n"
+        "deliver them per channel to notify_join_batch, notify_leave_batch\n"
+        "and notify_signoff_batch, or to the per user callbacks when those\n"
+        "are not set. A join and a leave of the same user on a channel\n"
+        "within the window cancel out, and a signoff drops the user's\n"
+        "pending joins. Other events are not held back, so they may arrive\n"
+        "before the batches. 0 delivers what is pending and turns it off."
+    },
+    {
+        "on_channel_message",
+        (PyCFunction)pysilc_client_on_channel_message,
+        METH_VARARGS,
+        "on_channel_message(channel, handler)\n\n"
+        "Deliver the messages of 'channel' to 'handler' instead of\n"
+        "channel_message, with the same arguments. None removes it. The\n"
+        "target of a matching add_filter() rule still comes first."
+    },
+    {
+        "on_private_message",
+        (PyCFunction)pysilc_client_on_private_message,
+        METH_VARARGS,
+        "on_private_message(user, handler)\n\n"
+        "Deliver the private messages of 'user' to 'handler' instead of\n"
+        "private_message, with the same arguments. None removes it."
+    },
+    {
+        "prioritize_events",
+        (PyCFunction)pysilc_client_prioritize_events,
+        METH_VARARGS | METH_KEYWORDS,
+        "prioritize_events(order = ('private_message', 'command_reply',\n"
+        "                  'channel_message', 'notify'), share = 0.2,\n"
+        "                  budget = 0)\n\n"
+        "Queue the message, notify and command reply callbacks and call\n"
+        "them from run_one() in 'order' of their class, highest first.\n"
+        "While several classes wait, a 'share' of the calls goes to the\n"
+        "longest waiting lower class event; 0 keeps strict order. At most\n"
+        "'budget' calls are made per run_one(), 0 for all that are queued,\n"
+        "so later higher class events can overtake the rest. None as the\n"
+        "order makes the queued calls and turns it off."
+    },
+    {
+        "limit_events",
+        (PyCFunction)pysilc_client_limit_events,
+        METH_VARARGS | METH_KEYWORDS,
+        "limit_events(event_class, limit, policy = QUEUE_DROP_OLDEST,\n"
+        "             sample = 10)\n\n"
+        "Bound the queued calls of an event class of prioritize_events(),\n"
+        "which this turns on with the default order if it is off. When\n"
+        "'limit' calls wait, QUEUE_DROP_NEWEST drops new events,\n"
+        "QUEUE_DROP_OLDEST drops the oldest waiting one, QUEUE_SAMPLE does\n"
+        "so for one in 'sample' new events and drops the rest, and\n"
+        "QUEUE_BLOCK stops reading the connection until there is room.\n"
+        "A limit of 0 removes the bound. event_queue_info() counts the\n"
+        "dropped events."
+    },
+    {
+        "events_pending",
+        (PyCFunction)pysilc_client_events_pending,
+        METH_NOARGS,
+        "events_pending() -> int\n\n"
+        "Number of prioritize_events() calls waiting for run_one()."
+    },
+    {
+        "event_queue_info",
+        (PyCFunction)pysilc_client_event_queue_info,
+        METH_NOARGS,
+        "event_queue_info() -> dict\n\n"
+        "The prioritize_events() configuration and per class counts, or\n"
+        "None when it is off."
+    },
+    {
+        "irc_send",
+        (PyCFunction)pysilc_client_irc_send,
+        METH_VARARGS,
+        "irc_send(command, args) -> bool\n\n"
+        "Send a parsed IRC PRIVMSG, JOIN, PART, TOPIC, NAMES, WHO or NICK\n"
+        "as the SILC message or command. IRC channel names have an extra\n"
+        "leading '#'. Returns False, having sent nothing, for other\n"
+        "commands, unknown channels and nicknames and text that is not\n"
+        "UTF-8, so the caller can fall back to its own handling."
+    },
     {
         "user",
         (PyCFunction)pysilc_client_user,
@@ -271,13 +871,202 @@ static PyMethodDef pysilc_client_methods[] = {
         "user() -> User\n\n"
         "Get current user."
     },
+    {
+        "joined_channels",
+        (PyCFunction)pysilc_client_joined_channels,
+        METH_NOARGS,
+        "joined_channels() -> tuple\n\n"
+        "Channels the current user is on, as the toolkit knows them. After\n"
+        "a resume these are the channels of the detached session."
+    },
+    {
+        "channel_users",
+        (PyCFunction)pysilc_client_channel_users,
+        METH_VARARGS,
+        "channel_users(channel) -> tuple\n\n"
+        "Users on a channel as the toolkit knows them, without a USERS\n"
+        "command."
+    },
     {
         "add_channel_private_key",
         (PyCFunction)pysilc_add_channel_private_key,
         METH_VARARGS,
         "add_channel_private_key(channel, name, key)"
-        "\n\n"
-        "Sets a channel key for the given channel.\n"
+        " -> SilcChannelPrivateKey\n\n"
+        "Sets a channel key for the given channel. Returns a key handle\n"
+        "that can be passed to send_channel_message, or None on failure.\n"
+    },
+    {
+        "del_channel_private_key",
+        (PyCFunction)pysilc_del_channel_private_key,
+        METH_VARARGS,
+        "del_channel_private_key(channel, key)\n\n"
+        "Removes a channel key, given as a handle or by name.\n"
+    },
+    {
+        "file_send",
+        (PyCFunction)pysilc_client_file_send,
+        METH_VARARGS | METH_KEYWORDS,
+        "file_send(user, filepath, hostname = None, port = 0,\n"
+        "          interval = 1.0, step = 0) -> int\n\n"
+        "Offer a file to a user (SilcUser object) and return the session\n"
+        "id. If 'hostname' is given the remote client connects to it,\n"
+        "otherwise it has to provide the connection. file_monitor is\n"
+        "called on state changes and at most every 'interval' seconds\n"
+        "or every 'step' bytes while the file is transferred.\n"
+    },
+    {
+        "file_receive",
+        (PyCFunction)pysilc_client_file_receive,
+        METH_VARARGS | METH_KEYWORDS,
+        "file_receive(session_id, path = None, hostname = None, port = 0,\n"
+        "             interval = 1.0, step = 0)\n\n"
+        "Accept a file offered through the ftp callback and save it in\n"
+        "the directory 'path'. Progress is reported as for file_send.\n"
+    },
+    {
+        "file_close",
+        (PyCFunction)pysilc_client_file_close,
+        METH_VARARGS,
+        "file_close(session_id)\n\n"
+        "Close a file transfer session. Sessions must be closed also\n"
+        "after they have finished or failed.\n"
+    },
+    {
+        "file_sessions",
+        (PyCFunction)pysilc_client_file_sessions,
+        METH_NOARGS,
+        "file_sessions() -> list\n\n"
+        "List of (session_id, status, offset, filesize) tuples of the\n"
+        "open file transfer sessions.\n"
+    },
+    {
+        "send_key_agreement",
+        (PyCFunction)pysilc_client_send_key_agreement,
+        METH_VARARGS | METH_KEYWORDS,
+        "send_key_agreement(user, hostname = None, port = 0, timeout = 0)\n\n"
+        "Request private message key agreement with a user (SilcUser\n"
+        "object). If 'hostname' is given the user connects to it to run\n"
+        "the key exchange. The result is passed to\n"
+        "key_agreement_completed and on success the key is used for\n"
+        "private messages to the user.\n"
+    },
+    {
+        "perform_key_agreement",
+        (PyCFunction)pysilc_client_perform_key_agreement,
+        METH_VARARGS | METH_KEYWORDS,
+        "perform_key_agreement(user, hostname, port, timeout = 0)\n\n"
+        "Connect to the host and port a user sent in a key agreement\n"
+        "request and run the key exchange. Completes as\n"
+        "send_key_agreement.\n"
+    },
+    {
+        "abort_key_agreement",
+        (PyCFunction)pysilc_client_abort_key_agreement,
+        METH_VARARGS,
+        "abort_key_agreement(user)\n\n"
+        "Abort queued and running key agreements with a user.\n"
+    },
+    {
+        "del_private_message_key",
+        (PyCFunction)pysilc_client_del_private_message_key,
+        METH_VARARGS,
+        "del_private_message_key(user) -> bool\n\n"
+        "Remove the private message key set with a user, so messages\n"
+        "fall back to the session keys.\n"
+    },
+    {
+        "stats",
+        (PyCFunction)pysilc_client_stats,
+        METH_VARARGS | METH_KEYWORDS,
+        "stats(reset = False) -> dict\n\n"
+        "Callback statistics keyed by callback name, for callbacks that\n"
+        "were called. Each value is a dict with 'calls', 'errors',\n"
+        "'python_time' and 'python_max' (seconds spent in the callback),\n"
+        "'native_time' (seconds from the toolkit event to the callback,\n"
+        "building the arguments) and 'histogram', a list of call counts\n"
+        "whose n-th entry counts callbacks that took less than 2**n\n"
+        "microseconds. The 'loop' entry has the 'calls' and 'time' of\n"
+        "run_one and its 'native_time', the time outside callbacks spent\n"
+        "in network I/O, decryption and decoding. If 'reset' is true the\n"
+        "counters are cleared after reading.\n"
+    },
+    {
+        "trace_start",
+        (PyCFunction)pysilc_client_trace_start,
+        METH_VARARGS | METH_KEYWORDS,
+        "trace_start(size = 65536)\n\n"
+        "Start recording a timeline of every callback into a ring buffer\n"
+        "of 'size' events, replacing any previous one. The oldest events\n"
+        "are overwritten when it is full.\n"
+    },
+    {
+        "trace_stop",
+        (PyCFunction)pysilc_client_trace_stop,
+        METH_NOARGS,
+        "trace_stop()\n\n"
+        "Stop recording and discard the ring buffer.\n"
+    },
+    {
+        "trace_dump",
+        (PyCFunction)pysilc_client_trace_dump,
+        METH_VARARGS,
+        "trace_dump(filename) -> int\n\n"
+        "Write the recorded events to a file in Chrome trace event JSON\n"
+        "format, for chrome://tracing or Perfetto, and return the number\n"
+        "of events written. Each callback has a 'decode' span while its\n"
+        "arguments are built and a span for the Python callback itself.\n"
+        "The first callback of a run_one also has a 'read' span from the\n"
+        "start of run_one, which covers reading and decrypting the\n"
+        "packet, until the toolkit handed over the event.\n"
+        "Recording continues.\n"
+    },
+    {
+        "loopback",
+        (PyCFunction)pysilc_client_loopback,
+        METH_VARARGS | METH_KEYWORDS,
+        "loopback(events = 'channel_message', count = 10000, size = 256,\n"
+        "         users = 16, channels = 4) -> dict\n\n"
+        "Deliver 'count' made up events to this client's callbacks through\n"
+        "the same native callbacks the toolkit calls, without a server or\n"
+        "a connection. 'events' is a comma separated list of\n"
+        "channel_message, private_message, join, leave and whois, which\n"
+        "are delivered in turn, from 'users' fake users on 'channels' fake\n"
+        "channels. Messages are 'size' bytes. Returns 'events_per_sec' and\n"
+        "the 'p50', 'p99' and 'max' seconds from the native callback entry\n"
+        "to the return of the Python callback. The fake users and channels\n"
+        "stay valid until a run with different counts or the client is\n"
+        "deleted.\n"
+    },
+    {
+        "record_start",
+        (PyCFunction)pysilc_client_record_start,
+        METH_VARARGS,
+        "record_start(filename)\n\n"
+        "Record the channel and private messages, join, leave, signoff,\n"
+        "nick change, topic and kick notifies and WHOIS, LEAVE and USERS\n"
+        "replies this client receives to a file, for replay(). Replaces\n"
+        "a recording in progress.\n"
+    },
+    {
+        "record_stop",
+        (PyCFunction)pysilc_client_record_stop,
+        METH_NOARGS,
+        "record_stop() -> int\n\n"
+        "Finish the recording and return the number of events written.\n"
+    },
+    {
+        "replay",
+        (PyCFunction)pysilc_client_replay,
+        METH_VARARGS | METH_KEYWORDS,
+        "replay(filename, speed = 0) -> dict\n\n"
+        "Deliver the events of a recording to this client's callbacks,\n"
+        "without a connection. With speed 0 events follow each other as\n"
+        "fast as the callbacks return; otherwise they are paced like the\n"
+        "recording, 'speed' times faster. Returns 'events', 'skipped',\n"
+        "'seconds' and 'events_per_sec'. Signatures are not verified\n"
+        "again. The users and channels stay valid until the client is\n"
+        "deleted.\n"
     },
     {NULL, NULL, 0, NULL},
 };
@@ -323,7 +1112,17 @@ static PyMemberDef pysilc_client_members[] = {
     PYSILC_MEMBER_OBJ_DEF(PySilcClient, notify_leave,
                           "notify_leave(user_leaving, channel)"),
     PYSILC_MEMBER_OBJ_DEF(PySilcClient, notify_signoff,
-                          "notify_signoff(user_signedoff, message)"),
+                          "notify_signoff(user_signedoff, message, channel)"),
+    PYSILC_MEMBER_OBJ_DEF(PySilcClient, notify_join_batch,
+                          "notify_join_batch(channel, users)\n\n"
+                          "The joins coalesce_notifies() collected, 'users'\n"
+                          "is a tuple in the order they joined"),
+    PYSILC_MEMBER_OBJ_DEF(PySilcClient, notify_leave_batch,
+                          "notify_leave_batch(channel, users)"),
+    PYSILC_MEMBER_OBJ_DEF(PySilcClient, notify_signoff_batch,
+                          "notify_signoff_batch(channel, users, messages)\n\n"
+                          "'channel' is None for users on no channel with us,\n"
+                          "'messages' are the signoff messages of 'users'"),
     PYSILC_MEMBER_OBJ_DEF(PySilcClient, notify_topic_set,
                           "notify_topic_set(type, user, channel, topic)"),
     PYSILC_MEMBER_OBJ_DEF(PySilcClient, notify_nick_change,
@@ -391,7 +1190,7 @@ static PyMemberDef pysilc_client_members[] = {
                           "command_reply_ban(channel, ban_list)\n"
                           "TODO: ban list not implemented"),
     PYSILC_MEMBER_OBJ_DEF(PySilcClient, command_reply_detach,
-                          "command_reply_detach()"),
+                          "command_reply_detach(detach_data)"),
     PYSILC_MEMBER_OBJ_DEF(PySilcClient, command_reply_watch,
                           "command_reply_watch()"),
     PYSILC_MEMBER_OBJ_DEF(PySilcClient, command_reply_silcoper,
@@ -406,6 +1205,66 @@ static PyMemberDef pysilc_client_members[] = {
     PYSILC_MEMBER_OBJ_DEF(PySilcClient, command_reply_failed,
                           "command_reply_failed(command, command_name, status"
                           ", msg)"),
+
+    {"verify_signatures", T_INT, offsetof(PySilcClient, verify_signatures), 0,
+     "If true, signed channel and private messages are verified before\n"
+     "delivery and MESSAGE_SIGNATURE_VERIFIED or\n"
+     "MESSAGE_SIGNATURE_FAILED is added to the message flags.\n"
+     "MESSAGE_SIGNATURE_UNVERIFIED means the signature matches a key\n"
+     "the message carried itself, which neither the trust_store nor\n"
+     "verify_public_key(nickname, 0, conn_type, fingerprint, status)\n"
+     "vouched for.\n"
+     "Defaults to True."},
+
+    PYSILC_MEMBER_OBJ_DEF(PySilcClient, trust_store,
+                          "A SilcTrustStore used to verify server public\n"
+                          "keys without calling into Python. Keys it does\n"
+                          "not trust are passed to\n"
+                          "verify_public_key(host, port, conn_type,\n"
+                          "fingerprint, trust_status), which returns True\n"
+                          "to accept the key. With a store and no callback\n"
+                          "such keys are rejected."),
+
+    PYSILC_MEMBER_OBJ_DEF(PySilcClient, ftp,
+                          "ftp(user, session_id, hostname, port)\n\n"
+                          "Callback function when a user offers a file.\n"
+                          "Accept it with file_receive(session_id)."),
+    PYSILC_MEMBER_OBJ_DEF(PySilcClient, file_monitor,
+                          "file_monitor(user, session_id, status, error,\n"
+                          "offset, filesize, filepath)\n\n"
+                          "Callback function for file transfer progress.\n"
+                          "'status' is one of SILC_CLIENT_FILE_MONITOR_*\n"
+                          "and 'error' one of SILC_CLIENT_FILE_*."),
+    PYSILC_MEMBER_OBJ_DEF(PySilcClient, file_ask_name,
+                          "file_ask_name(session_id, remote_filename)\n\n"
+                          "Optional callback returning the local file name\n"
+                          "for a received file, or None to keep the name\n"
+                          "given by the sender."),
+
+    PYSILC_MEMBER_OBJ_DEF(PySilcClient, key_agreement,
+                          "key_agreement(user, hostname, protocol, port)\n\n"
+                          "Callback function when a user requests key\n"
+                          "agreement. Returning True accepts: the key\n"
+                          "exchange is performed with 'hostname' and\n"
+                          "'port', or a request is sent back if the user\n"
+                          "gave none."),
+    PYSILC_MEMBER_OBJ_DEF(PySilcClient, key_agreement_completed,
+                          "key_agreement_completed(user, status)\n\n"
+                          "Callback function when a key agreement ends.\n"
+                          "'status' is one of SILC_KEY_AGREEMENT_*."),
+    {"filter_default", T_INT, offsetof(PySilcClient, filter_default), 0,
+     "What happens to messages no add_filter() rule matches,\n"
+     "FILTER_ACCEPT or FILTER_DROP. Defaults to FILTER_ACCEPT."},
+    {"max_key_agreements", T_INT, offsetof(PySilcClient, max_key_agreements),
+     0,
+     "Number of key exchanges run at the same time. Further requests\n"
+     "are queued. Defaults to 4."},
+    {"stats_enabled", T_INT, offsetof(PySilcClient, stats_enabled), 0,
+     "If true, callback statistics are collected for stats().\n"
+     "Defaults to True."},
+    {"resumed", T_INT, offsetof(PySilcClient, resumed), READONLY,
+     "True when the connection resumed a detached session, so the\n"
+     "channels are already joined, see joined_channels()."},
     {NULL, 0, 0, 0, NULL},
 };
 
@@ -467,10 +1326,12 @@ static PyTypeObject PySilcClient_Type = {
 #define PYSILC_CHANNEL_DOC "A Silc Channel Object.\n\n\
 Attributes accessible:\n\n\
   channel_name = string\n\n\
-  channel_id = string (64-160bit)\n\n\
+  channel_id = SilcID\n\n\
   mode = int\n\n\
   topic = string\n\n\
-  user_limit = int"
+  user_limit = int\n\n\
+  private_key = SilcChannelPrivateKey that decrypted the message the\n\
+                object was delivered with, or None"
 
 static PyTypeObject PySilcChannel_Type = {
     PyObject_HEAD_INIT(&PyType_Type)
@@ -482,12 +1343,12 @@ static PyTypeObject PySilcChannel_Type = {
     0, /* tp_print */
     0, /* tp_getattr */
     0, /* tp_setattr */
-    PySilcChannel_Compare, /* tp_compare */
+    0, /* tp_compare */
     0, /* tp_repr */
     0, /* tp_as_number */
     0, /* tp_as_sequence */
     0, /* tp_as_mapping */
-    0, /* tp_has */
+    PySilcChannel_Hash, /* tp_hash */
     0, /* tp_call */
     PySilcChannel_Str, /* tp_str */
     PySilcChannel_GetAttr, /* tp_getattro */
@@ -497,7 +1358,7 @@ static PyTypeObject PySilcChannel_Type = {
     PYSILC_CHANNEL_DOC, /* tp_doc */
     0, /* tp_traverse */
     0, /* tp_call */
-    0, /* tp_richcompare */
+    PySilcChannel_RichCompare, /* tp_richcompare */
     0, /* tp_weaklistoffset */
     0, /* tp_iter */
     0, /* tp_iternext */
@@ -514,6 +1375,53 @@ static PyTypeObject PySilcChannel_Type = {
     0, /* tp_new */
 };
 
+#define PYSILC_CHANNEL_PRIVATE_KEY_DOC "A handle to a channel private key.\n\
+Returned by SilcClient.add_channel_private_key and set as the\n\
+private_key attribute of channels delivered with messages that were\n\
+decrypted with a private key."
+
+static PyTypeObject PySilcChannelPrivateKey_Type = {
+    PyObject_HEAD_INIT(&PyType_Type)
+    0, /* ob_size */
+    "SilcChannelPrivateKey", /* tp_name */
+    sizeof(PySilcChannelPrivateKey), /* tp_basicsize */
+    0, /* tp_itemsize */
+    PySilcChannelPrivateKey_Del, /* tp_dealloc */
+    0, /* tp_print */
+    0, /* tp_getattr */
+    0, /* tp_setattr */
+    0, /* tp_compare */
+    0, /* tp_repr */
+    0, /* tp_as_number */
+    0, /* tp_as_sequence */
+    0, /* tp_as_mapping */
+    0, /* tp_hash */
+    0, /* tp_call */
+    PySilcChannelPrivateKey_Str, /* tp_str */
+    0, /* tp_getattro */
+    0, /* tp_setattro */
+    0, /* tp_as_buffer */
+    Py_TPFLAGS_DEFAULT, /* tp_flags */
+    PYSILC_CHANNEL_PRIVATE_KEY_DOC, /* tp_doc */
+    0, /* tp_traverse */
+    0, /* tp_clear */
+    0, /* tp_richcompare */
+    0, /* tp_weaklistoffset */
+    0, /* tp_iter */
+    0, /* tp_iternext */
+    0, /* tp_methods */
+    pysilc_channel_private_key_members, /* tp_members */
+    0, /* tp_getset */
+    0, /* tp_base */
+    0, /* tp_dict */
+    0, /* tp_descr_get */
+    0, /* tp_descr_set */
+    0, /* tp_dictoffset */
+    0, /* tp_init */
+    0, /* tp_alloc */
+    0, /* tp_new */
+};
+
 #define PYSILC_USER_DOC "A Silc User Object.\n\n\
 Accessible Attributes:\n\n\
   nickname = string\n\n\
@@ -522,8 +1430,10 @@ Accessible Attributes:\n\n\
   server = string\n\n\
   realname = string\n\n\
   fingerprint = string\n\n\
-  user_id = string (64/160bit)\n\n\
-  mode = int"
+  user_id = SilcID\n\n\
+  mode = int\n\n\
+Users hash and compare by their current id, which changes when the\n\
+user changes nickname."
 
 static PyTypeObject PySilcUser_Type = {
     PyObject_HEAD_INIT(&PyType_Type)
@@ -535,12 +1445,12 @@ static PyTypeObject PySilcUser_Type = {
     0, /* tp_print */
     0, /* tp_getattr */
     0, /* tp_setattr */
-    PySilcUser_Compare, /* tp_compare */
+    0, /* tp_compare */
     0, /* tp_repr */
     0, /* tp_as_number */
     0, /* tp_as_sequence */
     0, /* tp_as_mapping */
-    0, /* tp_has */
+    PySilcUser_Hash, /* tp_hash */
     0, /* tp_call */
     PySilcUser_Str, /* tp_str */
     PySilcUser_GetAttr, /* tp_getattro */
@@ -550,7 +1460,7 @@ static PyTypeObject PySilcUser_Type = {
     PYSILC_USER_DOC, /* tp_doc */
     0, /* tp_traverse */
     0, /* tp_call */
-    0, /* tp_richcompare */
+    PySilcUser_RichCompare, /* tp_richcompare */
     0, /* tp_weaklistoffset */
     0, /* tp_iter */
     0, /* tp_iternext */
@@ -567,9 +1477,106 @@ static PyTypeObject PySilcUser_Type = {
     0, /* tp_new */
 };
 
+#define PYSILC_ID_DOC "SilcID(type, data)\n\n\
+An immutable, hashable SILC client, channel or server id. 'type'\n\
+is one of SILC_ID_CLIENT, SILC_ID_CHANNEL or SILC_ID_SERVER and\n\
+'data' is the encoded id as returned by str(id). SilcUser and\n\
+SilcChannel objects hash and compare by their id, so they can be\n\
+used directly as set members and dictionary keys."
+
+static PyTypeObject PySilcID_Type = {
+    PyObject_HEAD_INIT(&PyType_Type)
+    0, /* ob_size */
+    "SilcID", /* tp_name */
+    sizeof(PySilcID), /* tp_basicsize */
+    0, /* tp_itemsize */
+    PySilcID_Del, /* tp_dealloc */
+    0, /* tp_print */
+    0, /* tp_getattr */
+    0, /* tp_setattr */
+    0, /* tp_compare */
+    PySilcID_Repr, /* tp_repr */
+    0, /* tp_as_number */
+    0, /* tp_as_sequence */
+    0, /* tp_as_mapping */
+    PySilcID_Hash, /* tp_hash */
+    0, /* tp_call */
+    PySilcID_Str, /* tp_str */
+    0, /* tp_getattro */
+    0, /* tp_setattro */
+    0, /* tp_as_buffer */
+    Py_TPFLAGS_DEFAULT, /* tp_flags */
+    PYSILC_ID_DOC, /* tp_doc */
+    0, /* tp_traverse */
+    0, /* tp_clear */
+    PySilcID_RichCompare, /* tp_richcompare */
+    0, /* tp_weaklistoffset */
+    0, /* tp_iter */
+    0, /* tp_iternext */
+    0, /* tp_methods */
+    pysilc_id_members, /* tp_members */
+    0, /* tp_getset */
+    0, /* tp_base */
+    0, /* tp_dict */
+    0, /* tp_descr_get */
+    0, /* tp_descr_set */
+    0, /* tp_dictoffset */
+    0, /* tp_init */
+    0, /* tp_alloc */
+    PySilcID_TypeNew, /* tp_new */
+};
+
+#define PYSILC_TRUST_STORE_DOC "SilcTrustStore(path)\n\n\
+A memory mapped database of trusted public key fingerprints keyed by\n\
+host or user name. Lookups are done in C against the shared read-only\n\
+mapping, so many processes can use the same store. A missing file is\n\
+an empty store."
+
+static PyTypeObject PySilcTrustStore_Type = {
+    PyObject_HEAD_INIT(&PyType_Type)
+    0, /* ob_size */
+    "SilcTrustStore", /* tp_name */
+    sizeof(PySilcTrustStore), /* tp_basicsize */
+    0, /* tp_itemsize */
+    PySilcTrustStore_Del, /* tp_dealloc */
+    0, /* tp_print */
+    0, /* tp_getattr */
+    0, /* tp_setattr */
+    0, /* tp_compare */
+    0, /* tp_repr */
+    0, /* tp_as_number */
+    &pysilc_trust_store_as_sequence, /* tp_as_sequence */
+    0, /* tp_as_mapping */
+    0, /* tp_hash */
+    0, /* tp_call */
+    0, /* tp_str */
+    0, /* tp_getattro */
+    0, /* tp_setattro */
+    0, /* tp_as_buffer */
+    Py_TPFLAGS_DEFAULT | Py_TPFLAGS_BASETYPE, /* tp_flags */
+    PYSILC_TRUST_STORE_DOC, /* tp_doc */
+    0, /* tp_traverse */
+    0, /* tp_clear */
+    0, /* tp_richcompare */
+    0, /* tp_weaklistoffset */
+    0, /* tp_iter */
+    0, /* tp_iternext */
+    pysilc_trust_store_methods, /* tp_methods */
+    0, /* tp_members */
+    0, /* tp_getset */
+    0, /* tp_base */
+    0, /* tp_dict */
+    0, /* tp_descr_get */
+    0, /* tp_descr_set */
+    0, /* tp_dictoffset */
+    PySilcTrustStore_Init, /* tp_init */
+    0, /* tp_alloc */
+    PyType_GenericNew, /* tp_new */
+};
+
 #define PYSILC_KEYS_DOC "Silc Key Pair. These are generated by\n\
-silc.create_key_pair and/or silc.load_key_pair and is required\n\
-by SilcClient."
+silc.create_key_pair, silc.load_key_pair and/or SilcKeys.from_bytes\n\
+and is required by SilcClient."
 
 static PyTypeObject PySilcKeys_Type = {
     PyObject_HEAD_INIT(&PyType_Type)
@@ -600,7 +1607,7 @@ static PyTypeObject PySilcKeys_Type = {
     0, /* tp_weaklistoffset */
     0, /* tp_iter */
     0, /* tp_iternext */
-    pysilc_user_methods, /* tp_methods */
+    pysilc_keys_methods, /* tp_methods */
     pysilc_user_members, /* tp_members */
     0, /* tp_getset */
     0, /* tp_base */
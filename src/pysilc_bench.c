@@ -0,0 +1,272 @@
+/*
+ *
+ * PySilc - Python SILC Toolkit Bindings
+ *
+ * Copyright (c) 2006, Alastair Tse <alastair@liquidx.net>
+ * Copyright (c) 2007, Martynas Venckus <martynas@altroot.org>
+ * All rights reserved.
+ *
+ * This program is free software; you can redistributed it and/or modify
+ * it under the terms of the BSD License. See LICENSE in the distribution
+ * for details or http://www.liquidx.net/pysilc/.
+ *
+ */
+
+#include "pysilc.h"
+#include <pthread.h>
+#include <time.h>
+
+/*
+ * Crypto throughput benchmarks. Each thread allocates its own cipher,
+ * HMAC and RNG since the toolkit contexts keep per-message state, and
+ * runs without the GIL.
+ */
+
+#define PYSILC_BENCH_RAW      0   // cipher encrypt followed by HMAC
+#define PYSILC_BENCH_PAYLOAD  1   // message payload encode and parse
+
+typedef struct _PySilcBench_Thread
+{
+    pthread_t thread;
+    const char *cipher_name;
+    const char *hmac_name;
+    int mode;
+    SilcUInt32 size;
+    SilcUInt32 iterations;
+    SilcUInt32 done;
+    SilcUInt64 bytes;       // processed, raw mode rounds size up to blocks
+    int error;
+} PySilcBench_Thread;
+
+static double _pysilc_bench_now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int _pysilc_bench_cipher(const char *name, unsigned char *key,
+                                SilcBool encryption,
+                                SilcCipher *cipher)
+{
+    if (!silc_cipher_alloc((unsigned char *)name, cipher))
+        return -1;
+    if (!silc_cipher_set_key(*cipher, key, silc_cipher_get_key_len(*cipher),
+                             encryption)) {
+        silc_cipher_free(*cipher);
+        return -1;
+    }
+    return 0;
+}
+
+static void _pysilc_bench_raw(PySilcBench_Thread *t, SilcCipher cipher,
+                              SilcHmac hmac, unsigned char *data,
+                              SilcUInt32 len)
+{
+    unsigned char iv[SILC_CIPHER_MAX_IV_SIZE];
+    unsigned char mac[SILC_HASH_MAXLEN];
+    SilcUInt32 mac_len, i;
+
+    memset(iv, 0, sizeof(iv));
+    for (i = 0; i < t->iterations; i++) {
+        if (!silc_cipher_encrypt(cipher, data, data, len, iv)) {
+            t->error = 1;
+            return;
+        }
+        silc_hmac_make(hmac, data, len, mac, &mac_len);
+        t->done++;
+        t->bytes += len;
+    }
+}
+
+static void _pysilc_bench_payload(PySilcBench_Thread *t, SilcCipher send_key,
+                                  SilcCipher receive_key, SilcHmac hmac,
+                                  SilcRng rng, unsigned char *data)
+{
+    SilcMessagePayload payload;
+    SilcBuffer buffer;
+    SilcUInt32 i;
+
+    for (i = 0; i < t->iterations; i++) {
+        // what silc_client_send_channel_message does for a channel key
+        buffer = silc_message_payload_encode(SILC_MESSAGE_FLAG_UTF8, data,
+                                             t->size, TRUE, FALSE, send_key,
+                                             hmac, rng, NULL, NULL, NULL,
+                                             NULL, NULL, NULL);
+        if (!buffer) {
+            t->error = 1;
+            return;
+        }
+
+        // and what the client library does before channel_message
+        payload = silc_message_payload_parse(silc_buffer_data(buffer),
+                                             silc_buffer_len(buffer), FALSE,
+                                             FALSE, receive_key, hmac, NULL,
+                                             0, NULL, 0, NULL, FALSE, NULL);
+        silc_buffer_free(buffer);
+        if (!payload) {
+            t->error = 1;
+            return;
+        }
+        silc_message_payload_free(payload);
+        t->done++;
+        t->bytes += t->size;
+    }
+}
+
+static void *_pysilc_bench_run(void *context)
+{
+    PySilcBench_Thread *t = (PySilcBench_Thread *)context;
+    SilcCipher send_key = NULL, receive_key = NULL;
+    SilcHmac hmac = NULL;
+    unsigned char key[64], *data = NULL;
+    SilcUInt32 len;
+    SilcRng rng;
+
+    t->error = 1;
+    if (!(rng = silc_rng_alloc()))
+        return NULL;
+    silc_rng_init(rng);
+    silc_rng_get_rn_data(rng, sizeof(key), key, sizeof(key));
+
+    if (_pysilc_bench_cipher(t->cipher_name, key, TRUE, &send_key) < 0)
+        goto out;
+    if (_pysilc_bench_cipher(t->cipher_name, key, FALSE, &receive_key) < 0)
+        goto out;
+    if (!silc_hmac_alloc(t->hmac_name, NULL, &hmac))
+        goto out;
+    silc_hmac_set_key(hmac, key, 32);
+
+    // raw cipher input must be a multiple of the block size
+    len = t->size + silc_cipher_get_block_len(send_key) - 1;
+    len -= len % silc_cipher_get_block_len(send_key);
+    if (!(data = malloc(len)))
+        goto out;
+    silc_rng_get_rn_data(rng, len, data, len);
+
+    t->error = 0;
+    if (t->mode == PYSILC_BENCH_RAW)
+        _pysilc_bench_raw(t, send_key, hmac, data, len);
+    else
+        _pysilc_bench_payload(t, send_key, receive_key, hmac, rng, data);
+
+out:
+    free(data);
+    if (hmac)
+        silc_hmac_free(hmac);
+    if (receive_key)
+        silc_cipher_free(receive_key);
+    if (send_key)
+        silc_cipher_free(send_key);
+    silc_rng_free(rng);
+    return NULL;
+}
+
+static PyObject *pysilc_benchmark(PyObject *mod, PyObject *args, PyObject *kwds)
+{
+    char *cipher_name = "aes-256-cbc", *hmac_name = "hmac-sha1-96";
+    char *mode_name = "payload";
+    unsigned int size = 256, iterations = 10000, threads = 1, i;
+    unsigned long long done = 0, bytes = 0;
+    PySilcBench_Thread *t;
+    double start, elapsed;
+    int mode, error = 0, started = 0;
+
+    static char *kwlist[] = {"cipher", "hmac", "size", "iterations", "threads", "mode", NULL};
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "|ssIIIs", kwlist,
+            &cipher_name, &hmac_name, &size, &iterations, &threads,
+            &mode_name))
+        return NULL;
+
+    if (!strcmp(mode_name, "raw"))
+        mode = PYSILC_BENCH_RAW;
+    else if (!strcmp(mode_name, "payload"))
+        mode = PYSILC_BENCH_PAYLOAD;
+    else {
+        PyErr_SetString(PyExc_ValueError, "mode should be 'raw' or 'payload'");
+        return NULL;
+    }
+    if (!size || !threads || threads > 1024) {
+        PyErr_SetString(PyExc_ValueError, "size and threads should be positive");
+        return NULL;
+    }
+
+    if (!(t = calloc(threads, sizeof(PySilcBench_Thread))))
+        return PyErr_NoMemory();
+
+    Py_BEGIN_ALLOW_THREADS
+    start = _pysilc_bench_now();
+    for (i = 0; i < threads; i++) {
+        t[i].cipher_name = cipher_name;
+        t[i].hmac_name = hmac_name;
+        t[i].mode = mode;
+        t[i].size = size;
+        t[i].iterations = iterations;
+        if (pthread_create(&t[i].thread, NULL, _pysilc_bench_run, &t[i]))
+            break;
+        started++;
+    }
+    for (i = 0; i < started; i++) {
+        pthread_join(t[i].thread, NULL);
+        error |= t[i].error;
+        done += t[i].done;
+        bytes += t[i].bytes;
+    }
+    elapsed = _pysilc_bench_now() - start;
+    Py_END_ALLOW_THREADS
+
+    free(t);
+    if (started != threads) {
+        PyErr_SetString(PyExc_RuntimeError, "Unable to start benchmark threads.");
+        return NULL;
+    }
+    if (error) {
+        PyErr_Format(PyExc_RuntimeError, "Benchmark of %s/%s failed",
+                     cipher_name, hmac_name);
+        return NULL;
+    }
+
+    return Py_BuildValue("{s:s,s:s,s:s,s:I,s:I,s:K,s:d,s:d,s:d}",
+                         "cipher", cipher_name,
+                         "hmac", hmac_name,
+                         "mode", mode_name,
+                         "size", size,
+                         "threads", threads,
+                         "messages", done,
+                         "seconds", elapsed,
+                         "messages_per_sec", elapsed > 0 ? done / elapsed : 0.0,
+                         "bytes_per_sec", elapsed > 0 ? bytes / elapsed : 0.0);
+}
+
+static PyObject *_pysilc_split_supported(char *list)
+{
+    PyObject *names, *name;
+    char *tok, *save = NULL;
+
+    if (!(names = PyList_New(0)))
+        goto out;
+    for (tok = list ? strtok_r(list, ",", &save) : NULL; tok;
+         tok = strtok_r(NULL, ",", &save)) {
+        if (!(name = PyString_FromString(tok)) || PyList_Append(names, name) < 0) {
+            Py_XDECREF(name);
+            Py_CLEAR(names);
+            goto out;
+        }
+        Py_DECREF(name);
+    }
+
+out:
+    silc_free(list);
+    return names;
+}
+
+static PyObject *pysilc_supported_ciphers(PyObject *mod)
+{
+    return _pysilc_split_supported(silc_cipher_get_supported());
+}
+
+static PyObject *pysilc_supported_hmacs(PyObject *mod)
+{
+    return _pysilc_split_supported(silc_hmac_get_supported());
+}
@@ -17,17 +17,9 @@
 #define PYSILC_GET_CLIENT_OR_DIE(source, destination)\
    PySilcClient *destination = (PySilcClient *)source->application;\
     if (!destination)\
-        return;
-
-#define PYSILC_NEW_USER_OR_DIE(source, destination)\
-    PySilcUser *destination = (PySilcUser *)PySilcUser_New(source);\
-    if (!destination)\
-        return;
-
-#define PYSILC_NEW_CHANNEL_OR_DIE(source, destination)\
-    PySilcChannel *destination = (PySilcChannel *)PySilcChannel_New(source);\
-    if (!destination)\
-        return;
+        return;\
+    _pysilc_stats_enter(destination);\
+    _pysilc_keepalive_active(destination);
 
 #define PYSILC_NEW_USER_OR_BREAK(source, destination)\
     destination = PySilcUser_New(source);\
@@ -47,6 +39,19 @@
 #define PYSILC_SILCBUFFER_TO_PYLIST(source, destination, Type) \
     do { } while (0);
 
+// pysilc_record.c, which replays through the callbacks below
+static void _pysilc_record_message(PySilcClient *pyclient,
+                                   SilcClientEntry sender,
+                                   SilcChannelEntry channel,
+                                   SilcMessageFlags flags,
+                                   const unsigned char *message,
+                                   SilcUInt32 message_len);
+static void _pysilc_record_notify(PySilcClient *pyclient, SilcNotifyType type,
+                                  va_list va);
+static void _pysilc_record_reply(PySilcClient *pyclient, SilcCommand command,
+                                 SilcStatus status, SilcStatus error,
+                                 va_list va);
+
 static void _pysilc_client_running(SilcClient client,
                                    void *context)
 {
@@ -56,7 +61,8 @@ static void _pysilc_client_running(SilcClient client,
     callback = PyObject_GetAttrString((PyObject *)pyclient, "running");
     if (!PyCallable_Check(callback))
         goto cleanup;
-    if ((result = PyObject_CallObject(callback, NULL)) == 0)
+    if ((result = _pysilc_stats_call(pyclient, PYSILC_STAT_RUNNING,
+                                     callback, NULL)) == 0)
         PyErr_Print();
 
 cleanup:
@@ -74,7 +80,15 @@ static void _pysilc_client_connect_callback(SilcClient client,
     PYSILC_GET_CLIENT_OR_DIE(client, pyclient);
     PyObject *args = NULL, *callback = NULL, *result = NULL;
 
+    // the detach data is not needed once the connection has an outcome;
+    // later connects start new sessions unless given data again
+    free(pyclient->resume_data);
+    pyclient->resume_data = NULL;
+    pyclient->params.detach_data = NULL;
+    pyclient->params.detach_data_len = 0;
+
     if ((status == SILC_CLIENT_CONN_SUCCESS) || (status == SILC_CLIENT_CONN_SUCCESS_RESUME)) {
+        pyclient->resumed = status == SILC_CLIENT_CONN_SUCCESS_RESUME;
         if (error != SILC_STATUS_OK) {
             // TODO: raise an exception and abort
             // call silc_client_close_connection(client, conn);
@@ -83,11 +97,14 @@ static void _pysilc_client_connect_callback(SilcClient client,
         }
 
         pyclient->silcconn = conn;
+        _pysilc_reconnect_connected(pyclient, conn, pyclient->resumed);
+        _pysilc_keepalive_start(pyclient);
 
         callback = PyObject_GetAttrString((PyObject *)pyclient, "connected");
         if (!PyCallable_Check(callback))
             goto cleanup;
-        if ((result = PyObject_CallObject(callback, NULL)) == 0)
+        if ((result = _pysilc_stats_call(pyclient, PYSILC_STAT_CONNECTED,
+                                         callback, NULL)) == 0)
             PyErr_Print();
     }
     else if (status == SILC_CLIENT_CONN_DISCONNECTED) {
@@ -96,23 +113,35 @@ static void _pysilc_client_connect_callback(SilcClient client,
             // call silc_client_close_connection(client, conn);
         }
 
+        // the batches go out while their entries are still valid
+        _pysilc_coalesce_flush(pyclient);
+        _pysilc_queue_drain(pyclient, 0);
+
+        // the toolkit frees the channels and their private keys
+        _pysilc_channel_keys_clear(pyclient->channel_keys);
+
         // TODO: we're not letting the user know about ClientConnection atm.
         pyclient->silcconn = NULL;
+        _pysilc_keepalive_stop(pyclient);
+        _pysilc_reconnect_lost(pyclient);
         callback = PyObject_GetAttrString((PyObject *)pyclient, "disconnected");
         if (!PyCallable_Check(callback))
             goto cleanup;
 
         if (!(args = Py_BuildValue("(s)", message)))
             goto cleanup;
-        if ((result = PyObject_CallObject(callback, args)) == 0)
+        if ((result = _pysilc_stats_call(pyclient, PYSILC_STAT_DISCONNECTED,
+                                         callback, args)) == 0)
             PyErr_Print();
     }
     else {
+        _pysilc_reconnect_lost(pyclient);
         callback = PyObject_GetAttrString((PyObject *)pyclient, "failure");
         if (!PyCallable_Check(callback))
             goto cleanup;
         // TODO: pass on protocol, failure parameters
-        if ((result = PyObject_CallObject(callback, NULL)) == 0)
+        if ((result = _pysilc_stats_call(pyclient, PYSILC_STAT_FAILURE,
+                                         callback, NULL)) == 0)
             PyErr_Print();
     }
 
@@ -137,7 +166,8 @@ static void _pysilc_client_callback_say(SilcClient client,
     if (!(args = Py_BuildValue("(s)", msg)))
         goto cleanup;
 
-    if ((result = PyObject_CallObject(callback, args)) == 0)
+    if ((result = _pysilc_stats_call(pyclient, PYSILC_STAT_SAY,
+                                     callback, args)) == 0)
         PyErr_Print();
 
 cleanup:
@@ -165,7 +195,8 @@ static void _pysilc_client_callback_command(SilcClient client,
                                silc_get_command_name(command),
                                silc_get_status_message(status))))
         goto cleanup;
-    if ((result = PyObject_CallObject(callback, args)) == 0)
+    if ((result = _pysilc_stats_call(pyclient, PYSILC_STAT_COMMAND,
+                                     callback, args)) == 0)
         PyErr_Print();
 cleanup:
     Py_XDECREF(callback);
@@ -185,21 +216,60 @@ static void _pysilc_client_callback_channel_message(SilcClient client,
                                                     SilcUInt32 message_len) {
 
     PYSILC_GET_CLIENT_OR_DIE(client, pyclient);
-    PYSILC_NEW_USER_OR_DIE(sender, pysender);
-    PYSILC_NEW_CHANNEL_OR_DIE(channel, pychannel);
+    PySilcUser *pysender = NULL;
+    PySilcChannel *pychannel = NULL;
     PyObject *result = NULL, *args = NULL, *callback = NULL;
+    PySilcFilterRule *rule = NULL;
+    PyObject *tag = NULL;
+    SilcUInt32 pyflags;
+
+    if (pyclient->record)
+        _pysilc_record_message(pyclient, sender, channel, flags, message,
+                               message_len);
+
+    // dropped messages cost no Python objects at all
+    rule = _pysilc_filter_match(pyclient, sender, channel, flags, message,
+                                message_len);
+    if (_pysilc_filter_drops(pyclient, rule))
+        return;
 
-    callback = PyObject_GetAttrString((PyObject *)pyclient, "channel_message");
+    // held, the rule may be removed while Python code runs
+    if (rule && rule->target) {
+        callback = rule->target;
+        Py_INCREF(callback);
+    }
+    else if ((callback = _pysilc_route_channel(pyclient, channel)) != NULL)
+        Py_INCREF(callback);
+    else
+        callback = PyObject_GetAttrString((PyObject *)pyclient, "channel_message");
+    if (rule && (tag = rule->tag))
+        Py_INCREF(tag);
     if (!PyCallable_Check(callback))
         goto cleanup;
+    if (!(pysender = (PySilcUser *)PySilcUser_New(sender)))
+        goto cleanup;
+    if (!(pychannel = (PySilcChannel *)PySilcChannel_New(channel)))
+        goto cleanup;
 
-    if (!(args = Py_BuildValue("(OOis#)", pysender, pychannel, flags, message, message_len)))
+    pyflags = flags | _pysilc_signed_verify(pyclient, sender, payload, flags);
+    if (key)
+        pychannel->private_key = PySilcChannelPrivateKey_New(channel, key);
+    if (tag)
+        args = Py_BuildValue("(OOis#O)", pysender, pychannel, pyflags,
+                             message, message_len, tag);
+    else
+        args = Py_BuildValue("(OOis#)", pysender, pychannel, pyflags, message, message_len);
+    if (!args)
         goto cleanup;
-    if ((result = PyObject_CallObject(callback, args)) == 0)
+    if ((result = _pysilc_queue_call(pyclient, conn, PYSILC_STAT_CHANNEL_MESSAGE,
+                                     callback, args)) == 0)
         PyErr_Print();
 
 cleanup:
+    Py_XDECREF(pysender);
+    Py_XDECREF(pychannel);
     Py_XDECREF(callback);
+    Py_XDECREF(tag);
     Py_XDECREF(args);
     Py_XDECREF(result);
 }
@@ -214,20 +284,53 @@ static void _pysilc_client_callback_private_message(SilcClient client,
                                                     SilcUInt32 message_len) {
 
     PYSILC_GET_CLIENT_OR_DIE(client, pyclient);
-    PYSILC_NEW_USER_OR_DIE(sender, pysender);
+    PySilcUser *pysender = NULL;
     PyObject *result = NULL, *args = NULL, *callback = NULL;
+    PySilcFilterRule *rule = NULL;
+    PyObject *tag = NULL;
+    SilcUInt32 pyflags;
+
+    if (pyclient->record)
+        _pysilc_record_message(pyclient, sender, NULL, flags, message,
+                               message_len);
+
+    rule = _pysilc_filter_match(pyclient, sender, NULL, flags, message,
+                                message_len);
+    if (_pysilc_filter_drops(pyclient, rule))
+        return;
 
-    callback = PyObject_GetAttrString((PyObject *)pyclient, "private_message");
+    // held, the rule may be removed while Python code runs
+    if (rule && rule->target) {
+        callback = rule->target;
+        Py_INCREF(callback);
+    }
+    else if ((callback = _pysilc_route_user(pyclient, sender)) != NULL)
+        Py_INCREF(callback);
+    else
+        callback = PyObject_GetAttrString((PyObject *)pyclient, "private_message");
+    if (rule && (tag = rule->tag))
+        Py_INCREF(tag);
     if (!PyCallable_Check(callback))
         goto cleanup;
+    if (!(pysender = (PySilcUser *)PySilcUser_New(sender)))
+        goto cleanup;
 
-    if (!(args = Py_BuildValue("(Ois#)", pysender, flags, message, message_len)))
+    pyflags = flags | _pysilc_signed_verify(pyclient, sender, payload, flags);
+    if (tag)
+        args = Py_BuildValue("(Ois#O)", pysender, pyflags, message,
+                             message_len, tag);
+    else
+        args = Py_BuildValue("(Ois#)", pysender, pyflags, message, message_len);
+    if (!args)
         goto cleanup;
-    if ((result = PyObject_CallObject(callback, args)) == 0)
+    if ((result = _pysilc_queue_call(pyclient, conn, PYSILC_STAT_PRIVATE_MESSAGE,
+                                     callback, args)) == 0)
         PyErr_Print();
 
 cleanup:
+    Py_XDECREF(pysender);
     Py_XDECREF(callback);
+    Py_XDECREF(tag);
     Py_XDECREF(args);
     Py_XDECREF(result);
 }
@@ -303,7 +406,8 @@ static void _pysilc_client_callback_command_reply_join_finished(SilcClient clien
                                          0, 0, users)))
         goto cleanup;
 
-    if ((result = PyObject_CallObject(callback, args)) == 0)
+    if ((result = _pysilc_queue_call(pyclient, conn, PYSILC_STAT_COMMAND_REPLY_JOIN,
+                                     callback, args)) == 0)
         PyErr_Print();
 
     cleanup:
@@ -337,12 +441,20 @@ static void _pysilc_client_callback_notify(SilcClient client,
     va_list va;
     va_start(va, type);
 
+    if (pyclient->record)
+        _pysilc_record_notify(pyclient, type, va);
+    if (pyclient->coalesce && _pysilc_coalesce_notify(pyclient, conn, type, va)) {
+        va_end(va);
+        return;
+    }
+
     switch(type) {
     case SILC_NOTIFY_TYPE_NONE:
         PYSILC_GET_CALLBACK_OR_BREAK("notify_none");
         if (!(args = Py_BuildValue("(s)", (char *)va_arg(va, char*))))
             break;
-        if ((result = PyObject_CallObject(callback, args)) == 0)
+        if ((result = _pysilc_queue_call(pyclient, conn, PYSILC_STAT_NOTIFY_NONE,
+                                         callback, args)) == 0)
             PyErr_Print();
         break;
 
@@ -353,7 +465,8 @@ static void _pysilc_client_callback_notify(SilcClient client,
         PYSILC_NEW_USER_OR_BREAK(va_arg(va, SilcClientEntry), pyuser);
         if ((args = Py_BuildValue("(OsO)", pychannel, channel_name, pyuser)) == NULL)
             break;
-        if ((result = PyObject_CallObject(callback, args)) == 0)
+        if ((result = _pysilc_queue_call(pyclient, conn, PYSILC_STAT_NOTIFY_INVITE,
+                                         callback, args)) == 0)
             PyErr_Print();
         break;
 
@@ -363,7 +476,8 @@ static void _pysilc_client_callback_notify(SilcClient client,
         PYSILC_NEW_CHANNEL_OR_BREAK(va_arg(va, SilcChannelEntry), pychannel);
         if ((args = Py_BuildValue("(OO)", pyuser, pychannel)) == NULL)
             break;
-        if ((result = PyObject_CallObject(callback, args)) == 0)
+        if ((result = _pysilc_queue_call(pyclient, conn, PYSILC_STAT_NOTIFY_JOIN,
+                                         callback, args)) == 0)
             PyErr_Print();
         break;
 
@@ -373,19 +487,29 @@ static void _pysilc_client_callback_notify(SilcClient client,
         PYSILC_NEW_CHANNEL_OR_BREAK(va_arg(va, SilcChannelEntry), pychannel);
         if ((args = Py_BuildValue("(OO)", pyuser, pychannel)) == NULL)
             break;
-        if ((result = PyObject_CallObject(callback, args)) == 0)
+        if ((result = _pysilc_queue_call(pyclient, conn, PYSILC_STAT_NOTIFY_LEAVE,
+                                         callback, args)) == 0)
             PyErr_Print();
         break;
     case SILC_NOTIFY_TYPE_SIGNOFF:
         PYSILC_GET_CALLBACK_OR_BREAK("notify_signoff");
         PYSILC_NEW_USER_OR_BREAK(va_arg(va, SilcClientEntry), pyuser);
-        PYSILC_NEW_CHANNEL_OR_BREAK(va_arg(va, SilcChannelEntry), pychannel);
         char *msg = va_arg(va, char *);
         if (!msg)
             msg = "";
+        // NULL when the client was on no channel with us
+        SilcChannelEntry signoff_channel = va_arg(va, SilcChannelEntry);
+        if (signoff_channel) {
+            PYSILC_NEW_CHANNEL_OR_BREAK(signoff_channel, pychannel);
+        }
+        else {
+            pychannel = Py_None;
+            Py_INCREF(Py_None);
+        }
         if ((args = Py_BuildValue("(OsO)", pyuser, msg, pychannel)) == NULL)
             break;
-        if ((result = PyObject_CallObject(callback, args)) == 0)
+        if ((result = _pysilc_queue_call(pyclient, conn, PYSILC_STAT_NOTIFY_SIGNOFF,
+                                         callback, args)) == 0)
             PyErr_Print();
         break;
     case SILC_NOTIFY_TYPE_TOPIC_SET:
@@ -416,7 +540,8 @@ static void _pysilc_client_callback_notify(SilcClient client,
 
         if (args == NULL)
             break;
-        if ((result = PyObject_CallObject(callback, args)) == 0)
+        if ((result = _pysilc_queue_call(pyclient, conn, PYSILC_STAT_NOTIFY_TOPIC_SET,
+                                         callback, args)) == 0)
             PyErr_Print();
         break;
 
@@ -428,7 +553,8 @@ static void _pysilc_client_callback_notify(SilcClient client,
         if ((args = Py_BuildValue("(Oss)", pyuser, old_nickname,
             new_nickname)) == NULL)
             break;
-        if ((result = PyObject_CallObject(callback, args)) == 0)
+        if ((result = _pysilc_queue_call(pyclient, conn, PYSILC_STAT_NOTIFY_NICK_CHANGE,
+                                         callback, args)) == 0)
             PyErr_Print();
         break;
 
@@ -471,7 +597,8 @@ static void _pysilc_client_callback_notify(SilcClient client,
         if (args == NULL)
             break;
 
-        if ((result = PyObject_CallObject(callback, args)) == 0)
+        if ((result = _pysilc_queue_call(pyclient, conn, PYSILC_STAT_NOTIFY_CMODE_CHANGE,
+                                         callback, args)) == 0)
             PyErr_Print();
         break;
 
@@ -505,7 +632,8 @@ static void _pysilc_client_callback_notify(SilcClient client,
         if (args == NULL)
             break;
 
-        if ((result = PyObject_CallObject(callback, args)) == 0)
+        if ((result = _pysilc_queue_call(pyclient, conn, PYSILC_STAT_NOTIFY_CUMODE_CHANGE,
+                                         callback, args)) == 0)
             PyErr_Print();
         break;
 
@@ -513,7 +641,8 @@ static void _pysilc_client_callback_notify(SilcClient client,
         PYSILC_GET_CALLBACK_OR_BREAK("notify_motd");
         if ((args = Py_BuildValue("(s)", va_arg(va, char *))) == NULL)
             break;
-        if ((result = PyObject_CallObject(callback, args)) == 0)
+        if ((result = _pysilc_queue_call(pyclient, conn, PYSILC_STAT_NOTIFY_MOTD,
+                                         callback, args)) == 0)
             PyErr_Print();
         break;
     case SILC_NOTIFY_TYPE_CHANNEL_CHANGE:
@@ -521,28 +650,43 @@ static void _pysilc_client_callback_notify(SilcClient client,
         PYSILC_NEW_CHANNEL_OR_BREAK(va_arg(va, SilcChannelEntry), pychannel);
         if ((args = Py_BuildValue("(O)", pychannel)) == NULL)
             break;
-        if ((result = PyObject_CallObject(callback, args)) == 0)
+        if ((result = _pysilc_queue_call(pyclient, conn, PYSILC_STAT_NOTIFY_CHANNEL_CHANGE,
+                                         callback, args)) == 0)
             PyErr_Print();
         break;
 
     case SILC_NOTIFY_TYPE_SERVER_SIGNOFF:
         PYSILC_GET_CALLBACK_OR_BREAK("notify_server_signoff");
-        if ((result = PyObject_CallObject(callback, args)) == 0)
+        if ((result = _pysilc_queue_call(pyclient, conn, PYSILC_STAT_NOTIFY_SERVER_SIGNOFF,
+                                         callback, args)) == 0)
             PyErr_Print();
         break;
 
     case SILC_NOTIFY_TYPE_KICKED:
-        PYSILC_GET_CALLBACK_OR_BREAK("notify_kicked");
-        PYSILC_NEW_USER_OR_BREAK(va_arg(va, SilcClientEntry), pyarg);
+    {
+        SilcClientEntry kicked = va_arg(va, SilcClientEntry);
         char *message = va_arg(va, char *);
-        PYSILC_NEW_USER_OR_BREAK(va_arg(va, SilcClientEntry), pyuser);
-        PYSILC_NEW_CHANNEL_OR_BREAK(va_arg(va, SilcChannelEntry), pychannel);
+        SilcClientEntry kicker = va_arg(va, SilcClientEntry);
+        SilcChannelEntry channel = va_arg(va, SilcChannelEntry);
+
+        // not rejoined after a reconnect, and its keys go with it
+        if (conn && kicked == conn->local_entry && channel) {
+            _pysilc_channel_keys_forget(pyclient->channel_keys, channel);
+            _pysilc_reconnect_left(pyclient, channel->channel_name);
+        }
+
+        PYSILC_GET_CALLBACK_OR_BREAK("notify_kicked");
+        PYSILC_NEW_USER_OR_BREAK(kicked, pyarg);
+        PYSILC_NEW_USER_OR_BREAK(kicker, pyuser);
+        PYSILC_NEW_CHANNEL_OR_BREAK(channel, pychannel);
 
         if ((args = Py_BuildValue("(OsOO)", pyarg, message, pyuser, pychannel)) == NULL)
             break;
-        if ((result = PyObject_CallObject(callback, args)) == 0)
+        if ((result = _pysilc_queue_call(pyclient, conn, PYSILC_STAT_NOTIFY_KICKED,
+                                         callback, args)) == 0)
             PyErr_Print();
         break;
+    }
 
     case SILC_NOTIFY_TYPE_KILLED:
         PYSILC_GET_CALLBACK_OR_BREAK("notify_killed");
@@ -573,7 +717,8 @@ static void _pysilc_client_callback_notify(SilcClient client,
         if (args == NULL)
             break;
 
-        if ((result = PyObject_CallObject(callback, args)) == 0)
+        if ((result = _pysilc_queue_call(pyclient, conn, PYSILC_STAT_NOTIFY_KILLED,
+                                         callback, args)) == 0)
             PyErr_Print();
         break;
 
@@ -582,7 +727,8 @@ static void _pysilc_client_callback_notify(SilcClient client,
         int error = va_arg(va, int);
         if ((args = Py_BuildValue("(is)", error, silc_get_status_message(error))) == NULL)
             break;
-        if ((result = PyObject_CallObject(callback, args)) == 0)
+        if ((result = _pysilc_queue_call(pyclient, conn, PYSILC_STAT_NOTIFY_ERROR,
+                                         callback, args)) == 0)
             PyErr_Print();
         break;
     case SILC_NOTIFY_TYPE_WATCH:
@@ -594,13 +740,16 @@ static void _pysilc_client_callback_notify(SilcClient client,
         va_arg(va, void *); // TODO: founder_key
         if ((args = Py_BuildValue("(OsiiO)", pyuser, new_nick, user_mode, notification, Py_None)) == NULL)
             break;
-        if ((result = PyObject_CallObject(callback, args)) == 0)
+        if ((result = _pysilc_queue_call(pyclient, conn, PYSILC_STAT_NOTIFY_WATCH,
+                                         callback, args)) == 0)
             PyErr_Print();
         break;
     }
 
-    // TODO: don't leak if not reached...
+    // every case breaks out to here, so nothing is skipped
     va_end(va);
+    if (PyErr_Occurred())
+        PyErr_Print();
     Py_XDECREF(callback);
     Py_XDECREF(pyuser);
     Py_XDECREF(pychannel);
@@ -623,6 +772,11 @@ static void _pysilc_client_callback_command_reply(SilcClient client,
 
     PYSILC_GET_CLIENT_OR_DIE(client, pyclient);
 
+    if (pyclient->record)
+        _pysilc_record_reply(pyclient, command, status, error, va);
+    if (command == SILC_COMMAND_PING)
+        _pysilc_keepalive_pong(pyclient);
+
     if (status != SILC_STATUS_OK) {
         // we encounter an error, return the command and error
         callback = PyObject_GetAttrString((PyObject *)pyclient,
@@ -636,11 +790,13 @@ static void _pysilc_client_callback_command_reply(SilcClient client,
             Py_DECREF(callback);
             return;
         }
-        if ((result = PyObject_CallObject(callback, args)) == 0)
+        if ((result = _pysilc_queue_call(pyclient, conn, PYSILC_STAT_COMMAND_REPLY_FAILED,
+                                         callback, args)) == 0)
             PyErr_Print();
 
         Py_DECREF(callback);
         Py_DECREF(args);
+        Py_XDECREF(result);
         return;
     }
 
@@ -663,7 +819,8 @@ static void _pysilc_client_callback_command_reply(SilcClient client,
         // TODO: fill in fingerprint, channels, channel_usermodes, attrs
         if ((args = Py_BuildValue("(Osssii)", pyuser, nickname, username, realname, usermode, idletime)) == NULL)
             break;
-        if ((result = PyObject_CallObject(callback, args)) == 0)
+        if ((result = _pysilc_queue_call(pyclient, conn, PYSILC_STAT_COMMAND_REPLY_WHOIS,
+                                         callback, args)) == 0)
             PyErr_Print();
         break;
      }
@@ -677,7 +834,8 @@ static void _pysilc_client_callback_command_reply(SilcClient client,
         realname = va_arg(va, char *);
         if ((args = Py_BuildValue("(Osss)", pyuser, nickname, username, realname)) == NULL)
              break;
-        if ((result = PyObject_CallObject(callback, args)) == 0)
+        if ((result = _pysilc_queue_call(pyclient, conn, PYSILC_STAT_COMMAND_REPLY_WHOWAS,
+                                         callback, args)) == 0)
             PyErr_Print();
         break;
     }
@@ -689,7 +847,8 @@ static void _pysilc_client_callback_command_reply(SilcClient client,
         char *info = va_arg(va, char *);
         if ((args = Py_BuildValue("(ss)", name, info)) == NULL)
             break;
-        if ((result = PyObject_CallObject(callback, args)) == 0)
+        if ((result = _pysilc_queue_call(pyclient, conn, PYSILC_STAT_COMMAND_REPLY_IDENTIFY,
+                                         callback, args)) == 0)
             PyErr_Print();
         break;
     }
@@ -701,7 +860,8 @@ static void _pysilc_client_callback_command_reply(SilcClient client,
         va_arg(va, void *); // TODO: info
         if ((args = Py_BuildValue("(Oss)", pyuser, nickname, "")) == NULL)
             break;
-        if ((result = PyObject_CallObject(callback, args)) == 0)
+        if ((result = _pysilc_queue_call(pyclient, conn, PYSILC_STAT_COMMAND_REPLY_NICK,
+                                         callback, args)) == 0)
             PyErr_Print();
         break;
     }
@@ -721,7 +881,8 @@ static void _pysilc_client_callback_command_reply(SilcClient client,
             if ((args = Py_BuildValue("(Ossi)", pychannel, channel_name, channel_topic, user_count)) == NULL)
                 break;
         }
-        if ((result = PyObject_CallObject(callback, args)) == 0)
+        if ((result = _pysilc_queue_call(pyclient, conn, PYSILC_STAT_COMMAND_REPLY_LIST,
+                                         callback, args)) == 0)
             PyErr_Print();
         break;
     }
@@ -732,7 +893,8 @@ static void _pysilc_client_callback_command_reply(SilcClient client,
         char *channel_topic = va_arg(va, char *);
         if ((args = Py_BuildValue("(Os)", pychannel, channel_topic)) == NULL)
             break;
-        if ((result = PyObject_CallObject(callback, args)) == 0)
+        if ((result = _pysilc_queue_call(pyclient, conn, PYSILC_STAT_COMMAND_REPLY_TOPIC,
+                                         callback, args)) == 0)
             PyErr_Print();
         break;
     }
@@ -761,7 +923,8 @@ static void _pysilc_client_callback_command_reply(SilcClient client,
         if ((args = Py_BuildValue("(OO)", pychannel, pyargs)) == NULL)
 
             break;
-        if ((result = PyObject_CallObject(callback, args)) == 0)
+        if ((result = _pysilc_queue_call(pyclient, conn, PYSILC_STAT_COMMAND_REPLY_INVITE,
+                                         callback, args)) == 0)
             PyErr_Print();
         */
         break;
@@ -777,7 +940,8 @@ static void _pysilc_client_callback_command_reply(SilcClient client,
         }
         if ((args = Py_BuildValue("(O)", pyuser)) == NULL)
              break;
-         if ((result = PyObject_CallObject(callback, args)) == 0)
+         if ((result = _pysilc_queue_call(pyclient, conn, PYSILC_STAT_COMMAND_REPLY_KILL,
+                                          callback, args)) == 0)
              PyErr_Print();
         break;
     }
@@ -792,31 +956,37 @@ static void _pysilc_client_callback_command_reply(SilcClient client,
     case SILC_COMMAND_PING:
     {
         PYSILC_GET_CALLBACK_OR_BREAK("command_reply_ping");
-        if ((result = PyObject_CallObject(callback, args)) == 0)
+        if ((result = _pysilc_queue_call(pyclient, conn, PYSILC_STAT_COMMAND_REPLY_PING,
+                                         callback, args)) == 0)
             PyErr_Print();
         break;
     }
     case SILC_COMMAND_OPER:
     {
         PYSILC_GET_CALLBACK_OR_BREAK("command_reply_oper");
-        if ((result = PyObject_CallObject(callback, args)) == 0)
+        if ((result = _pysilc_queue_call(pyclient, conn, PYSILC_STAT_COMMAND_REPLY_OPER,
+                                         callback, args)) == 0)
             PyErr_Print();
         break;
     }
     case SILC_COMMAND_JOIN:
     {
+        char *tmpstr = va_arg(va, char *);
+        _pysilc_reconnect_joined(pyclient, tmpstr);
+
         PYSILC_GET_CALLBACK_OR_BREAK("command_reply_join");
         PySilcClient_Callback_Join_Context *context = malloc(sizeof(PySilcClient_Callback_Join_Context));
-        memset(context, 0, sizeof(PySilcClient_Callback_Join_Context));
         if (!context)
             break;
+        memset(context, 0, sizeof(PySilcClient_Callback_Join_Context));
 
-        char *tmpstr = NULL;
-
-        tmpstr = va_arg(va, char *);
         if (tmpstr)
             context->channel_name = strdup(tmpstr);
-        PYSILC_NEW_CHANNEL_OR_BREAK(va_arg(va, SilcChannelEntry), pychannel);
+        if (!(pychannel = PySilcChannel_New(va_arg(va, SilcChannelEntry)))) {
+            free(context->channel_name);
+            free(context);
+            break;
+        }
         context->pychannel = pychannel;
         Py_INCREF(pychannel);
         context->channel_mode = va_arg(va, SilcUInt32);
@@ -838,11 +1008,12 @@ static void _pysilc_client_callback_command_reply(SilcClient client,
     }
     case SILC_COMMAND_MOTD:
     {
-        PYSILC_GET_CALLBACK_OR_BREAK("command_reply_join");
+        PYSILC_GET_CALLBACK_OR_BREAK("command_reply_motd");
         char *motd = va_arg(va, char *);
         if ((args = Py_BuildValue("(s)", motd)) == NULL)
             break;
-        if ((result = PyObject_CallObject(callback, args)) == 0)
+        if ((result = _pysilc_queue_call(pyclient, conn, PYSILC_STAT_COMMAND_REPLY_MOTD,
+                                         callback, args)) == 0)
             PyErr_Print();
         break;
     }
@@ -859,7 +1030,8 @@ static void _pysilc_client_callback_command_reply(SilcClient client,
 
         if ((args = Py_BuildValue("(OiiOO)", pychannel, mode, user_limit, Py_None, Py_None)) == NULL)
             break;
-        if ((result = PyObject_CallObject(callback, args)) == 0)
+        if ((result = _pysilc_queue_call(pyclient, conn, PYSILC_STAT_COMMAND_REPLY_CMODE,
+                                         callback, args)) == 0)
             PyErr_Print();
         break;
     }
@@ -871,7 +1043,8 @@ static void _pysilc_client_callback_command_reply(SilcClient client,
         PYSILC_NEW_USER_OR_BREAK(va_arg(va, SilcClientEntry), pyuser);
         if ((args = Py_BuildValue("(iOO)", mode, pychannel, pyuser)) == NULL)
             break;
-        if ((result = PyObject_CallObject(callback, args)) == 0)
+        if ((result = _pysilc_queue_call(pyclient, conn, PYSILC_STAT_COMMAND_REPLY_CUMODE,
+                                         callback, args)) == 0)
             PyErr_Print();
         break;
     }
@@ -882,7 +1055,8 @@ static void _pysilc_client_callback_command_reply(SilcClient client,
         PYSILC_NEW_USER_OR_BREAK(va_arg(va, SilcClientEntry), pyuser);
         if ((args = Py_BuildValue("(OO)", pychannel, pyuser)) == NULL)
             break;
-        if ((result = PyObject_CallObject(callback, args)) == 0)
+        if ((result = _pysilc_queue_call(pyclient, conn, PYSILC_STAT_COMMAND_REPLY_KICK,
+                                         callback, args)) == 0)
             PyErr_Print();
         break;
     }
@@ -893,38 +1067,54 @@ static void _pysilc_client_callback_command_reply(SilcClient client,
          va_arg(va, void *); // TODO: ban_list
          if ((args = Py_BuildValue("(OO)", pychannel, Py_None)) == NULL)
              break;
-         if ((result = PyObject_CallObject(callback, args)) == 0)
+         if ((result = _pysilc_queue_call(pyclient, conn, PYSILC_STAT_COMMAND_REPLY_BAN,
+                                          callback, args)) == 0)
              PyErr_Print();
          break;
     }
     case SILC_COMMAND_DETACH:
     {
+        // the data to resume with, the server closes the connection next
+        SilcBuffer detach = va_arg(va, SilcBuffer);
         PYSILC_GET_CALLBACK_OR_BREAK("command_reply_detach");
-        if ((result = PyObject_CallObject(callback, args)) == 0)
+        if (!detach)
+            break;
+        if ((args = Py_BuildValue("(s#)", silc_buffer_data(detach),
+                                  silc_buffer_len(detach))) == NULL)
+            break;
+        if ((result = _pysilc_queue_call(pyclient, conn, PYSILC_STAT_COMMAND_REPLY_DETACH,
+                                         callback, args)) == 0)
             PyErr_Print();
         break;
     }
     case SILC_COMMAND_WATCH:
     {
         PYSILC_GET_CALLBACK_OR_BREAK("command_reply_watch");
-        if ((result = PyObject_CallObject(callback, args)) == 0)
+        if ((result = _pysilc_queue_call(pyclient, conn, PYSILC_STAT_COMMAND_REPLY_WATCH,
+                                         callback, args)) == 0)
             PyErr_Print();
         break;
     }
     case SILC_COMMAND_SILCOPER:
     {
         PYSILC_GET_CALLBACK_OR_BREAK("command_reply_silcoper");
-        if ((result = PyObject_CallObject(callback, args)) == 0)
+        if ((result = _pysilc_queue_call(pyclient, conn, PYSILC_STAT_COMMAND_REPLY_SILCOPER,
+                                         callback, args)) == 0)
             PyErr_Print();
         break;
     }
     case SILC_COMMAND_LEAVE:
     {
+        SilcChannelEntry channel = va_arg(va, SilcChannelEntry);
+        _pysilc_channel_keys_forget(pyclient->channel_keys, channel);
+        if (channel)
+            _pysilc_reconnect_left(pyclient, channel->channel_name);
         PYSILC_GET_CALLBACK_OR_BREAK("command_reply_leave");
-        PYSILC_NEW_CHANNEL_OR_BREAK(va_arg(va, SilcChannelEntry), pychannel);
+        PYSILC_NEW_CHANNEL_OR_BREAK(channel, pychannel);
         if ((args = Py_BuildValue("(O)", pychannel)) == NULL)
             break;
-        if ((result = PyObject_CallObject(callback, args)) == 0)
+        if ((result = _pysilc_queue_call(pyclient, conn, PYSILC_STAT_COMMAND_REPLY_LEAVE,
+                                         callback, args)) == 0)
             PyErr_Print();
         break;
     }
@@ -942,21 +1132,32 @@ static void _pysilc_client_callback_command_reply(SilcClient client,
         SilcChannelEntry channel = ((PySilcChannel *)pychannel)->silcobj;
         SilcUInt32 user_count = silc_hash_table_count(channel->user_list);
         pyuser = PyTuple_New(user_count); // hijack pyuser so we get autocleanup
-
-        printf("user: %d\n", user_count);
+        if (!pyuser)
+            break;
 
         if (channel && channel->user_list) {
             silc_hash_table_list(channel->user_list, &hash_list);
-            while (silc_hash_table_get(&hash_list, (void *)&user, (void *)&user_channel)) {
-                cached = silc_client_get_client_by_id(client, conn, &(user->id));
-                if (cached) {
+            while (i < user_count &&
+                   silc_hash_table_get(&hash_list, (void *)&user, (void *)&user_channel)) {
+                // replayed entries are not in a client cache
+                if (!conn)
+                    u = PySilcUser_New(user);
+                // the lookup takes a reference that the wrapper does not keep
+                else if ((cached = silc_client_get_client_by_id(client, conn,
+                                                                &(user->id)))) {
+                    PYSILC_LIVE_INC(PYSILC_LIVE_CLIENT_ENTRY_REF);
                     u = PySilcUser_New(cached);
-                    PyTuple_SetItem(pyuser, i, u);
-                    // TODO: reference count is not incr, so we don't DECREF it. check.
+                    silc_client_unref_client(client, conn, cached);
+                    PYSILC_LIVE_DEC(PYSILC_LIVE_CLIENT_ENTRY_REF);
                 }
-                else {
-                    PyTuple_SetItem(pyuser, i, Py_None);
+                else
+                    u = NULL;
+                if (!u) {
+                    PyErr_Clear();
+                    u = Py_None;
+                    Py_INCREF(u);
                 }
+                PyTuple_SET_ITEM(pyuser, i, u); // steals the reference
                 i++;
             }
             silc_hash_table_list_reset(&hash_list);
@@ -966,7 +1167,8 @@ static void _pysilc_client_callback_command_reply(SilcClient client,
 
         if ((args = Py_BuildValue("(OO)", pychannel, pyuser/*list*/)) == NULL)
                break;
-        if ((result = PyObject_CallObject(callback, args)) == 0)
+        if ((result = _pysilc_queue_call(pyclient, conn, PYSILC_STAT_COMMAND_REPLY_USERS,
+                                         callback, args)) == 0)
             PyErr_Print();
         break;
     }
@@ -975,25 +1177,16 @@ static void _pysilc_client_callback_command_reply(SilcClient client,
         break;
     }
 
-    // TODO: don't leak if not reached...
-    va_end(va);
+    // the va_list belongs to the toolkit, which ends it
+    if (PyErr_Occurred())
+        PyErr_Print();
     Py_XDECREF(callback);
+    Py_XDECREF(args);
     Py_XDECREF(result);
     Py_XDECREF(pychannel);
     Py_XDECREF(pyuser);
 }
 
-static void _pysilc_client_callback_verify_key(SilcClient client,
-                                               SilcClientConnection conn,
-                                               SilcConnectionType conn_type,
-                                               SilcPublicKey public_key,
-                                               SilcVerifyPublicKey completion,
-                                               void *context)
-{
-    // TODO: implement me
-    completion(TRUE, context);
-}
-
 static void _pysilc_client_callback_get_auth_method(SilcClient client,
                                                     SilcClientConnection conn,
                                                     char *hostname,
@@ -1013,7 +1206,38 @@ static void _pysilc_client_callback_key_agreement(SilcClient client,
                                                   SilcUInt16 protocol,
                                                   SilcUInt16 port)
 {
-    // TODO :implement me
+    PYSILC_GET_CLIENT_OR_DIE(client, pyclient);
+    PyObject *callback = NULL, *pyuser = NULL, *args = NULL, *result = NULL;
+
+    // without a handler requests are ignored, as before
+    callback = PyObject_GetAttrString((PyObject *)pyclient, "key_agreement");
+    if (!PyCallable_Check(callback))
+        goto cleanup;
+
+    if ((pyuser = PySilcUser_New(client_entry)) == NULL)
+        goto cleanup;
+    if ((args = Py_BuildValue("(Osii)", pyuser, hostname, protocol,
+                              port)) == NULL)
+        goto cleanup;
+    if ((result = _pysilc_stats_call(pyclient, PYSILC_STAT_KEY_AGREEMENT,
+                                     callback, args)) == 0) {
+        PyErr_Print();
+        goto cleanup;
+    }
+
+    // the exchange itself is queued and runs on the scheduler
+    if (PyObject_IsTrue(result) == 1 &&
+        _pysilc_keyagr_queue(pyclient, client_entry, hostname, port,
+                             hostname != NULL, 0) < 0)
+        PyErr_NoMemory();
+
+cleanup:
+    if (PyErr_Occurred())
+        PyErr_Print();
+    Py_XDECREF(callback);
+    Py_XDECREF(pyuser);
+    Py_XDECREF(args);
+    Py_XDECREF(result);
 }
 
 static void _pysilc_client_callback_ftp(SilcClient client,
@@ -1022,7 +1246,27 @@ static void _pysilc_client_callback_ftp(SilcClient client,
                                         SilcUInt32 session_id,
                                         const char *hostname, SilcUInt16 port)
 {
-    // TODO :implement me
+    PYSILC_GET_CLIENT_OR_DIE(client, pyclient);
+    PyObject *callback = NULL, *pyuser = NULL, *args = NULL, *result = NULL;
+
+    callback = PyObject_GetAttrString((PyObject *)pyclient, "ftp");
+    if (!PyCallable_Check(callback))
+        goto cleanup;
+
+    if ((pyuser = PySilcUser_New(client_entry)) == NULL)
+        goto cleanup;
+    if ((args = Py_BuildValue("(OIsi)", pyuser, session_id,
+                              hostname ? hostname : "", port)) == NULL)
+        goto cleanup;
+    if ((result = _pysilc_stats_call(pyclient, PYSILC_STAT_FTP,
+                                     callback, args)) == 0)
+        PyErr_Print();
+
+cleanup:
+    Py_XDECREF(callback);
+    Py_XDECREF(pyuser);
+    Py_XDECREF(args);
+    Py_XDECREF(result);
 }
 
 static void _pysilc_client_callback_ask_passphrase(SilcClient client,
@@ -1032,24 +1276,32 @@ static void _pysilc_client_callback_ask_passphrase(SilcClient client,
 {
     PYSILC_GET_CLIENT_OR_DIE(client, pyclient);
     PyObject *callback = NULL, *result = NULL;
-    char *passphrase;
-    ssize_t length;
+    char *passphrase = "";
+    Py_ssize_t length;
 
     callback = PyObject_GetAttrString((PyObject *)pyclient, "ask_passphrase");
 
     if (!PyCallable_Check(callback))
         goto cleanup;
 
-    if ((result = PyObject_CallObject(callback, NULL)) == 0)
+    if ((result = _pysilc_stats_call(pyclient, PYSILC_STAT_ASK_PASSPHRASE,
+                                     callback, NULL)) == 0) {
         PyErr_Print();
+        goto cleanup;
+    }
 
-	int success = PyString_AsStringAndSize(result, &passphrase, &length);
-	if (success < 0)
-		goto cleanup;
+    if (PyString_AsStringAndSize(result, &passphrase, &length) < 0) {
+        PyErr_Print();
+        goto cleanup;
+    }
 
-	completion((unsigned char *)passphrase, length, context);
+    completion((unsigned char *)passphrase, length, context);
+    passphrase = NULL;
 
 cleanup:
+    // the toolkit waits for an answer, so give an empty one on failure
+    if (passphrase)
+        completion(NULL, 0, context);
     Py_XDECREF(callback);
     Py_XDECREF(result);
 }
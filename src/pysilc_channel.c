@@ -22,26 +22,41 @@ static PyObject *PySilcChannel_New(SilcChannelEntry channel)
     if (!pychannel)
         return NULL;
 
+    pychannel->id = NULL;
+    pychannel->private_key = NULL;
     pychannel->silcobj = channel;           // TODO: maybe we need to do a clone?
     pychannel->silcobj->context = pychannel; // TODO: self ref should be weak ref?
     PyObject_Init((PyObject *)pychannel, &PySilcChannel_Type);
+    PYSILC_LIVE_INC(PYSILC_LIVE_CHANNEL);
     return (PyObject *)pychannel;
 }
 static void PySilcChannel_Del(PyObject *object)
 {
+    Py_XDECREF(((PySilcChannel *)object)->id);
+    Py_XDECREF(((PySilcChannel *)object)->private_key);
     ((PySilcChannel *)object)->silcobj = NULL;
+    PYSILC_LIVE_DEC(PYSILC_LIVE_CHANNEL);
     PyObject_Del(object);
 }
 
+static PySilcID *_pysilc_channel_get_id(PySilcChannel *pychannel)
+{
+    if (!pychannel->id && pychannel->silcobj)
+        pychannel->id = (PySilcID *)PySilcID_FromId(&(pychannel->silcobj->id),
+                                                    SILC_ID_CHANNEL);
+    return pychannel->id;
+}
+
 static PyObject *PySilcChannel_GetAttr(PyObject *self, PyObject *name)
 {
     // expose the following attributes as readonly
     // - char *channel_name
-    // - 64/160 bit channel id
+    // - SilcID channel_id
     // - unsigned int mode
     // - char * topic
     // - (TODO) founder_key
     // - unsigned int user_limit
+    // - SilcChannelPrivateKey private_key (of the delivered message)
     // - (TODO) user_list
 
     int result;
@@ -86,9 +101,12 @@ static PyObject *PySilcChannel_GetAttr(PyObject *self, PyObject *name)
     if (PyObject_Cmp(temp, name, &result) == -1)
         goto cleanup;
     if (result == 0) {
-        char buf[160];
-        memcpy(&buf, &(pychannel->silcobj->id), 160);
-        value = PyString_FromStringAndSize(buf, 160);
+        value = (PyObject *)_pysilc_channel_get_id(pychannel);
+        if (!value) {
+            Py_DECREF(temp);
+            return NULL;
+        }
+        Py_INCREF(value);
         goto cleanup;
     }
 
@@ -112,6 +130,17 @@ static PyObject *PySilcChannel_GetAttr(PyObject *self, PyObject *name)
         goto cleanup;
     }
 
+    // check for private_key
+    Py_DECREF(temp);
+    temp = PyString_FromString("private_key");
+    if (PyObject_Cmp(temp, name, &result) == -1)
+        goto cleanup;
+    if (result == 0) {
+        value = pychannel->private_key ? pychannel->private_key : Py_None;
+        Py_INCREF(value);
+        goto cleanup;
+    }
+
 cleanup:
     Py_XDECREF(temp);
     if (value)
@@ -125,28 +154,199 @@ static PyObject *PySilcChannel_Str(PyObject *self)
     return PyObject_GetAttrString(self, "channel_name");
 }
 
-static int PySilcChannel_Compare(PyObject *self, PyObject *other)
+static long PySilcChannel_Hash(PyObject *self)
 {
-    if (!PyObject_IsInstance(other, (PyObject *)&PySilcChannel_Type)) {
-        PyErr_SetString(PyExc_TypeError, "Can only compare with SilcChannel.");
+    PySilcID *id;
+
+    if (!((PySilcChannel *)self)->silcobj)
+        return _Py_HashPointer(self);
+    if (!(id = _pysilc_channel_get_id((PySilcChannel *)self)))
         return -1;
+    return id->hash;
+}
+
+static PyObject *PySilcChannel_RichCompare(PyObject *self, PyObject *other, int op)
+{
+    PySilcID *id, *other_id;
+
+    if (!PyObject_TypeCheck(other, &PySilcChannel_Type)) {
+        Py_INCREF(Py_NotImplemented);
+        return Py_NotImplemented;
     }
 
-    int result = 0;
-    PyObject *channel_name = PyObject_GetAttrString(self, "channel_name");
-    PyObject *other_name = PyObject_GetAttrString(self, "channel_name");
-    if (!channel_name || !other_name) {
-        PyErr_SetString(PyExc_RuntimeError, "Does not have channel name");
-        return -1;
+    id = _pysilc_channel_get_id((PySilcChannel *)self);
+    other_id = _pysilc_channel_get_id((PySilcChannel *)other);
+    if (!id || !other_id) {
+        PyErr_SetString(PyExc_RuntimeError, "Does not have channel id");
+        return NULL;
     }
 
-    result = PyObject_Compare(channel_name, other_name);
-    Py_DECREF(channel_name);
-    Py_DECREF(other_name);
-    return result;
+    return _pysilc_id_richcompare(id, other_id, op);
 }
 
 
+/* ---------------- channel private keys ------------- */
+
+// Key of the per client channel key cache: a channel and a key name.
+typedef struct {
+    SilcChannelID id;
+    char *name;
+} PySilcChannelKeyName;
+
+static SilcUInt32 _pysilc_channel_key_hash(void *key, void *user_context)
+{
+    PySilcChannelKeyName *k = (PySilcChannelKeyName *)key;
+    return silc_hash_id(&k->id, SILC_32_TO_PTR(SILC_ID_CHANNEL)) ^
+        silc_hash_string(k->name, NULL);
+}
+
+static SilcBool _pysilc_channel_key_compare(void *key1, void *key2,
+                                            void *user_context)
+{
+    PySilcChannelKeyName *a = (PySilcChannelKeyName *)key1;
+    PySilcChannelKeyName *b = (PySilcChannelKeyName *)key2;
+    return silc_hash_id_compare(&a->id, &b->id, SILC_32_TO_PTR(SILC_ID_CHANNEL)) &&
+        !strcmp(a->name, b->name);
+}
+
+static void _pysilc_channel_key_destructor(void *key, void *context,
+                                           void *user_context)
+{
+    // the SilcChannelPrivateKey itself is owned by the channel entry
+    free(((PySilcChannelKeyName *)key)->name);
+    free(key);
+}
+
+static SilcHashTable _pysilc_channel_keys_alloc(void)
+{
+    return silc_hash_table_alloc(0, _pysilc_channel_key_hash, NULL,
+                                 _pysilc_channel_key_compare, NULL,
+                                 _pysilc_channel_key_destructor, NULL, TRUE);
+}
+
+static void _pysilc_channel_keys_add(SilcHashTable cache,
+                                     SilcChannelEntry channel,
+                                     SilcChannelPrivateKey key)
+{
+    PySilcChannelKeyName *k;
+
+    if (!cache || !key || !key->name)
+        return;
+    if (!(k = malloc(sizeof(*k))))
+        return;
+    k->id = channel->id;
+    if (!(k->name = strdup(key->name))) {
+        free(k);
+        return;
+    }
+    silc_hash_table_replace(cache, k, key);
+}
+
+static SilcChannelPrivateKey _pysilc_channel_keys_find(SilcHashTable cache,
+                                                       SilcChannelID *id,
+                                                       const char *name)
+{
+    PySilcChannelKeyName k;
+    void *key = NULL;
+
+    if (!cache)
+        return NULL;
+    k.id = *id;
+    k.name = (char *)name;
+    if (!silc_hash_table_find(cache, &k, NULL, &key))
+        return NULL;
+    return (SilcChannelPrivateKey)key;
+}
+
+static void _pysilc_channel_keys_del(SilcHashTable cache, SilcChannelID *id,
+                                     const char *name)
+{
+    PySilcChannelKeyName k;
+
+    if (!cache)
+        return;
+    k.id = *id;
+    k.name = (char *)name;
+    silc_hash_table_del(cache, &k);
+}
+
+// Drops all cached keys of a channel, the toolkit frees them with it.
+static void _pysilc_channel_keys_forget(SilcHashTable cache,
+                                        SilcChannelEntry channel)
+{
+    SilcHashTableList htl;
+    PySilcChannelKeyName *k;
+    SilcDList stale;
+    void *key;
+
+    if (!cache || !channel || !(stale = silc_dlist_init()))
+        return;
+
+    silc_hash_table_list(cache, &htl);
+    while (silc_hash_table_get(&htl, (void *)&k, &key))
+        if (silc_hash_id_compare(&k->id, &channel->id,
+                                 SILC_32_TO_PTR(SILC_ID_CHANNEL)))
+            silc_dlist_add(stale, k);
+    silc_hash_table_list_reset(&htl);
+
+    silc_dlist_start(stale);
+    while ((k = silc_dlist_get(stale)) != SILC_LIST_END)
+        silc_hash_table_del(cache, k);
+    silc_dlist_uninit(stale);
+}
+
+// Drops all cached keys, the channels go with the connection.
+static void _pysilc_channel_keys_clear(SilcHashTable cache)
+{
+    SilcHashTableList htl;
+    PySilcChannelKeyName *k;
+    SilcDList stale;
+    void *key;
+
+    if (!cache || !(stale = silc_dlist_init()))
+        return;
+
+    silc_hash_table_list(cache, &htl);
+    while (silc_hash_table_get(&htl, (void *)&k, &key))
+        silc_dlist_add(stale, k);
+    silc_hash_table_list_reset(&htl);
+
+    silc_dlist_start(stale);
+    while ((k = silc_dlist_get(stale)) != SILC_LIST_END)
+        silc_hash_table_del(cache, k);
+    silc_dlist_uninit(stale);
+}
+
+static PyObject *PySilcChannelPrivateKey_New(SilcChannelEntry channel,
+                                             SilcChannelPrivateKey key)
+{
+    if (!channel || !key || !key->name)
+        return NULL;
+    PySilcChannelPrivateKey *pykey = (PySilcChannelPrivateKey *)PyObject_New(PySilcChannelPrivateKey, &PySilcChannelPrivateKey_Type);
+    if (!pykey)
+        return NULL;
+
+    pykey->channel_id = channel->id;
+    if (!(pykey->name = strdup(key->name))) {
+        PyObject_Del(pykey);
+        return PyErr_NoMemory();
+    }
+    PYSILC_LIVE_INC(PYSILC_LIVE_CHANNEL_PRIVATE_KEY);
+    return (PyObject *)pykey;
+}
+
+static void PySilcChannelPrivateKey_Del(PyObject *object)
+{
+    free(((PySilcChannelPrivateKey *)object)->name);
+    PYSILC_LIVE_DEC(PYSILC_LIVE_CHANNEL_PRIVATE_KEY);
+    PyObject_Del(object);
+}
+
+static PyObject *PySilcChannelPrivateKey_Str(PyObject *self)
+{
+    return PyString_FromString(((PySilcChannelPrivateKey *)self)->name);
+}
+
 static PyObject *PySilcKeys_New(SilcPublicKey public, SilcPrivateKey private)
 {
     PySilcKeys *pykeys = (PySilcKeys *)PyObject_New(PySilcKeys, &PySilcKeys_Type);
@@ -157,10 +357,12 @@ static PyObject *PySilcKeys_New(SilcPublicKey public, SilcPrivateKey private)
     pykeys->public = public;
 
     PyObject_Init((PyObject *)pykeys, &PySilcKeys_Type);
+    PYSILC_LIVE_INC(PYSILC_LIVE_KEYS);
     return (PyObject *)pykeys;
 }
 static void PySilcKeys_Del(PyObject *object)
 {
     // TODO: free them properly
+    PYSILC_LIVE_DEC(PYSILC_LIVE_KEYS);
     PyObject_Del(object);
 }
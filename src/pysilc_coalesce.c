@@ -0,0 +1,478 @@
+/*
+ *
+ * PySilc - Python SILC Toolkit Bindings
+ *
+ * Copyright (c) 2006, Alastair Tse <alastair@liquidx.net>
+ * Copyright (c) 2007, Martynas Venckus <martynas@altroot.org>
+ * All rights reserved.
+ *
+ * This program is free software; you can redistributed it and/or modify
+ * it under the terms of the BSD License. See LICENSE in the distribution
+ * for details or http://www.liquidx.net/pysilc/.
+ *
+ */
+
+#include "pysilc.h"
+
+/*
+ * Notify coalescing. With coalesce_notifies(window) the JOIN, LEAVE and
+ * SIGNOFF notifies of a netsplit are not passed on one by one: they are
+ * collected per type and channel for 'window' seconds from the first one
+ * and then delivered as one batch call each, in the order the batches
+ * were started. A join and a leave of the same user on the same channel
+ * within the window cancel out, and a signoff drops the user's pending
+ * joins, so a bot sees where things ended up rather than every step.
+ */
+
+typedef struct {
+    SilcClientEntry user;
+    char *message;              // signoff message
+    int cancelled;
+} PySilcCoalesceUser;
+
+typedef struct {
+    SilcNotifyType type;
+    SilcChannelEntry channel;   // NULL for signoffs on no common channel
+    SilcDList users;            // PySilcCoalesceUser, in arrival order
+    SilcHashTable index;        // client entry -> PySilcCoalesceUser
+    SilcUInt32 live;            // users not cancelled
+} PySilcCoalesceBatch;
+
+typedef struct _PySilcCoalesce {
+    SilcUInt32 window_ms;
+    SilcDList batches;          // PySilcCoalesceBatch, in start order
+    SilcClientConnection conn;  // the entries are referenced through
+    int scheduled;
+} PySilcCoalesce;
+
+static SILC_TASK_CALLBACK(_pysilc_coalesce_task);
+
+static void _pysilc_coalesce_batch_free(PySilcClient *pyclient,
+                                        SilcClientConnection conn,
+                                        PySilcCoalesceBatch *batch)
+{
+    PySilcCoalesceUser *entry;
+
+    silc_dlist_start(batch->users);
+    while ((entry = silc_dlist_get(batch->users)) != SILC_LIST_END) {
+        if (conn && pyclient->silcobj) {
+            silc_client_unref_client(pyclient->silcobj, conn, entry->user);
+            PYSILC_LIVE_DEC(PYSILC_LIVE_CLIENT_ENTRY_REF);
+        }
+        free(entry->message);
+        free(entry);
+    }
+    silc_dlist_uninit(batch->users);
+    silc_hash_table_free(batch->index);
+    if (conn && pyclient->silcobj && batch->channel)
+        silc_client_unref_channel(pyclient->silcobj, conn, batch->channel);
+    free(batch);
+}
+
+static PySilcCoalesceBatch *_pysilc_coalesce_find(PySilcClient *pyclient,
+                                                  SilcClientConnection conn,
+                                                  SilcNotifyType type,
+                                                  SilcChannelEntry channel,
+                                                  int create)
+{
+    PySilcCoalesce *co = pyclient->coalesce;
+    PySilcCoalesceBatch *batch;
+
+    // a few channels at a time even in a netsplit
+    silc_dlist_start(co->batches);
+    while ((batch = silc_dlist_get(co->batches)) != SILC_LIST_END)
+        if (batch->type == type && batch->channel == channel)
+            return batch;
+    if (!create)
+        return NULL;
+
+    if (!(batch = calloc(1, sizeof(*batch))))
+        return NULL;
+    batch->type = type;
+    batch->users = silc_dlist_init();
+    batch->index = silc_hash_table_alloc(0, silc_hash_ptr, NULL, NULL, NULL,
+                                         NULL, NULL, TRUE);
+    if (!batch->users || !batch->index) {
+        if (batch->users)
+            silc_dlist_uninit(batch->users);
+        if (batch->index)
+            silc_hash_table_free(batch->index);
+        free(batch);
+        return NULL;
+    }
+    if (channel) {
+        batch->channel = conn ? silc_client_ref_channel(pyclient->silcobj,
+                                                        conn, channel)
+                              : channel;
+    }
+    silc_dlist_add(co->batches, batch);
+    return batch;
+}
+
+/* Takes the user out of the batch. Returns TRUE if it was in it. */
+static int _pysilc_coalesce_cancel(PySilcCoalesceBatch *batch,
+                                   SilcClientEntry user)
+{
+    PySilcCoalesceUser *entry;
+
+    if (!batch || !silc_hash_table_find(batch->index, user, NULL,
+                                        (void **)&entry))
+        return 0;
+    silc_hash_table_del(batch->index, user);
+    entry->cancelled = 1;
+    batch->live--;
+    return 1;
+}
+
+static int _pysilc_coalesce_add(PySilcClient *pyclient,
+                                SilcClientConnection conn,
+                                PySilcCoalesceBatch *batch,
+                                SilcClientEntry user, const char *message)
+{
+    PySilcCoalesceUser *entry;
+
+    if (silc_hash_table_find(batch->index, user, NULL, NULL))
+        return 1;
+    if (!(entry = calloc(1, sizeof(*entry))))
+        return 0;
+    if (message && !(entry->message = strdup(message))) {
+        free(entry);
+        return 0;
+    }
+    if (conn) {
+        entry->user = silc_client_ref_client(pyclient->silcobj, conn, user);
+        PYSILC_LIVE_INC(PYSILC_LIVE_CLIENT_ENTRY_REF);
+    }
+    else
+        entry->user = user;
+    silc_dlist_add(batch->users, entry);
+    silc_hash_table_add(batch->index, user, entry);
+    batch->live++;
+    return 1;
+}
+
+static int _pysilc_coalesce_take(PySilcClient *pyclient,
+                                 SilcClientConnection conn,
+                                 SilcNotifyType type, va_list va)
+{
+    PySilcCoalesce *co = pyclient->coalesce;
+    PySilcCoalesceBatch *batch;
+    SilcClientEntry user;
+    SilcChannelEntry channel;
+    char *message = NULL;
+
+    if (!co || !co->window_ms)
+        return 0;
+    // all buffered entries must belong to one connection
+    if (silc_dlist_count(co->batches) && co->conn != conn)
+        return 0;
+    co->conn = conn;
+
+    switch (type) {
+    case SILC_NOTIFY_TYPE_JOIN:
+        user = va_arg(va, SilcClientEntry);
+        channel = va_arg(va, SilcChannelEntry);
+        if (!user || !channel)
+            return 0;
+        // left and came back, nothing changed
+        if (_pysilc_coalesce_cancel(_pysilc_coalesce_find(pyclient, conn,
+                                        SILC_NOTIFY_TYPE_LEAVE, channel, 0),
+                                    user))
+            break;
+        if (!(batch = _pysilc_coalesce_find(pyclient, conn, type, channel, 1)))
+            return 0;
+        if (!_pysilc_coalesce_add(pyclient, conn, batch, user, NULL))
+            return 0;
+        break;
+
+    case SILC_NOTIFY_TYPE_LEAVE:
+        user = va_arg(va, SilcClientEntry);
+        channel = va_arg(va, SilcChannelEntry);
+        if (!user || !channel)
+            return 0;
+        // came and went, never seen
+        if (_pysilc_coalesce_cancel(_pysilc_coalesce_find(pyclient, conn,
+                                        SILC_NOTIFY_TYPE_JOIN, channel, 0),
+                                    user))
+            break;
+        if (!(batch = _pysilc_coalesce_find(pyclient, conn, type, channel, 1)))
+            return 0;
+        if (!_pysilc_coalesce_add(pyclient, conn, batch, user, NULL))
+            return 0;
+        break;
+
+    case SILC_NOTIFY_TYPE_SIGNOFF:
+        user = va_arg(va, SilcClientEntry);
+        message = va_arg(va, char *);
+        channel = va_arg(va, SilcChannelEntry);
+        if (!user)
+            return 0;
+        silc_dlist_start(co->batches);
+        while ((batch = silc_dlist_get(co->batches)) != SILC_LIST_END)
+            if (batch->type == SILC_NOTIFY_TYPE_JOIN)
+                _pysilc_coalesce_cancel(batch, user);
+        if (!(batch = _pysilc_coalesce_find(pyclient, conn, type, channel, 1)))
+            return 0;
+        if (!_pysilc_coalesce_add(pyclient, conn, batch, user,
+                                  message ? message : ""))
+            return 0;
+        break;
+
+    default:
+        return 0;
+    }
+
+    if (!co->scheduled && pyclient->silcobj) {
+        co->scheduled = 1;
+        silc_schedule_task_add_timeout(pyclient->silcobj->schedule,
+                                       _pysilc_coalesce_task, pyclient,
+                                       co->window_ms / 1000,
+                                       (co->window_ms % 1000) * 1000);
+    }
+    return 1;
+}
+
+/* Buffers a JOIN, LEAVE or SIGNOFF notify. Returns FALSE if it was not
+   taken and should be delivered as usual; the arguments are left for
+   the notify callback to read either way. */
+static int _pysilc_coalesce_notify(PySilcClient *pyclient,
+                                   SilcClientConnection conn,
+                                   SilcNotifyType type, va_list va)
+{
+    va_list args;
+    int taken;
+
+    va_copy(args, va);
+    taken = _pysilc_coalesce_take(pyclient, conn, type, args);
+    va_end(args);
+    return taken;
+}
+
+/* One call per user, for applications without the batch callback. */
+static void _pysilc_coalesce_deliver_each(PySilcClient *pyclient,
+                                          SilcClientConnection conn,
+                                          PySilcCoalesceBatch *batch,
+                                          PyObject *pychannel,
+                                          PyObject *users)
+{
+    PyObject *callback = NULL, *args = NULL, *result = NULL;
+    PySilcCoalesceUser *entry;
+    PySilcStatEvent event;
+    const char *name;
+    Py_ssize_t i = 0;
+
+    switch (batch->type) {
+    case SILC_NOTIFY_TYPE_JOIN:
+        name = "notify_join";
+        event = PYSILC_STAT_NOTIFY_JOIN;
+        break;
+    case SILC_NOTIFY_TYPE_LEAVE:
+        name = "notify_leave";
+        event = PYSILC_STAT_NOTIFY_LEAVE;
+        break;
+    default:
+        name = "notify_signoff";
+        event = PYSILC_STAT_NOTIFY_SIGNOFF;
+        break;
+    }
+    callback = PyObject_GetAttrString((PyObject *)pyclient, name);
+    if (!PyCallable_Check(callback)) {
+        Py_XDECREF(callback);
+        PyErr_Clear();
+        return;
+    }
+
+    silc_dlist_start(batch->users);
+    while ((entry = silc_dlist_get(batch->users)) != SILC_LIST_END) {
+        if (entry->cancelled)
+            continue;
+        if (batch->type == SILC_NOTIFY_TYPE_SIGNOFF)
+            args = Py_BuildValue("(OsO)", PyTuple_GET_ITEM(users, i),
+                                 entry->message, pychannel);
+        else
+            args = Py_BuildValue("(OO)", PyTuple_GET_ITEM(users, i),
+                                 pychannel);
+        i++;
+        if (!args)
+            break;
+        if ((result = _pysilc_queue_call(pyclient, conn, event,
+                                         callback, args)) == 0)
+            PyErr_Print();
+        Py_DECREF(args);
+        Py_XDECREF(result);
+    }
+    Py_DECREF(callback);
+}
+
+static void _pysilc_coalesce_deliver(PySilcClient *pyclient,
+                                     SilcClientConnection conn,
+                                     PySilcCoalesceBatch *batch)
+{
+    PyObject *callback = NULL, *args = NULL, *result = NULL;
+    PyObject *pychannel = NULL, *users = NULL, *messages = NULL, *item;
+    PySilcCoalesceUser *entry;
+    PySilcStatEvent event;
+    const char *name;
+    Py_ssize_t i = 0;
+
+    if (!batch->live)
+        return;
+
+    if (batch->channel) {
+        if (!(pychannel = PySilcChannel_New(batch->channel)))
+            goto cleanup;
+    }
+    else {
+        pychannel = Py_None;
+        Py_INCREF(Py_None);
+    }
+    if (!(users = PyTuple_New(batch->live)) ||
+        !(messages = PyTuple_New(batch->live)))
+        goto cleanup;
+    silc_dlist_start(batch->users);
+    while ((entry = silc_dlist_get(batch->users)) != SILC_LIST_END) {
+        if (entry->cancelled)
+            continue;
+        if (!(item = PySilcUser_New(entry->user)))
+            goto cleanup;
+        PyTuple_SET_ITEM(users, i, item);
+        if (!(item = PyString_FromString(entry->message ? entry->message : "")))
+            goto cleanup;
+        PyTuple_SET_ITEM(messages, i, item);
+        i++;
+    }
+
+    switch (batch->type) {
+    case SILC_NOTIFY_TYPE_JOIN:
+        name = "notify_join_batch";
+        event = PYSILC_STAT_NOTIFY_JOIN_BATCH;
+        break;
+    case SILC_NOTIFY_TYPE_LEAVE:
+        name = "notify_leave_batch";
+        event = PYSILC_STAT_NOTIFY_LEAVE_BATCH;
+        break;
+    default:
+        name = "notify_signoff_batch";
+        event = PYSILC_STAT_NOTIFY_SIGNOFF_BATCH;
+        break;
+    }
+    callback = PyObject_GetAttrString((PyObject *)pyclient, name);
+    if (!PyCallable_Check(callback)) {
+        PyErr_Clear();
+        _pysilc_coalesce_deliver_each(pyclient, conn, batch, pychannel,
+                                      users);
+        goto cleanup;
+    }
+
+    if (batch->type == SILC_NOTIFY_TYPE_SIGNOFF)
+        args = Py_BuildValue("(OOO)", pychannel, users, messages);
+    else
+        args = Py_BuildValue("(OO)", pychannel, users);
+    if (!args)
+        goto cleanup;
+    if ((result = _pysilc_queue_call(pyclient, conn, event, callback,
+                                     args)) == 0)
+        PyErr_Print();
+
+cleanup:
+    if (PyErr_Occurred())
+        PyErr_Print();
+    Py_XDECREF(pychannel);
+    Py_XDECREF(users);
+    Py_XDECREF(messages);
+    Py_XDECREF(callback);
+    Py_XDECREF(args);
+    Py_XDECREF(result);
+}
+
+/* Delivers everything buffered now. */
+static void _pysilc_coalesce_flush(PySilcClient *pyclient)
+{
+    PySilcCoalesce *co = pyclient->coalesce;
+    PySilcCoalesceBatch *batch;
+    SilcClientConnection conn;
+    SilcDList batches;
+
+    if (!co || !silc_dlist_count(co->batches))
+        return;
+
+    // callbacks may buffer new notifies or turn coalescing off
+    batches = co->batches;
+    conn = co->conn;
+    if (!(co->batches = silc_dlist_init())) {
+        co->batches = batches;
+        return;
+    }
+
+    silc_dlist_start(batches);
+    while ((batch = silc_dlist_get(batches)) != SILC_LIST_END)
+        _pysilc_coalesce_deliver(pyclient, conn, batch);
+    silc_dlist_start(batches);
+    while ((batch = silc_dlist_get(batches)) != SILC_LIST_END)
+        _pysilc_coalesce_batch_free(pyclient, conn, batch);
+    silc_dlist_uninit(batches);
+}
+
+static SILC_TASK_CALLBACK(_pysilc_coalesce_task)
+{
+    PySilcClient *pyclient = (PySilcClient *)context;
+
+    if (!pyclient->coalesce)
+        return;
+    pyclient->coalesce->scheduled = 0;
+    _pysilc_stats_enter(pyclient);
+    _pysilc_coalesce_flush(pyclient);
+}
+
+/* Drops whatever is buffered, for the client going away. */
+static void _pysilc_coalesce_free(PySilcClient *pyclient)
+{
+    PySilcCoalesce *co = pyclient->coalesce;
+    PySilcCoalesceBatch *batch;
+
+    if (!co)
+        return;
+    if (pyclient->silcobj)
+        silc_schedule_task_del_by_all(pyclient->silcobj->schedule, 0,
+                                      _pysilc_coalesce_task, pyclient);
+    silc_dlist_start(co->batches);
+    while ((batch = silc_dlist_get(co->batches)) != SILC_LIST_END)
+        _pysilc_coalesce_batch_free(pyclient, co->conn, batch);
+    silc_dlist_uninit(co->batches);
+    free(co);
+    pyclient->coalesce = NULL;
+}
+
+static PyObject *pysilc_client_coalesce_notifies(PyObject *self,
+                                                 PyObject *args)
+{
+    PySilcClient *pyclient = (PySilcClient *)self;
+    PySilcCoalesce *co;
+    double window;
+
+    if (!PyArg_ParseTuple(args, "d", &window))
+        return NULL;
+    if (window < 0) {
+        PyErr_SetString(PyExc_ValueError, "window should not be negative");
+        return NULL;
+    }
+
+    if (!window) {
+        // what is buffered still goes out
+        _pysilc_coalesce_flush(pyclient);
+        _pysilc_coalesce_free(pyclient);
+        Py_RETURN_NONE;
+    }
+
+    if (!(co = pyclient->coalesce)) {
+        if (!(co = calloc(1, sizeof(*co))))
+            return PyErr_NoMemory();
+        if (!(co->batches = silc_dlist_init())) {
+            free(co);
+            return PyErr_NoMemory();
+        }
+        pyclient->coalesce = co;
+    }
+    co->window_ms = (SilcUInt32)(window * 1000);
+    Py_RETURN_NONE;
+}
@@ -0,0 +1,210 @@
+/*
+ *
+ * PySilc - Python SILC Toolkit Bindings
+ *
+ * Copyright (c) 2006, Alastair Tse <alastair@liquidx.net>
+ * Copyright (c) 2007, Martynas Venckus <martynas@altroot.org>
+ * All rights reserved.
+ *
+ * This program is free software; you can redistributed it and/or modify
+ * it under the terms of the BSD License. See LICENSE in the distribution
+ * for details or http://www.liquidx.net/pysilc/.
+ *
+ */
+
+#include "pysilc.h"
+
+/*
+ * Connecting to the first of several candidate servers to answer. TCP
+ * connections are started one after another, each a stagger interval
+ * after the last or at once when one fails, and raced; the first to
+ * connect gets the key exchange and the others are aborted, so the
+ * server with the fastest path wins rather than the first listed.
+ */
+
+typedef struct {
+    struct _PySilcConnectRace *race;
+    char *host;
+    int port;
+    SilcAsyncOperation op;          // TCP connect in progress, or NULL
+} PySilcConnectCandidate;
+
+typedef struct _PySilcConnectRace {
+    PySilcClient *pyclient;
+    PySilcConnectCandidate *candidates;
+    SilcUInt32 count;
+    SilcUInt32 started;
+    SilcUInt32 failed;
+    SilcUInt32 stagger_ms;
+    int starting;                   // inside _pysilc_connect_race()
+} PySilcConnectRace;
+
+static SILC_TASK_CALLBACK(_pysilc_connect_stagger_task);
+
+/* Aborts the connects still in progress and frees the race. */
+static void _pysilc_connect_free(PySilcClient *pyclient)
+{
+    PySilcConnectRace *race = pyclient->race;
+    SilcUInt32 i;
+
+    if (!race)
+        return;
+    if (pyclient->silcobj)
+        silc_schedule_task_del_by_all(pyclient->silcobj->schedule, 0,
+                                      _pysilc_connect_stagger_task, race);
+    for (i = 0; i < race->count; i++) {
+        if (race->candidates[i].op)
+            silc_async_abort(race->candidates[i].op, NULL, NULL);
+        free(race->candidates[i].host);
+    }
+    free(race->candidates);
+    free(race);
+    pyclient->race = NULL;
+}
+
+static void _pysilc_connect_start_next(PySilcConnectRace *race);
+
+static void _pysilc_connect_completion(SilcNetStatus status,
+                                       SilcStream stream, void *context)
+{
+    PySilcConnectCandidate *candidate = (PySilcConnectCandidate *)context;
+    PySilcConnectRace *race = candidate->race;
+    PySilcClient *pyclient = race->pyclient;
+
+    candidate->op = NULL;
+
+    if (status == SILC_NET_OK) {
+        // the others are aborted before the key exchange starts
+        _pysilc_connect_free(pyclient);
+        if (!silc_client_key_exchange(pyclient->silcobj, &pyclient->params,
+                                      pyclient->keys->public,
+                                      pyclient->keys->private, stream,
+                                      SILC_CONN_SERVER,
+                                      pyclient->conncallback, NULL))
+            pyclient->conncallback(pyclient->silcobj, NULL,
+                                   SILC_CLIENT_CONN_ERROR, SILC_STATUS_OK,
+                                   "Key exchange could not be started", NULL);
+        return;
+    }
+
+    race->failed++;
+    if (race->failed < race->count) {
+        // do not wait out the stagger for the next one
+        if (race->started < race->count)
+            _pysilc_connect_start_next(race);
+        return;
+    }
+
+    // failing at once, connect_to_server() returns -1 instead
+    if (race->starting)
+        return;
+
+    // all of them failed, as a single connect would report it
+    _pysilc_connect_free(pyclient);
+    pyclient->conncallback(pyclient->silcobj, NULL, SILC_CLIENT_CONN_ERROR,
+                           SILC_STATUS_OK, "No server could be connected to",
+                           NULL);
+}
+
+static void _pysilc_connect_start_next(PySilcConnectRace *race)
+{
+    PySilcClient *pyclient = race->pyclient;
+    PySilcConnectCandidate *candidate = &race->candidates[race->started++];
+
+    silc_schedule_task_del_by_all(pyclient->silcobj->schedule, 0,
+                                  _pysilc_connect_stagger_task, race);
+    if (race->started < race->count)
+        silc_schedule_task_add_timeout(pyclient->silcobj->schedule,
+                                       _pysilc_connect_stagger_task, race,
+                                       race->stagger_ms / 1000,
+                                       (race->stagger_ms % 1000) * 1000);
+
+    // the completion comes from the scheduler, or from here when the
+    // connect could not even be started
+    candidate->op = silc_net_tcp_connect(pyclient->params.bind_ip,
+                                         candidate->host, candidate->port,
+                                         pyclient->silcobj->schedule,
+                                         _pysilc_connect_completion,
+                                         candidate);
+    if (!candidate->op)
+        _pysilc_connect_completion(SILC_NET_ERROR, NULL, candidate);
+}
+
+static SILC_TASK_CALLBACK(_pysilc_connect_stagger_task)
+{
+    PySilcConnectRace *race = (PySilcConnectRace *)context;
+
+    if (race->started < race->count)
+        _pysilc_connect_start_next(race);
+}
+
+/* Starts racing the (host, port) candidates in the sequence. Returns -1
+   with an exception set if it is not one, and 1 if no connect could be
+   started at all; the connect callback is not called then. */
+static int _pysilc_connect_race(PySilcClient *pyclient, PyObject *hosts,
+                                unsigned int port, double stagger)
+{
+    PySilcConnectRace *race;
+    PyObject *seq, *item;
+    char *host;
+    int candidate_port;
+    Py_ssize_t count, i;
+
+    if (!(seq = PySequence_Fast(hosts, "host should be a string or a "
+                                       "sequence of candidate servers")))
+        return -1;
+    if (!(count = PySequence_Fast_GET_SIZE(seq))) {
+        Py_DECREF(seq);
+        PyErr_SetString(PyExc_ValueError, "no candidate servers given");
+        return -1;
+    }
+
+    _pysilc_connect_free(pyclient);
+    if (!(race = calloc(1, sizeof(*race))) ||
+        !(race->candidates = calloc(count, sizeof(*race->candidates)))) {
+        free(race);
+        Py_DECREF(seq);
+        PyErr_NoMemory();
+        return -1;
+    }
+    race->pyclient = pyclient;
+    race->stagger_ms = (SilcUInt32)(stagger * 1000);
+    pyclient->race = race;
+
+    for (i = 0; i < count; i++) {
+        item = PySequence_Fast_GET_ITEM(seq, i);
+        candidate_port = port;
+        if (PyString_Check(item))
+            host = PyString_AS_STRING(item);
+        else if (!PyTuple_Check(item)) {
+            PyErr_SetString(PyExc_TypeError, "candidate servers should be "
+                            "host names or (host, port) tuples");
+            goto error;
+        } else if (!PyArg_ParseTuple(item, "s|i;candidate servers should be "
+                                     "host names or (host, port) tuples",
+                                     &host, &candidate_port))
+            goto error;
+        race->candidates[i].race = race;
+        race->candidates[i].port = candidate_port;
+        if (!(race->candidates[i].host = strdup(host))) {
+            PyErr_NoMemory();
+            goto error;
+        }
+        race->count++;
+    }
+    Py_DECREF(seq);
+
+    race->starting = 1;
+    _pysilc_connect_start_next(race);
+    if (race->failed == race->count) {
+        _pysilc_connect_free(pyclient);
+        return 1;
+    }
+    race->starting = 0;
+    return 0;
+
+error:
+    Py_DECREF(seq);
+    _pysilc_connect_free(pyclient);
+    return -1;
+}
@@ -0,0 +1,653 @@
+/*
+ *
+ * PySilc - Python SILC Toolkit Bindings
+ *
+ * Copyright (c) 2006, Alastair Tse <alastair@liquidx.net>
+ * Copyright (c) 2007, Martynas Venckus <martynas@altroot.org>
+ * All rights reserved.
+ *
+ * This program is free software; you can redistributed it and/or modify
+ * it under the terms of the BSD License. See LICENSE in the distribution
+ * for details or http://www.liquidx.net/pysilc/.
+ *
+ */
+
+#include "pysilc.h"
+#include <ctype.h>
+#include <regex.h>
+
+/*
+ * Inbound message filter. Rules added with add_filter() are checked
+ * against each channel and private message before any Python object is
+ * made for it; the first matching rule in the order they were added
+ * drops the message, or delivers it to its own target or with its tag.
+ *
+ * The prefix and substring patterns of all rules are compiled into one
+ * Aho-Corasick automaton, so a message is scanned once whatever the
+ * number of patterns, and only the rules whose patterns occur in it are
+ * looked at further. Rules without patterns are kept per channel. The
+ * regular expressions, the costly part, are only run for those
+ * candidates, in rule order, until one matches.
+ */
+
+#define PYSILC_FILTER_PREFIX    1
+#define PYSILC_FILTER_CONTAINS  2
+
+typedef struct {
+    long id;
+    int action;
+    int text;               // PYSILC_FILTER_PREFIX | PYSILC_FILTER_CONTAINS
+    char *channel;
+    char *sender;
+    SilcUInt32 flags;       // all of them must be set
+    char *prefix;
+    char *contains;
+    char *pattern;          // regular expression, NULL when none
+    regex_t regex;
+    PyObject *target;
+    PyObject *tag;
+    SilcUInt64 hits;
+} PySilcFilterRule;
+
+/* Automaton state. Children are a sibling list, the states are few
+   compared to a full 256 entry table each. */
+typedef struct {
+    SilcUInt32 child;
+    SilcUInt32 sibling;
+    SilcUInt32 fail;
+    SilcUInt32 output;      // first pattern ending here
+    SilcUInt32 dict;        // next state on the fail chain with output
+    unsigned char c;
+} PySilcFilterState;
+
+typedef struct {
+    SilcUInt32 rule;
+    SilcUInt32 len;
+    int kind;
+    SilcUInt32 next;
+} PySilcFilterOutput;
+
+typedef struct {
+    SilcUInt32 *index;
+    SilcUInt32 count;
+    SilcUInt32 size;
+} PySilcFilterList;
+
+typedef struct _PySilcFilter {
+    PySilcFilterRule **rules;
+    SilcUInt32 count;
+    SilcUInt32 size;
+    long next_id;
+    int dirty;              // rebuild the rest before the next match
+
+    PySilcFilterState *states;      // 0 is the root
+    SilcUInt32 state_count;
+    PySilcFilterOutput *outputs;    // 0 ends a list
+    SilcUInt32 output_count;
+    PySilcFilterList any_channel;   // rules without patterns
+    SilcHashTable by_channel;       // channel -> PySilcFilterList, likewise
+    SilcUInt32 *seen;               // per rule, the message it was hit by
+    unsigned char *found;           // per rule, the patterns found
+    SilcUInt32 generation;
+    PySilcFilterList hits;
+} PySilcFilter;
+
+static int _pysilc_filter_list_add(PySilcFilterList *list, SilcUInt32 index)
+{
+    SilcUInt32 *grown;
+
+    if (list->count == list->size) {
+        grown = realloc(list->index, (list->size ? list->size * 2 : 8) *
+                                     sizeof(*list->index));
+        if (!grown)
+            return -1;
+        list->index = grown;
+        list->size = list->size ? list->size * 2 : 8;
+    }
+    list->index[list->count++] = index;
+    return 0;
+}
+
+static void _pysilc_filter_lower(char *dst, const char *src, size_t size)
+{
+    size_t i;
+
+    for (i = 0; i + 1 < size && src[i]; i++)
+        dst[i] = tolower((unsigned char)src[i]);
+    dst[i] = '\0';
+}
+
+static void _pysilc_filter_rule_free(PySilcFilterRule *rule)
+{
+    free(rule->channel);
+    free(rule->sender);
+    free(rule->prefix);
+    free(rule->contains);
+    if (rule->pattern) {
+        regfree(&rule->regex);
+        free(rule->pattern);
+    }
+    Py_XDECREF(rule->target);
+    Py_XDECREF(rule->tag);
+    free(rule);
+}
+
+static void _pysilc_filter_channel_destructor(void *key, void *context,
+                                              void *user_context)
+{
+    PySilcFilterList *list = (PySilcFilterList *)context;
+
+    free(key);
+    free(list->index);
+    free(list);
+}
+
+static void _pysilc_filter_reset(PySilcFilter *filter)
+{
+    free(filter->states);
+    free(filter->outputs);
+    free(filter->any_channel.index);
+    free(filter->seen);
+    free(filter->found);
+    free(filter->hits.index);
+    filter->states = NULL;
+    filter->outputs = NULL;
+    filter->state_count = filter->output_count = 0;
+    memset(&filter->any_channel, 0, sizeof(filter->any_channel));
+    memset(&filter->hits, 0, sizeof(filter->hits));
+    filter->seen = NULL;
+    filter->found = NULL;
+    filter->generation = 0;
+    if (filter->by_channel) {
+        silc_hash_table_free(filter->by_channel);
+        filter->by_channel = NULL;
+    }
+}
+
+static void _pysilc_filter_free(PySilcClient *pyclient)
+{
+    PySilcFilter *filter = pyclient->filter;
+    SilcUInt32 i;
+
+    if (!filter)
+        return;
+    _pysilc_filter_reset(filter);
+    for (i = 0; i < filter->count; i++)
+        _pysilc_filter_rule_free(filter->rules[i]);
+    free(filter->rules);
+    free(filter);
+    pyclient->filter = NULL;
+}
+
+static SilcUInt32 _pysilc_filter_goto(PySilcFilter *filter, SilcUInt32 state,
+                                      unsigned char c)
+{
+    SilcUInt32 child;
+
+    for (child = filter->states[state].child; child;
+         child = filter->states[child].sibling)
+        if (filter->states[child].c == c)
+            return child;
+    return 0;
+}
+
+static void _pysilc_filter_insert(PySilcFilter *filter, const char *pattern,
+                                  SilcUInt32 rule, int kind)
+{
+    PySilcFilterState *state;
+    PySilcFilterOutput *output;
+    SilcUInt32 current = 0, next;
+    const unsigned char *c;
+
+    for (c = (const unsigned char *)pattern; *c; c++) {
+        if ((next = _pysilc_filter_goto(filter, current, *c))) {
+            current = next;
+            continue;
+        }
+        next = filter->state_count++;
+        state = &filter->states[next];
+        memset(state, 0, sizeof(*state));
+        state->c = *c;
+        state->sibling = filter->states[current].child;
+        filter->states[current].child = next;
+        current = next;
+    }
+
+    output = &filter->outputs[filter->output_count];
+    output->rule = rule;
+    output->len = strlen(pattern);
+    output->kind = kind;
+    output->next = filter->states[current].output;
+    filter->states[current].output = filter->output_count++;
+}
+
+static int _pysilc_filter_build(PySilcFilter *filter)
+{
+    PySilcFilterRule *rule;
+    PySilcFilterList *list;
+    SilcUInt32 i, states = 1, *queue, head = 0, tail = 0, s, t, f;
+    char *key;
+
+    _pysilc_filter_reset(filter);
+
+    // a state per pattern byte at most
+    for (i = 0; i < filter->count; i++) {
+        rule = filter->rules[i];
+        states += (rule->prefix ? strlen(rule->prefix) : 0) +
+                  (rule->contains ? strlen(rule->contains) : 0);
+    }
+    filter->states = calloc(states, sizeof(*filter->states));
+    filter->outputs = calloc(2 * filter->count + 1, sizeof(*filter->outputs));
+    filter->seen = calloc(filter->count + 1, sizeof(*filter->seen));
+    filter->found = calloc(filter->count + 1, sizeof(*filter->found));
+    filter->by_channel = silc_hash_table_alloc(0, silc_hash_string, NULL,
+                                               silc_hash_string_compare, NULL,
+                                               _pysilc_filter_channel_destructor,
+                                               NULL, TRUE);
+    if (!filter->states || !filter->outputs || !filter->seen ||
+        !filter->found || !filter->by_channel)
+        return -1;
+    filter->state_count = 1;
+    filter->output_count = 1;
+
+    for (i = 0; i < filter->count; i++) {
+        rule = filter->rules[i];
+        if (rule->prefix)
+            _pysilc_filter_insert(filter, rule->prefix, i,
+                                  PYSILC_FILTER_PREFIX);
+        if (rule->contains)
+            _pysilc_filter_insert(filter, rule->contains, i,
+                                  PYSILC_FILTER_CONTAINS);
+        if (rule->text)
+            continue;
+
+        if (!rule->channel) {
+            if (_pysilc_filter_list_add(&filter->any_channel, i) < 0)
+                return -1;
+            continue;
+        }
+        if (!silc_hash_table_find(filter->by_channel, rule->channel, NULL,
+                                  (void **)&list)) {
+            if (!(list = calloc(1, sizeof(*list))))
+                return -1;
+            if (!(key = strdup(rule->channel))) {
+                free(list);
+                return -1;
+            }
+            silc_hash_table_add(filter->by_channel, key, list);
+        }
+        if (_pysilc_filter_list_add(list, i) < 0)
+            return -1;
+    }
+
+    // failure links, breadth first
+    if (!(queue = malloc(filter->state_count * sizeof(*queue))))
+        return -1;
+    for (t = filter->states[0].child; t; t = filter->states[t].sibling)
+        queue[tail++] = t;
+    while (head < tail) {
+        s = queue[head++];
+        for (t = filter->states[s].child; t; t = filter->states[t].sibling) {
+            f = filter->states[s].fail;
+            while (f && !_pysilc_filter_goto(filter, f, filter->states[t].c))
+                f = filter->states[f].fail;
+            f = _pysilc_filter_goto(filter, f, filter->states[t].c);
+            filter->states[t].fail = f != t ? f : 0;
+            f = filter->states[t].fail;
+            filter->states[t].dict = filter->states[f].output ?
+                                     f : filter->states[f].dict;
+            queue[tail++] = t;
+        }
+    }
+    free(queue);
+
+    filter->dirty = 0;
+    return 0;
+}
+
+static int _pysilc_filter_compare(const void *a, const void *b)
+{
+    SilcUInt32 x = *(const SilcUInt32 *)a, y = *(const SilcUInt32 *)b;
+    return x < y ? -1 : x > y;
+}
+
+/* Scans the message once and collects the rules all of whose patterns
+   occur in it, in rule order. */
+static void _pysilc_filter_scan(PySilcFilter *filter,
+                                const unsigned char *message,
+                                SilcUInt32 message_len)
+{
+    PySilcFilterOutput *output;
+    SilcUInt32 i, s = 0, t, o, d, rule;
+
+    filter->hits.count = 0;
+    if (filter->state_count <= 1)
+        return;
+    if (!++filter->generation) {
+        memset(filter->seen, 0, filter->count * sizeof(*filter->seen));
+        filter->generation = 1;
+    }
+
+    for (i = 0; i < message_len; i++) {
+        for (;;) {
+            t = _pysilc_filter_goto(filter, s, message[i]);
+            if (t || !s)
+                break;
+            s = filter->states[s].fail;
+        }
+        s = t;
+
+        for (d = filter->states[s].output ? s : filter->states[s].dict; d;
+             d = filter->states[d].dict) {
+            for (o = filter->states[d].output; o; o = output->next) {
+                output = &filter->outputs[o];
+                if (output->kind == PYSILC_FILTER_PREFIX &&
+                    output->len != i + 1)
+                    continue;
+                rule = output->rule;
+                if (filter->seen[rule] != filter->generation) {
+                    filter->seen[rule] = filter->generation;
+                    filter->found[rule] = 0;
+                }
+                if (filter->found[rule] & output->kind)
+                    continue;
+                filter->found[rule] |= output->kind;
+                if (filter->found[rule] == filter->rules[rule]->text)
+                    _pysilc_filter_list_add(&filter->hits, rule);
+            }
+        }
+    }
+
+    if (filter->hits.count > 1)
+        qsort(filter->hits.index, filter->hits.count,
+              sizeof(*filter->hits.index), _pysilc_filter_compare);
+}
+
+static int _pysilc_filter_rule_matches(PySilcFilterRule *rule,
+                                       const char *sender,
+                                       const char *channel,
+                                       SilcMessageFlags flags,
+                                       const unsigned char *message,
+                                       SilcUInt32 message_len, char **text)
+{
+    if (rule->channel && (!channel || strcmp(rule->channel, channel)))
+        return 0;
+    if (rule->sender && strcasecmp(rule->sender, sender))
+        return 0;
+    if ((flags & rule->flags) != rule->flags)
+        return 0;
+    if (!rule->pattern)
+        return 1;
+
+    // regexec wants it terminated; copied once per message at most
+    if (!*text) {
+        if (!(*text = malloc(message_len + 1)))
+            return 0;
+        memcpy(*text, message, message_len);
+        (*text)[message_len] = '\0';
+    }
+    return !regexec(&rule->regex, *text, 0, NULL, 0);
+}
+
+/* The first rule matching the message, or NULL for the default action.
+   'channel' is NULL for private messages. */
+static PySilcFilterRule *_pysilc_filter_match(PySilcClient *pyclient,
+                                              SilcClientEntry sender,
+                                              SilcChannelEntry channel,
+                                              SilcMessageFlags flags,
+                                              const unsigned char *message,
+                                              SilcUInt32 message_len)
+{
+    PySilcFilter *filter = pyclient->filter;
+    PySilcFilterList *lists[3], *per_channel = NULL;
+    PySilcFilterRule *rule, *matched = NULL;
+    SilcUInt32 next[3] = {0, 0, 0}, best;
+    char name[257], *text = NULL;
+    const char *nickname = sender ? sender->nickname : "";
+    int i, from;
+
+    if (!filter || !filter->count)
+        return NULL;
+    // out of memory, everything takes the default until rebuilt
+    if (filter->dirty && _pysilc_filter_build(filter) < 0)
+        return NULL;
+
+    _pysilc_filter_scan(filter, message, message_len);
+    name[0] = '\0';
+    if (channel && channel->channel_name) {
+        _pysilc_filter_lower(name, channel->channel_name, sizeof(name));
+        silc_hash_table_find(filter->by_channel, name, NULL,
+                             (void **)&per_channel);
+    }
+    lists[0] = &filter->any_channel;
+    lists[1] = per_channel;
+    lists[2] = &filter->hits;
+
+    // the candidates of the three lists in rule order
+    for (;;) {
+        from = -1;
+        best = 0;
+        for (i = 0; i < 3; i++) {
+            if (!lists[i] || next[i] >= lists[i]->count)
+                continue;
+            if (from < 0 || lists[i]->index[next[i]] < best) {
+                from = i;
+                best = lists[i]->index[next[i]];
+            }
+        }
+        if (from < 0)
+            break;
+        next[from]++;
+
+        rule = filter->rules[best];
+        if (_pysilc_filter_rule_matches(rule, nickname,
+                                        channel ? name : NULL, flags,
+                                        message, message_len, &text)) {
+            matched = rule;
+            matched->hits++;
+            break;
+        }
+    }
+
+    free(text);
+    return matched;
+}
+
+/* Whether the message is dropped, by a rule or by filter_default. */
+static int _pysilc_filter_drops(PySilcClient *pyclient,
+                                PySilcFilterRule *rule)
+{
+    if (rule)
+        return rule->action == PYSILC_FILTER_DROP;
+    return pyclient->filter_default == PYSILC_FILTER_DROP;
+}
+
+static int _pysilc_filter_string(PyObject *obj, char **dst, int lower)
+{
+    char *src;
+    size_t len;
+
+    if (!obj || obj == Py_None)
+        return 0;
+    if (!(src = PyString_AsString(obj)))
+        return -1;
+    if (!(len = strlen(src)))
+        return 0;
+    if (!(*dst = malloc(len + 1))) {
+        PyErr_NoMemory();
+        return -1;
+    }
+    if (lower)
+        _pysilc_filter_lower(*dst, src, len + 1);
+    else
+        memcpy(*dst, src, len + 1);
+    return 0;
+}
+
+/* Compiles a POSIX extended regular expression string. Compiled Python
+   patterns are refused, their syntax is not the same. */
+static int _pysilc_filter_regex(PySilcFilterRule *rule, PyObject *regex)
+{
+    int error;
+    char message[256];
+
+    if (!regex || regex == Py_None)
+        return 0;
+    if (!PyString_Check(regex)) {
+        PyErr_SetString(PyExc_TypeError, "regex should be a string holding "
+                        "a POSIX extended regular expression");
+        return -1;
+    }
+
+    if ((error = regcomp(&rule->regex, PyString_AS_STRING(regex),
+                         REG_EXTENDED | REG_NOSUB))) {
+        regerror(error, &rule->regex, message, sizeof(message));
+        PyErr_Format(PyExc_ValueError, "bad regex: %s", message);
+        return -1;
+    }
+    if (!(rule->pattern = strdup(PyString_AS_STRING(regex)))) {
+        regfree(&rule->regex);
+        PyErr_NoMemory();
+        return -1;
+    }
+    return 0;
+}
+
+static PyObject *pysilc_client_add_filter(PyObject *self, PyObject *args,
+                                          PyObject *kwds)
+{
+    PySilcClient *pyclient = (PySilcClient *)self;
+    PySilcFilter *filter;
+    PySilcFilterRule *rule, **grown;
+    int action = PYSILC_FILTER_ACCEPT;
+    unsigned int flags = 0;
+    PyObject *channel = NULL, *sender = NULL, *prefix = NULL;
+    PyObject *contains = NULL, *regex = NULL, *target = NULL, *tag = NULL;
+    static char *kwlist[] = {"action", "channel", "sender", "flags",
+                             "prefix", "contains", "regex", "target", "tag",
+                             NULL};
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "|iOOIOOOOO", kwlist,
+                                     &action, &channel, &sender, &flags,
+                                     &prefix, &contains, &regex, &target,
+                                     &tag))
+        return NULL;
+    if (action != PYSILC_FILTER_ACCEPT && action != PYSILC_FILTER_DROP) {
+        PyErr_SetString(PyExc_ValueError,
+                        "action should be FILTER_ACCEPT or FILTER_DROP");
+        return NULL;
+    }
+    if (target == Py_None)
+        target = NULL;
+    if (target && !PyCallable_Check(target)) {
+        PyErr_SetString(PyExc_TypeError, "target should be callable");
+        return NULL;
+    }
+
+    if (!(filter = pyclient->filter)) {
+        if (!(filter = calloc(1, sizeof(*filter))))
+            return PyErr_NoMemory();
+        pyclient->filter = filter;
+    }
+    if (filter->count == filter->size) {
+        grown = realloc(filter->rules, (filter->size ? filter->size * 2 : 16) *
+                                       sizeof(*filter->rules));
+        if (!grown)
+            return PyErr_NoMemory();
+        filter->rules = grown;
+        filter->size = filter->size ? filter->size * 2 : 16;
+    }
+    if (!(rule = calloc(1, sizeof(*rule))))
+        return PyErr_NoMemory();
+
+    rule->action = action;
+    rule->flags = flags;
+    if (_pysilc_filter_string(channel, &rule->channel, 1) < 0 ||
+        _pysilc_filter_string(sender, &rule->sender, 0) < 0 ||
+        _pysilc_filter_string(prefix, &rule->prefix, 0) < 0 ||
+        _pysilc_filter_string(contains, &rule->contains, 0) < 0 ||
+        _pysilc_filter_regex(rule, regex) < 0) {
+        _pysilc_filter_rule_free(rule);
+        return NULL;
+    }
+    rule->text = (rule->prefix ? PYSILC_FILTER_PREFIX : 0) |
+                 (rule->contains ? PYSILC_FILTER_CONTAINS : 0);
+    if (target) {
+        rule->target = target;
+        Py_INCREF(target);
+    }
+    if (tag && tag != Py_None) {
+        rule->tag = tag;
+        Py_INCREF(tag);
+    }
+
+    rule->id = ++filter->next_id;
+    filter->rules[filter->count++] = rule;
+    filter->dirty = 1;
+    return PyInt_FromLong(rule->id);
+}
+
+static PyObject *pysilc_client_remove_filter(PyObject *self, PyObject *args)
+{
+    PySilcClient *pyclient = (PySilcClient *)self;
+    PySilcFilter *filter = pyclient->filter;
+    long id;
+    SilcUInt32 i;
+
+    if (!PyArg_ParseTuple(args, "l", &id))
+        return NULL;
+    if (!filter)
+        Py_RETURN_FALSE;
+
+    for (i = 0; i < filter->count; i++) {
+        if (filter->rules[i]->id != id)
+            continue;
+        _pysilc_filter_rule_free(filter->rules[i]);
+        memmove(&filter->rules[i], &filter->rules[i + 1],
+                (filter->count - i - 1) * sizeof(*filter->rules));
+        filter->count--;
+        filter->dirty = 1;
+        Py_RETURN_TRUE;
+    }
+    Py_RETURN_FALSE;
+}
+
+static PyObject *pysilc_client_clear_filters(PyObject *self)
+{
+    _pysilc_filter_free((PySilcClient *)self);
+    Py_RETURN_NONE;
+}
+
+static PyObject *pysilc_client_filters(PyObject *self)
+{
+    PySilcClient *pyclient = (PySilcClient *)self;
+    PySilcFilter *filter = pyclient->filter;
+    PySilcFilterRule *rule;
+    PyObject *list, *item;
+    SilcUInt32 i;
+
+    if (!(list = PyList_New(0)))
+        return NULL;
+    for (i = 0; filter && i < filter->count; i++) {
+        rule = filter->rules[i];
+        item = Py_BuildValue("{s:l,s:i,s:z,s:z,s:I,s:z,s:z,s:z,s:O,s:O,s:K}",
+                             "id", rule->id,
+                             "action", rule->action,
+                             "channel", rule->channel,
+                             "sender", rule->sender,
+                             "flags", rule->flags,
+                             "prefix", rule->prefix,
+                             "contains", rule->contains,
+                             "regex", rule->pattern,
+                             "target", rule->target ? rule->target : Py_None,
+                             "tag", rule->tag ? rule->tag : Py_None,
+                             "hits", (unsigned PY_LONG_LONG)rule->hits);
+        if (!item || PyList_Append(list, item) < 0) {
+            Py_XDECREF(item);
+            Py_DECREF(list);
+            return NULL;
+        }
+        Py_DECREF(item);
+    }
+    return list;
+}
@@ -0,0 +1,390 @@
+/*
+ *
+ * PySilc - Python SILC Toolkit Bindings
+ *
+ * Copyright (c) 2006, Alastair Tse <alastair@liquidx.net>
+ * Copyright (c) 2007, Martynas Venckus <martynas@altroot.org>
+ * All rights reserved.
+ *
+ * This program is free software; you can redistributed it and/or modify
+ * it under the terms of the BSD License. See LICENSE in the distribution
+ * for details or http://www.liquidx.net/pysilc/.
+ *
+ */
+
+#include "pysilc.h"
+
+/*
+ * File transfer sessions. The file data is read, encrypted and written
+ * by the toolkit's SFTP session on the client scheduler, so any number
+ * of transfers run concurrently and no file data passes through Python.
+ * Python only sees progress, throttled per session.
+ */
+
+typedef struct _PySilcFtpSession
+{
+    PySilcClient *pyclient;      // borrowed, sessions die with the client
+    SilcUInt32 session_id;
+    SilcUInt32 interval_msec;    // report at most this often, 0 = always
+    SilcUInt64 step;             // or after this many bytes, 0 = never
+    SilcInt64 last_time;
+    SilcUInt64 last_offset;      // as last reported to Python
+    int last_status;
+    SilcUInt64 offset;           // as last seen from the toolkit
+    SilcUInt64 filesize;
+} PySilcFtpSession;
+
+static const char *_pysilc_ftp_errors[] = {
+    "Ok",
+    "File transfer error",
+    "Unknown file transfer session",
+    "File transfer already started",
+    "No such file",
+    "Permission denied",
+    "Key agreement failed",
+    "Connecting to remote client failed",
+    "File transfer timed out",
+    "Out of memory",
+};
+
+static void _pysilc_ftp_set_error(SilcClientFileError error)
+{
+    const char *msg = "File transfer error";
+
+    if (error < sizeof(_pysilc_ftp_errors) / sizeof(_pysilc_ftp_errors[0]))
+        msg = _pysilc_ftp_errors[error];
+    PyErr_SetString(PyExc_RuntimeError, msg);
+}
+
+// the key is the session id itself, only the session is allocated
+static void _pysilc_ftp_session_destructor(void *key, void *context,
+                                           void *user_context)
+{
+    silc_free(context);
+}
+
+static SilcHashTable _pysilc_ftp_sessions_alloc(void)
+{
+    return silc_hash_table_alloc(0, silc_hash_uint, NULL, NULL, NULL,
+                                 _pysilc_ftp_session_destructor, NULL, TRUE);
+}
+
+static PySilcFtpSession *_pysilc_ftp_session_new(PySilcClient *pyclient,
+                                                 double interval,
+                                                 unsigned PY_LONG_LONG step)
+{
+    PySilcFtpSession *session;
+
+    if (interval < 0) {
+        PyErr_SetString(PyExc_ValueError, "interval should not be negative");
+        return NULL;
+    }
+    if (!(session = silc_calloc(1, sizeof(*session)))) {
+        PyErr_NoMemory();
+        return NULL;
+    }
+    session->pyclient = pyclient;
+    session->interval_msec = (SilcUInt32)(interval * 1000);
+    session->step = step;
+    session->last_status = -1;
+    return session;
+}
+
+static int _pysilc_ftp_is_progress(SilcClientMonitorStatus status)
+{
+    return status == SILC_CLIENT_FILE_MONITOR_SEND ||
+           status == SILC_CLIENT_FILE_MONITOR_RECEIVE ||
+           status == SILC_CLIENT_FILE_MONITOR_GET;
+}
+
+/* Decides whether a monitor event goes to Python. State changes, the
+   first and the last chunk are always reported, progress in between
+   only once the interval or the step has passed. */
+static int _pysilc_ftp_should_report(PySilcFtpSession *session,
+                                     SilcClientMonitorStatus status,
+                                     SilcUInt64 offset, SilcUInt64 filesize)
+{
+    SilcInt64 now;
+
+    if (!_pysilc_ftp_is_progress(status) || status != session->last_status ||
+        offset >= filesize)
+        return 1;
+    if (!session->interval_msec && !session->step)
+        return 1;
+    if (session->step && offset - session->last_offset >= session->step)
+        return 1;
+
+    now = silc_time_msec();
+    if (session->interval_msec &&
+        now - session->last_time >= session->interval_msec)
+        return 1;
+    return 0;
+}
+
+static void _pysilc_ftp_monitor(SilcClient client, SilcClientConnection conn,
+                                SilcClientMonitorStatus status,
+                                SilcClientFileError error,
+                                SilcUInt64 offset, SilcUInt64 filesize,
+                                SilcClientEntry client_entry,
+                                SilcUInt32 session_id,
+                                const char *filepath, void *context)
+{
+    PySilcFtpSession *session = (PySilcFtpSession *)context;
+    PyObject *callback = NULL, *pyuser = NULL, *args = NULL, *result = NULL;
+
+    if (!session)
+        return;
+    _pysilc_stats_enter(session->pyclient);
+    session->offset = offset;
+    session->filesize = filesize;
+    if (!_pysilc_ftp_should_report(session, status, offset, filesize))
+        return;
+
+    session->last_time = silc_time_msec();
+    session->last_offset = offset;
+    session->last_status = status;
+
+    callback = PyObject_GetAttrString((PyObject *)session->pyclient,
+                                      "file_monitor");
+    if (!PyCallable_Check(callback))
+        goto cleanup;
+
+    if (client_entry) {
+        if (!(pyuser = PySilcUser_New(client_entry)))
+            goto cleanup;
+    }
+    else {
+        Py_INCREF(Py_None);
+        pyuser = Py_None;
+    }
+
+    if ((args = Py_BuildValue("(OIiiKKs)", pyuser, session_id, status, error,
+                              (unsigned PY_LONG_LONG)offset,
+                              (unsigned PY_LONG_LONG)filesize,
+                              filepath ? filepath : "")) == NULL)
+        goto cleanup;
+    if ((result = _pysilc_stats_call(session->pyclient,
+                                     PYSILC_STAT_FILE_MONITOR,
+                                     callback, args)) == 0)
+        PyErr_Print();
+
+cleanup:
+    if (PyErr_Occurred())
+        PyErr_Print();
+    Py_XDECREF(callback);
+    Py_XDECREF(pyuser);
+    Py_XDECREF(args);
+    Py_XDECREF(result);
+}
+
+static void _pysilc_ftp_ask_name(SilcClient client, SilcClientConnection conn,
+                                 SilcUInt32 session_id,
+                                 const char *remote_filename,
+                                 SilcClientFileName completion,
+                                 void *completion_context, void *context)
+{
+    PySilcFtpSession *session = (PySilcFtpSession *)context;
+    PyObject *callback = NULL, *args = NULL, *result = NULL;
+    const char *filepath = NULL;
+
+    _pysilc_stats_enter(session->pyclient);
+    callback = PyObject_GetAttrString((PyObject *)session->pyclient,
+                                      "file_ask_name");
+    if (PyCallable_Check(callback) &&
+        (args = Py_BuildValue("(Is)", session_id, remote_filename))) {
+        result = _pysilc_stats_call(session->pyclient,
+                                    PYSILC_STAT_FILE_ASK_NAME, callback, args);
+        if (!result)
+            PyErr_Print();
+        else if (PyString_Check(result))
+            filepath = PyString_AsString(result);
+    }
+    else
+        PyErr_Clear();
+
+    // NULL keeps the name the sender gave
+    completion(filepath, completion_context);
+
+    Py_XDECREF(callback);
+    Py_XDECREF(args);
+    Py_XDECREF(result);
+}
+
+/* Fills connection parameters when the local end should listen for the
+   remote client, otherwise the remote end provides the connection. */
+static SilcClientConnectionParams *
+_pysilc_ftp_params(SilcClientConnectionParams *params, char *hostname,
+                   unsigned int port)
+{
+    if (!hostname)
+        return NULL;
+    memset(params, 0, sizeof(*params));
+    params->local_ip = hostname;
+    params->local_port = port;
+    return params;
+}
+
+static PyObject *pysilc_client_file_send(PyObject *self, PyObject *args,
+                                         PyObject *kwds)
+{
+    PySilcClient *pyclient = (PySilcClient *)self;
+    PySilcUser *user;
+    PySilcFtpSession *session;
+    SilcClientConnectionParams params;
+    SilcClientFileError error;
+    char *filepath, *hostname = NULL;
+    unsigned int port = 0;
+    double interval = 1.0;
+    unsigned PY_LONG_LONG step = 0;
+    SilcUInt32 session_id;
+
+    static char *kwlist[] = {"user", "filepath", "hostname", "port",
+                             "interval", "step", NULL};
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "Os|zIdK", kwlist,
+                                     &user, &filepath, &hostname, &port,
+                                     &interval, &step))
+        return NULL;
+
+    if (!PyObject_TypeCheck(user, &PySilcUser_Type)) {
+        PyErr_SetString(PyExc_TypeError, "user should be a SilcUser");
+        return NULL;
+    }
+    if (!pyclient->silcobj || !pyclient->silcconn || !user->silcobj) {
+        PyErr_SetString(PyExc_RuntimeError, "SILC Client Not Connected");
+        return NULL;
+    }
+    if (!(session = _pysilc_ftp_session_new(pyclient, interval, step)))
+        return NULL;
+
+    error = silc_client_file_send(pyclient->silcobj, pyclient->silcconn,
+                                  user->silcobj,
+                                  _pysilc_ftp_params(&params, hostname, port),
+                                  pyclient->keys->public,
+                                  pyclient->keys->private,
+                                  _pysilc_ftp_monitor, session, filepath,
+                                  &session_id);
+    if (error != SILC_CLIENT_FILE_OK) {
+        silc_free(session);
+        _pysilc_ftp_set_error(error);
+        return NULL;
+    }
+
+    session->session_id = session_id;
+    silc_hash_table_add(pyclient->ftp_sessions, SILC_32_TO_PTR(session_id),
+                        session);
+    return PyInt_FromLong(session_id);
+}
+
+static PyObject *pysilc_client_file_receive(PyObject *self, PyObject *args,
+                                            PyObject *kwds)
+{
+    PySilcClient *pyclient = (PySilcClient *)self;
+    PySilcFtpSession *session;
+    SilcClientConnectionParams params;
+    SilcClientFileError error;
+    PyObject *ask_name;
+    char *path = NULL, *hostname = NULL;
+    unsigned int session_id, port = 0;
+    double interval = 1.0;
+    unsigned PY_LONG_LONG step = 0;
+
+    static char *kwlist[] = {"session_id", "path", "hostname", "port",
+                             "interval", "step", NULL};
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "I|zzIdK", kwlist,
+                                     &session_id, &path, &hostname, &port,
+                                     &interval, &step))
+        return NULL;
+
+    if (!pyclient->silcobj || !pyclient->silcconn) {
+        PyErr_SetString(PyExc_RuntimeError, "SILC Client Not Connected");
+        return NULL;
+    }
+    if (silc_hash_table_find(pyclient->ftp_sessions,
+                             SILC_32_TO_PTR(session_id), NULL, NULL)) {
+        _pysilc_ftp_set_error(SILC_CLIENT_FILE_ALREADY_STARTED);
+        return NULL;
+    }
+    if (!(session = _pysilc_ftp_session_new(pyclient, interval, step)))
+        return NULL;
+    session->session_id = session_id;
+
+    // only ask for a name when the application wants to choose one
+    ask_name = PyObject_GetAttrString(self, "file_ask_name");
+    if (!ask_name)
+        PyErr_Clear();
+
+    error = silc_client_file_receive(pyclient->silcobj, pyclient->silcconn,
+                                     _pysilc_ftp_params(&params, hostname,
+                                                        port),
+                                     pyclient->keys->public,
+                                     pyclient->keys->private,
+                                     _pysilc_ftp_monitor, session, path,
+                                     session_id,
+                                     PyCallable_Check(ask_name) ?
+                                     _pysilc_ftp_ask_name : NULL, session);
+    Py_XDECREF(ask_name);
+    if (error != SILC_CLIENT_FILE_OK) {
+        silc_free(session);
+        _pysilc_ftp_set_error(error);
+        return NULL;
+    }
+
+    silc_hash_table_add(pyclient->ftp_sessions, SILC_32_TO_PTR(session_id),
+                        session);
+    Py_RETURN_NONE;
+}
+
+static PyObject *pysilc_client_file_close(PyObject *self, PyObject *args)
+{
+    PySilcClient *pyclient = (PySilcClient *)self;
+    SilcClientFileError error;
+    unsigned int session_id;
+
+    if (!PyArg_ParseTuple(args, "I", &session_id))
+        return NULL;
+
+    if (!pyclient->silcobj || !pyclient->silcconn) {
+        PyErr_SetString(PyExc_RuntimeError, "SILC Client Not Connected");
+        return NULL;
+    }
+
+    // the toolkit reports CLOSED through the monitor before returning
+    error = silc_client_file_close(pyclient->silcobj, pyclient->silcconn,
+                                   session_id);
+    silc_hash_table_del(pyclient->ftp_sessions, SILC_32_TO_PTR(session_id));
+    if (error != SILC_CLIENT_FILE_OK) {
+        _pysilc_ftp_set_error(error);
+        return NULL;
+    }
+    Py_RETURN_NONE;
+}
+
+static PyObject *pysilc_client_file_sessions(PyObject *self)
+{
+    PySilcClient *pyclient = (PySilcClient *)self;
+    SilcHashTableList htl;
+    PySilcFtpSession *session;
+    PyObject *list, *item;
+    void *key;
+
+    if (!(list = PyList_New(0)))
+        return NULL;
+
+    silc_hash_table_list(pyclient->ftp_sessions, &htl);
+    while (silc_hash_table_get(&htl, &key, (void **)&session)) {
+        item = Py_BuildValue("(IiKK)", session->session_id,
+                             session->last_status,
+                             (unsigned PY_LONG_LONG)session->offset,
+                             (unsigned PY_LONG_LONG)session->filesize);
+        if (!item || PyList_Append(list, item) < 0) {
+            Py_XDECREF(item);
+            Py_CLEAR(list);
+            break;
+        }
+        Py_DECREF(item);
+    }
+    silc_hash_table_list_reset(&htl);
+    return list;
+}
@@ -0,0 +1,149 @@
+/*
+ *
+ * PySilc - Python SILC Toolkit Bindings
+ *
+ * Copyright (c) 2006, Alastair Tse <alastair@liquidx.net>
+ * Copyright (c) 2007, Martynas Venckus <martynas@altroot.org>
+ * All rights reserved.
+ *
+ * This program is free software; you can redistributed it and/or modify
+ * it under the terms of the BSD License. See LICENSE in the distribution
+ * for details or http://www.liquidx.net/pysilc/.
+ *
+ */
+
+#include "pysilc.h"
+
+static long _pysilc_id_hash(SilcIdType type, const unsigned char *data,
+                            SilcUInt32 len)
+{
+    // FNV-1a over the id type and the encoded id
+    unsigned long hash = 2166136261UL;
+    SilcUInt32 i;
+
+    hash = (hash ^ type) * 16777619UL;
+    for (i = 0; i < len; i++)
+        hash = (hash ^ data[i]) * 16777619UL;
+
+    if ((long)hash == -1)
+        return -2;
+    return (long)hash;
+}
+
+static PyObject *PySilcID_New(SilcIdType type, const unsigned char *data,
+                              SilcUInt32 len)
+{
+    if (len > PYSILC_ID_MAX_LEN) {
+        PyErr_SetString(PyExc_ValueError, "SILC ID too long");
+        return NULL;
+    }
+
+    PySilcID *pyid = (PySilcID *)PyObject_New(PySilcID, &PySilcID_Type);
+    if (!pyid)
+        return NULL;
+
+    pyid->type = type;
+    pyid->len = len;
+    memset(pyid->data, 0, PYSILC_ID_MAX_LEN);
+    memcpy(pyid->data, data, len);
+    pyid->hash = _pysilc_id_hash(type, data, len);
+    PYSILC_LIVE_INC(PYSILC_LIVE_ID);
+    return (PyObject *)pyid;
+}
+
+static PyObject *PySilcID_FromId(const void *id, SilcIdType type)
+{
+    unsigned char buf[PYSILC_ID_MAX_LEN];
+    SilcUInt32 len = 0;
+
+    if (!silc_id_id2str(id, type, buf, sizeof(buf), &len)) {
+        PyErr_SetString(PyExc_RuntimeError, "Unable to encode SILC ID");
+        return NULL;
+    }
+    return PySilcID_New(type, buf, len);
+}
+
+static PyObject *PySilcID_TypeNew(PyTypeObject *type, PyObject *args,
+                                  PyObject *kwds)
+{
+    unsigned short idtype;
+    unsigned char *data;
+    int len;
+    static char *kwlist[] = {"type", "data", NULL};
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "Hs#", kwlist,
+                                     &idtype, &data, &len))
+        return NULL;
+
+    return PySilcID_New(idtype, data, len);
+}
+
+static void PySilcID_Del(PyObject *object)
+{
+    PYSILC_LIVE_DEC(PYSILC_LIVE_ID);
+    PyObject_Del(object);
+}
+
+static long PySilcID_Hash(PyObject *self)
+{
+    return ((PySilcID *)self)->hash;
+}
+
+static PyObject *_pysilc_id_richcompare(PySilcID *a, PySilcID *b, int op)
+{
+    int result, cmp;
+
+    // equal ids have equal hashes, so most inequalities end here
+    if (a->hash != b->hash && (op == Py_EQ || op == Py_NE)) {
+        result = (op == Py_NE);
+        return PyBool_FromLong(result);
+    }
+
+    if (a->type != b->type)
+        cmp = a->type < b->type ? -1 : 1;
+    else if (a->len != b->len)
+        cmp = a->len < b->len ? -1 : 1;
+    else
+        cmp = memcmp(a->data, b->data, a->len);
+
+    switch (op) {
+    case Py_LT: result = cmp <  0; break;
+    case Py_LE: result = cmp <= 0; break;
+    case Py_EQ: result = cmp == 0; break;
+    case Py_NE: result = cmp != 0; break;
+    case Py_GT: result = cmp >  0; break;
+    case Py_GE: result = cmp >= 0; break;
+    default:
+        Py_INCREF(Py_NotImplemented);
+        return Py_NotImplemented;
+    }
+    return PyBool_FromLong(result);
+}
+
+static PyObject *PySilcID_RichCompare(PyObject *self, PyObject *other, int op)
+{
+    if (!PyObject_TypeCheck(other, &PySilcID_Type)) {
+        Py_INCREF(Py_NotImplemented);
+        return Py_NotImplemented;
+    }
+    return _pysilc_id_richcompare((PySilcID *)self, (PySilcID *)other, op);
+}
+
+static PyObject *PySilcID_Str(PyObject *self)
+{
+    PySilcID *pyid = (PySilcID *)self;
+    return PyString_FromStringAndSize((char *)pyid->data, pyid->len);
+}
+
+static PyObject *PySilcID_Repr(PyObject *self)
+{
+    PySilcID *pyid = (PySilcID *)self;
+    char hex[PYSILC_ID_MAX_LEN * 2 + 1];
+    SilcUInt32 i;
+
+    for (i = 0; i < pyid->len; i++)
+        sprintf(hex + i * 2, "%02x", pyid->data[i]);
+    hex[pyid->len * 2] = '\0';
+
+    return PyString_FromFormat("<SilcID type %d %s>", pyid->type, hex);
+}
@@ -0,0 +1,228 @@
+/*
+ *
+ * PySilc - Python SILC Toolkit Bindings
+ *
+ * Copyright (c) 2006, Alastair Tse <alastair@liquidx.net>
+ * Copyright (c) 2007, Martynas Venckus <martynas@altroot.org>
+ * All rights reserved.
+ *
+ * This program is free software; you can redistributed it and/or modify
+ * it under the terms of the BSD License. See LICENSE in the distribution
+ * for details or http://www.liquidx.net/pysilc/.
+ *
+ */
+
+#include "pysilc.h"
+
+/*
+ * IRC translation for IRC bridges such as the supybot driver. Parsed IRC
+ * messages are sent as SILC messages and commands directly, looking
+ * channels and users up in the toolkit cache and giving commands as
+ * argument lists, so no command line is formatted or parsed again.
+ *
+ * IRC channel names carry one extra leading '#': "#talk" is the SILC
+ * channel "talk" and "##chat" is "#chat".
+ */
+
+#define PYSILC_IRC_MAX_TARGETS 16
+
+static const char *_pysilc_irc_channel_name(const char *target)
+{
+    return target[0] == '#' ? target + 1 : NULL;
+}
+
+static int _pysilc_irc_privmsg(PySilcClient *pyclient, const char *target,
+                               const char *text, int text_len)
+{
+    SilcClient client = pyclient->silcobj;
+    SilcClientConnection conn = pyclient->silcconn;
+    SilcChannelEntry channel;
+    SilcClientEntry user;
+    SilcDList users;
+    const char *name;
+    int sent;
+
+    // anything else goes through the Python fallback, which replaces it
+    if (!silc_utf8_valid((const unsigned char *)text, text_len))
+        return 0;
+
+    if ((name = _pysilc_irc_channel_name(target)) != NULL) {
+        if (!(channel = silc_client_get_channel(client, conn, (char *)name)))
+            return 0;
+        sent = silc_client_send_channel_message(client, conn, channel, NULL,
+                                                SILC_MESSAGE_FLAG_UTF8,
+                                                pyclient->sign_hash,
+                                                (unsigned char *)text,
+                                                text_len);
+        silc_client_unref_channel(client, conn, channel);
+        return sent ? 1 : 0;
+    }
+
+    // nicknames need not be unique, the first match gets it like /MSG
+    users = silc_client_get_clients_local(client, conn, target, FALSE);
+    if (!users)
+        return 0;
+    silc_dlist_start(users);
+    user = silc_dlist_get(users);
+    sent = user != SILC_LIST_END &&
+           silc_client_send_private_message(client, conn, user,
+                                            SILC_MESSAGE_FLAG_UTF8,
+                                            pyclient->sign_hash,
+                                            (unsigned char *)text, text_len);
+    silc_client_list_free(client, conn, users);
+    return sent ? 1 : 0;
+}
+
+/* Splits "#a,#b" into SILC channel names in place. Returns the count,
+   or -1 if a target is not a channel. */
+static int _pysilc_irc_channels(char *targets, char **names)
+{
+    char *tok, *save = NULL;
+    int count = 0;
+
+    for (tok = strtok_r(targets, ",", &save); tok;
+         tok = strtok_r(NULL, ",", &save)) {
+        if (count == PYSILC_IRC_MAX_TARGETS ||
+            !(names[count] = (char *)_pysilc_irc_channel_name(tok)))
+            return -1;
+        count++;
+    }
+    return count;
+}
+
+static int _pysilc_irc_command(PySilcClient *pyclient, const char *command,
+                               char **argv, int argc)
+{
+    SilcClient client = pyclient->silcobj;
+    SilcClientConnection conn = pyclient->silcconn;
+    char *targets, *names[PYSILC_IRC_MAX_TARGETS], *keys, *key, *save = NULL;
+    SilcChannelEntry channel;
+    int count, i, joined;
+
+    if (!strcmp(command, "NICK")) {
+        if (argc < 1)
+            return 0;
+        return silc_client_command_call(client, conn, NULL, "NICK", argv[0],
+                                        NULL) != 0;
+    }
+
+    if (argc < 1 || !(targets = strdup(argv[0])))
+        return 0;
+    if ((count = _pysilc_irc_channels(targets, names)) <= 0) {
+        free(targets);
+        return 0;
+    }
+
+    if (!strcmp(command, "JOIN")) {
+        // JOIN #a,#b keya,keyb
+        keys = argc > 1 ? strdup(argv[1]) : NULL;
+        key = keys ? strtok_r(keys, ",", &save) : NULL;
+        for (i = 0; i < count; i++) {
+            // already on it, e.g. after resuming a detached session
+            channel = silc_client_get_channel(client, conn, names[i]);
+            joined = channel && silc_client_on_channel(channel,
+                                                       conn->local_entry);
+            if (channel)
+                silc_client_unref_channel(client, conn, channel);
+            _pysilc_reconnect_joining(pyclient, names[i], key);
+            if (!joined)
+                silc_client_command_call(client, conn, NULL, "JOIN", names[i],
+                                         key, NULL);
+            key = key ? strtok_r(NULL, ",", &save) : NULL;
+        }
+        free(keys);
+    }
+    else if (!strcmp(command, "PART")) {
+        for (i = 0; i < count; i++)
+            silc_client_command_call(client, conn, NULL, "LEAVE", names[i],
+                                     NULL);
+    }
+    else if (!strcmp(command, "TOPIC")) {
+        silc_client_command_call(client, conn, NULL, "TOPIC", names[0],
+                                 argc > 1 ? argv[1] : NULL, NULL);
+    }
+    else if (!strcmp(command, "NAMES") || !strcmp(command, "WHO")) {
+        for (i = 0; i < count; i++)
+            silc_client_command_call(client, conn, NULL, "USERS", names[i],
+                                     NULL);
+    }
+    else
+        count = 0;
+
+    free(targets);
+    return count > 0;
+}
+
+static PyObject *pysilc_client_irc_send(PyObject *self, PyObject *args)
+{
+    PySilcClient *pyclient = (PySilcClient *)self;
+    char *command, *argv[3];
+    PyObject *ircargs, *item;
+    Py_ssize_t argc, i;
+    int handled, text_len = 0;
+
+    if (!PyArg_ParseTuple(args, "sO", &command, &ircargs))
+        return NULL;
+    if (!pyclient->silcobj || !pyclient->silcconn) {
+        PyErr_SetString(PyExc_RuntimeError, "SILC Client Not Connected");
+        return NULL;
+    }
+    if (!(ircargs = PySequence_Fast(ircargs, "args should be a sequence")))
+        return NULL;
+
+    // only plain strings; unicode and longer argument lists fall back
+    argc = PySequence_Fast_GET_SIZE(ircargs);
+    for (i = 0; i < argc && i < 3; i++) {
+        item = PySequence_Fast_GET_ITEM(ircargs, i);
+        if (!PyString_Check(item)) {
+            Py_DECREF(ircargs);
+            Py_RETURN_FALSE;
+        }
+        argv[i] = PyString_AS_STRING(item);
+        if (i == 1)
+            text_len = PyString_GET_SIZE(item);
+    }
+
+    if (!strcmp(command, "PRIVMSG"))
+        handled = argc == 2 &&
+                  _pysilc_irc_privmsg(pyclient, argv[0], argv[1], text_len);
+    else if (argc <= 2)
+        handled = _pysilc_irc_command(pyclient, command, argv, argc);
+    else
+        handled = 0;
+
+    Py_DECREF(ircargs);
+    return PyBool_FromLong(handled);
+}
+
+static PyObject *pysilc_irc_prefix(PyObject *mod, PyObject *args,
+                                   PyObject *kwds)
+{
+    PySilcUser *user;
+    char *ident = "";
+    static char *kwlist[] = {"user", "ident", NULL};
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "O!|s", kwlist,
+                                     &PySilcUser_Type, &user, &ident))
+        return NULL;
+    if (!user->silcobj) {
+        PyErr_SetString(PyExc_RuntimeError, "SilcUser has no entry");
+        return NULL;
+    }
+    return PyString_FromFormat("%s!%s%s@%s", user->silcobj->nickname, ident,
+                               user->silcobj->username,
+                               user->silcobj->hostname);
+}
+
+static PyObject *pysilc_irc_channel(PyObject *mod, PyObject *args)
+{
+    PySilcChannel *channel;
+
+    if (!PyArg_ParseTuple(args, "O!", &PySilcChannel_Type, &channel))
+        return NULL;
+    if (!channel->silcobj || !channel->silcobj->channel_name) {
+        PyErr_SetString(PyExc_RuntimeError, "SilcChannel has no entry");
+        return NULL;
+    }
+    return PyString_FromFormat("#%s", channel->silcobj->channel_name);
+}
@@ -0,0 +1,230 @@
+/*
+ *
+ * PySilc - Python SILC Toolkit Bindings
+ *
+ * Copyright (c) 2006, Alastair Tse <alastair@liquidx.net>
+ * Copyright (c) 2007, Martynas Venckus <martynas@altroot.org>
+ * All rights reserved.
+ *
+ * This program is free software; you can redistributed it and/or modify
+ * it under the terms of the BSD License. See LICENSE in the distribution
+ * for details or http://www.liquidx.net/pysilc/.
+ *
+ */
+
+#include "pysilc.h"
+
+/*
+ * Adaptive keepalive, used instead of the toolkit heartbeat when
+ * connect_to_server() is given adaptive_keepalive. Nothing is sent while
+ * the server is sending anything; once the connection has been idle for
+ * the current interval the server is PINGed. Each answered PING makes
+ * the interval longer, up to the configured maximum, so a quiet
+ * connection settles on about the longest idle time its NAT bindings
+ * survive. An unanswered PING, after a timeout derived from the measured
+ * round trip time, closes the connection and brings the interval back to
+ * the longest one that worked.
+ */
+
+#define PYSILC_KEEPALIVE_MIN_SECS     15
+#define PYSILC_KEEPALIVE_MIN_TIMEOUT  5000000000ULL    // ns
+#define PYSILC_KEEPALIVE_MAX_TIMEOUT  60000000000ULL
+
+typedef struct _PySilcKeepalive {
+    SilcUInt32 max_secs;
+    SilcUInt32 interval;            // idle seconds before a PING
+    SilcUInt32 good;                // longest interval that was answered
+    SilcUInt32 ceiling;             // shortest interval that was not
+    SilcUInt64 last_active;         // last traffic from the server, ns
+    SilcUInt64 ping_sent;           // outstanding PING, 0 when none
+    SilcUInt64 srtt, rttvar;        // smoothed round trip time, ns
+    SilcUInt64 pings, timeouts;
+} PySilcKeepalive;
+
+static SILC_TASK_CALLBACK(_pysilc_keepalive_task);
+
+static void _pysilc_keepalive_schedule(PySilcClient *pyclient, SilcUInt64 ns)
+{
+    silc_schedule_task_del_by_all(pyclient->silcobj->schedule, 0,
+                                  _pysilc_keepalive_task, pyclient);
+    silc_schedule_task_add_timeout(pyclient->silcobj->schedule,
+                                   _pysilc_keepalive_task, pyclient,
+                                   ns / 1000000000ULL,
+                                   (ns % 1000000000ULL) / 1000);
+}
+
+static void _pysilc_keepalive_free(PySilcClient *pyclient)
+{
+    if (!pyclient->keepalive)
+        return;
+    if (pyclient->silcobj)
+        silc_schedule_task_del_by_all(pyclient->silcobj->schedule, 0,
+                                      _pysilc_keepalive_task, pyclient);
+    free(pyclient->keepalive);
+    pyclient->keepalive = NULL;
+}
+
+/* Turns adaptive keepalive on for the next connections, or off with 0.
+   What was learned is kept while the maximum stays the same. */
+static int _pysilc_keepalive_configure(PySilcClient *pyclient,
+                                       SilcUInt32 max_secs)
+{
+    PySilcKeepalive *ka = pyclient->keepalive;
+
+    if (!max_secs) {
+        _pysilc_keepalive_free(pyclient);
+        return 0;
+    }
+    if (ka && ka->max_secs == max_secs)
+        return 0;
+    _pysilc_keepalive_free(pyclient);
+    if (!(ka = calloc(1, sizeof(*ka))))
+        return -1;
+    ka->max_secs = max_secs;
+    ka->interval = max_secs < PYSILC_KEEPALIVE_MIN_SECS ?
+                   max_secs : PYSILC_KEEPALIVE_MIN_SECS;
+    pyclient->keepalive = ka;
+    return 0;
+}
+
+// called on entry of every toolkit callback
+static void _pysilc_keepalive_active(PySilcClient *pyclient)
+{
+    if (pyclient->keepalive)
+        pyclient->keepalive->last_active = _pysilc_stats_now();
+}
+
+static SilcUInt64 _pysilc_keepalive_timeout(PySilcKeepalive *ka)
+{
+    SilcUInt64 timeout = 4 * (ka->srtt + 4 * ka->rttvar);
+
+    if (timeout < PYSILC_KEEPALIVE_MIN_TIMEOUT)
+        return PYSILC_KEEPALIVE_MIN_TIMEOUT;
+    if (timeout > PYSILC_KEEPALIVE_MAX_TIMEOUT)
+        return PYSILC_KEEPALIVE_MAX_TIMEOUT;
+    return timeout;
+}
+
+static void _pysilc_keepalive_start(PySilcClient *pyclient)
+{
+    PySilcKeepalive *ka = pyclient->keepalive;
+
+    if (!ka)
+        return;
+    ka->last_active = _pysilc_stats_now();
+    ka->ping_sent = 0;
+    _pysilc_keepalive_schedule(pyclient, ka->interval * 1000000000ULL);
+}
+
+static void _pysilc_keepalive_stop(PySilcClient *pyclient)
+{
+    if (pyclient->keepalive && pyclient->silcobj)
+        silc_schedule_task_del_by_all(pyclient->silcobj->schedule, 0,
+                                      _pysilc_keepalive_task, pyclient);
+}
+
+/* A PING reply, ours or the application's; errors count too. */
+static void _pysilc_keepalive_pong(PySilcClient *pyclient)
+{
+    PySilcKeepalive *ka = pyclient->keepalive;
+    SilcUInt64 rtt;
+    SilcUInt32 next;
+
+    if (!ka || !ka->ping_sent)
+        return;
+
+    // RFC 6298 smoothing
+    rtt = _pysilc_stats_now() - ka->ping_sent;
+    if (!ka->srtt) {
+        ka->srtt = rtt;
+        ka->rttvar = rtt / 2;
+    }
+    else {
+        ka->rttvar = (3 * ka->rttvar +
+                      (rtt > ka->srtt ? rtt - ka->srtt : ka->srtt - rtt)) / 4;
+        ka->srtt = (7 * ka->srtt + rtt) / 8;
+    }
+    ka->ping_sent = 0;
+
+    // the binding survived this long, try half as long again next time
+    if (ka->interval > ka->good)
+        ka->good = ka->interval;
+    next = ka->interval + ka->interval / 2;
+    if (ka->ceiling && next >= ka->ceiling)
+        next = ka->ceiling - 1;
+    if (next > ka->max_secs)
+        next = ka->max_secs;
+    if (next > ka->interval)
+        ka->interval = next;
+
+    if (pyclient->silcconn)
+        _pysilc_keepalive_schedule(pyclient, ka->interval * 1000000000ULL);
+}
+
+static SILC_TASK_CALLBACK(_pysilc_keepalive_task)
+{
+    PySilcClient *pyclient = (PySilcClient *)context;
+    PySilcKeepalive *ka = pyclient->keepalive;
+    SilcClientConnection conn = pyclient->silcconn;
+    SilcUInt64 now, idle, interval, timeout;
+
+    if (!ka || !conn)
+        return;
+    now = _pysilc_stats_now();
+
+    // replies wait unread while the event queue holds reading back
+    if (pyclient->inbound_blocked) {
+        ka->ping_sent = 0;
+        ka->last_active = now;
+        _pysilc_keepalive_schedule(pyclient, ka->interval * 1000000000ULL);
+        return;
+    }
+
+    if (ka->ping_sent) {
+        timeout = _pysilc_keepalive_timeout(ka);
+        if (now - ka->ping_sent < timeout) {
+            _pysilc_keepalive_schedule(pyclient,
+                                       timeout - (now - ka->ping_sent));
+            return;
+        }
+        // gone; the disconnected callback and any reconnect follow
+        ka->timeouts++;
+        ka->ping_sent = 0;
+        if (!ka->ceiling || ka->interval < ka->ceiling)
+            ka->ceiling = ka->interval;
+        ka->interval = ka->good ? ka->good :
+                       ka->interval / 2 ? ka->interval / 2 : 1;
+        silc_client_close_connection(pyclient->silcobj, conn);
+        return;
+    }
+
+    idle = now - ka->last_active;
+    interval = ka->interval * 1000000000ULL;
+    if (idle < interval) {
+        _pysilc_keepalive_schedule(pyclient, interval - idle);
+        return;
+    }
+
+    ka->pings++;
+    ka->ping_sent = now;
+    silc_client_command_call(pyclient->silcobj, conn, NULL, "PING", NULL);
+    _pysilc_keepalive_schedule(pyclient, _pysilc_keepalive_timeout(ka));
+}
+
+static PyObject *pysilc_client_keepalive_info(PyObject *self)
+{
+    PySilcClient *pyclient = (PySilcClient *)self;
+    PySilcKeepalive *ka = pyclient->keepalive;
+
+    if (!ka)
+        Py_RETURN_NONE;
+    return Py_BuildValue("{s:I,s:I,s:I,s:I,s:d,s:d,s:K,s:K}",
+                         "interval", ka->interval,
+                         "max_interval", ka->max_secs,
+                         "longest_answered", ka->good,
+                         "shortest_failed", ka->ceiling,
+                         "rtt", ka->srtt / 1e9,
+                         "rtt_var", ka->rttvar / 1e9,
+                         "pings", (unsigned PY_LONG_LONG)ka->pings,
+                         "timeouts", (unsigned PY_LONG_LONG)ka->timeouts);
+}
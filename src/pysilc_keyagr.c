@@ -0,0 +1,302 @@
+/*
+ *
+ * PySilc - Python SILC Toolkit Bindings
+ *
+ * Copyright (c) 2006, Alastair Tse <alastair@liquidx.net>
+ * Copyright (c) 2007, Martynas Venckus <martynas@altroot.org>
+ * All rights reserved.
+ *
+ * This program is free software; you can redistributed it and/or modify
+ * it under the terms of the BSD License. See LICENSE in the distribution
+ * for details or http://www.liquidx.net/pysilc/.
+ *
+ */
+
+#include "pysilc.h"
+
+/*
+ * Private message key agreement. The key exchange itself runs as a
+ * toolkit SKE session on the client scheduler; here agreements are
+ * queued so that at most max_key_agreements exchanges are in progress,
+ * and a burst of new peers is spread over several scheduler rounds
+ * instead of starting all the Diffie-Hellman work at once.
+ */
+
+#define PYSILC_KEY_AGREEMENT_MAX 4
+
+typedef struct _PySilcKeyAgreement
+{
+    PySilcClient *pyclient;
+    SilcClientEntry client_entry;   // referenced while queued or running
+    char *hostname;                 // remote end for perform, local for send
+    int port;
+    int perform;
+    SilcUInt32 timeout;
+} PySilcKeyAgreement;
+
+static void _pysilc_keyagr_free(PySilcKeyAgreement *ka)
+{
+    PySilcClient *pyclient = ka->pyclient;
+
+    if (pyclient->silcobj) {
+        silc_client_unref_client(pyclient->silcobj, pyclient->silcconn,
+                                 ka->client_entry);
+        PYSILC_LIVE_DEC(PYSILC_LIVE_CLIENT_ENTRY_REF);
+    }
+    silc_free(ka->hostname);
+    silc_free(ka);
+}
+
+static void _pysilc_keyagr_report(PySilcClient *pyclient,
+                                  SilcClientEntry client_entry,
+                                  SilcKeyAgreementStatus status)
+{
+    PyObject *callback = NULL, *pyuser = NULL, *args = NULL, *result = NULL;
+
+    _pysilc_stats_enter(pyclient);
+    callback = PyObject_GetAttrString((PyObject *)pyclient,
+                                      "key_agreement_completed");
+    if (!PyCallable_Check(callback))
+        goto cleanup;
+
+    if ((pyuser = PySilcUser_New(client_entry)) == NULL)
+        goto cleanup;
+    if ((args = Py_BuildValue("(Oi)", pyuser, status)) == NULL)
+        goto cleanup;
+    if ((result = _pysilc_stats_call(pyclient,
+                                     PYSILC_STAT_KEY_AGREEMENT_COMPLETED,
+                                     callback, args)) == 0)
+        PyErr_Print();
+
+cleanup:
+    Py_XDECREF(callback);
+    Py_XDECREF(pyuser);
+    Py_XDECREF(args);
+    Py_XDECREF(result);
+}
+
+static SILC_TASK_CALLBACK(_pysilc_keyagr_pump_task);
+
+static void _pysilc_keyagr_completion(SilcClient client,
+                                      SilcClientConnection conn,
+                                      SilcClientEntry client_entry,
+                                      SilcKeyAgreementStatus status,
+                                      SilcSKEKeyMaterial key, void *context)
+{
+    PySilcKeyAgreement *ka = (PySilcKeyAgreement *)context;
+    PySilcClient *pyclient = ka->pyclient;
+
+    // default cipher and HMAC, as the toolkit negotiated them
+    if (status == SILC_KEY_AGREEMENT_OK &&
+        !silc_client_add_private_message_key_ske(client, conn, client_entry,
+                                                 NULL, NULL, key))
+        status = SILC_KEY_AGREEMENT_ERROR;
+
+    _pysilc_keyagr_report(pyclient, client_entry, status);
+
+    pyclient->key_agreements_active--;
+    _pysilc_keyagr_free(ka);
+
+    // start the next one once the SKE has unwound
+    if (silc_dlist_count(pyclient->key_agreements))
+        silc_schedule_task_add_timeout(client->schedule,
+                                       _pysilc_keyagr_pump_task, pyclient,
+                                       0, 0);
+}
+
+static void _pysilc_keyagr_start(PySilcKeyAgreement *ka)
+{
+    PySilcClient *pyclient = ka->pyclient;
+    SilcClientConnectionParams params;
+
+    memset(&params, 0, sizeof(params));
+    params.timeout_secs = ka->timeout;
+
+    pyclient->key_agreements_active++;
+    if (ka->perform) {
+        silc_client_perform_key_agreement(pyclient->silcobj,
+                                          pyclient->silcconn,
+                                          ka->client_entry, &params,
+                                          pyclient->keys->public,
+                                          pyclient->keys->private,
+                                          ka->hostname, ka->port,
+                                          _pysilc_keyagr_completion, ka);
+    }
+    else {
+        params.local_ip = ka->hostname;
+        params.local_port = ka->port;
+        silc_client_send_key_agreement(pyclient->silcobj, pyclient->silcconn,
+                                       ka->client_entry, &params,
+                                       pyclient->keys->public,
+                                       pyclient->keys->private,
+                                       _pysilc_keyagr_completion, ka);
+    }
+}
+
+static void _pysilc_keyagr_pump(PySilcClient *pyclient)
+{
+    PySilcKeyAgreement *ka;
+    int max = pyclient->max_key_agreements;
+
+    if (max <= 0)
+        max = 1;
+    while (pyclient->key_agreements_active < max &&
+           silc_dlist_count(pyclient->key_agreements)) {
+        silc_dlist_start(pyclient->key_agreements);
+        ka = silc_dlist_get(pyclient->key_agreements);
+        silc_dlist_del(pyclient->key_agreements, ka);
+        _pysilc_keyagr_start(ka);
+    }
+}
+
+static SILC_TASK_CALLBACK(_pysilc_keyagr_pump_task)
+{
+    PySilcClient *pyclient = (PySilcClient *)context;
+
+    if (pyclient->silcconn)
+        _pysilc_keyagr_pump(pyclient);
+}
+
+static int _pysilc_keyagr_queue(PySilcClient *pyclient,
+                                SilcClientEntry client_entry,
+                                const char *hostname, int port, int perform,
+                                unsigned int timeout)
+{
+    PySilcKeyAgreement *ka;
+
+    if (!(ka = silc_calloc(1, sizeof(*ka))))
+        return -1;
+    if (hostname && !(ka->hostname = strdup(hostname))) {
+        silc_free(ka);
+        return -1;
+    }
+    ka->pyclient = pyclient;
+    ka->client_entry = silc_client_ref_client(pyclient->silcobj,
+                                              pyclient->silcconn,
+                                              client_entry);
+    PYSILC_LIVE_INC(PYSILC_LIVE_CLIENT_ENTRY_REF);
+    ka->port = port;
+    ka->perform = perform;
+    ka->timeout = timeout;
+
+    silc_dlist_add(pyclient->key_agreements, ka);
+    _pysilc_keyagr_pump(pyclient);
+    return 0;
+}
+
+static void _pysilc_keyagr_clear(PySilcClient *pyclient)
+{
+    PySilcKeyAgreement *ka;
+
+    if (!pyclient->key_agreements)
+        return;
+    silc_dlist_start(pyclient->key_agreements);
+    while ((ka = silc_dlist_get(pyclient->key_agreements)) != SILC_LIST_END)
+        _pysilc_keyagr_free(ka);
+    silc_dlist_uninit(pyclient->key_agreements);
+    pyclient->key_agreements = NULL;
+}
+
+static PyObject *_pysilc_keyagr_request(PyObject *self, PySilcUser *user,
+                                        const char *hostname, int port,
+                                        int perform, unsigned int timeout)
+{
+    PySilcClient *pyclient = (PySilcClient *)self;
+
+    if (!PyObject_TypeCheck(user, &PySilcUser_Type)) {
+        PyErr_SetString(PyExc_TypeError, "user should be a SilcUser");
+        return NULL;
+    }
+    if (!pyclient->silcobj || !pyclient->silcconn || !user->silcobj) {
+        PyErr_SetString(PyExc_RuntimeError, "SILC Client Not Connected");
+        return NULL;
+    }
+    if (_pysilc_keyagr_queue(pyclient, user->silcobj, hostname, port,
+                             perform, timeout) < 0)
+        return PyErr_NoMemory();
+    Py_RETURN_NONE;
+}
+
+static PyObject *pysilc_client_send_key_agreement(PyObject *self,
+                                                  PyObject *args,
+                                                  PyObject *kwds)
+{
+    PySilcUser *user;
+    char *hostname = NULL;
+    unsigned int port = 0, timeout = 0;
+    static char *kwlist[] = {"user", "hostname", "port", "timeout", NULL};
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "O|zII", kwlist,
+                                     &user, &hostname, &port, &timeout))
+        return NULL;
+    return _pysilc_keyagr_request(self, user, hostname, port, 0, timeout);
+}
+
+static PyObject *pysilc_client_perform_key_agreement(PyObject *self,
+                                                     PyObject *args,
+                                                     PyObject *kwds)
+{
+    PySilcUser *user;
+    char *hostname;
+    unsigned int port, timeout = 0;
+    static char *kwlist[] = {"user", "hostname", "port", "timeout", NULL};
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "OsI|I", kwlist,
+                                     &user, &hostname, &port, &timeout))
+        return NULL;
+    return _pysilc_keyagr_request(self, user, hostname, port, 1, timeout);
+}
+
+static PyObject *pysilc_client_abort_key_agreement(PyObject *self,
+                                                   PyObject *args)
+{
+    PySilcClient *pyclient = (PySilcClient *)self;
+    PySilcKeyAgreement *ka;
+    PySilcUser *user;
+    SilcDList queued;
+
+    if (!PyArg_ParseTuple(args, "O!", &PySilcUser_Type, &user))
+        return NULL;
+    if (!pyclient->silcobj || !pyclient->silcconn || !user->silcobj) {
+        PyErr_SetString(PyExc_RuntimeError, "SILC Client Not Connected");
+        return NULL;
+    }
+
+    // drop queued requests first, as they have no SKE to abort
+    if (!(queued = silc_dlist_init()))
+        return PyErr_NoMemory();
+    silc_dlist_start(pyclient->key_agreements);
+    while ((ka = silc_dlist_get(pyclient->key_agreements)) != SILC_LIST_END)
+        if (ka->client_entry == user->silcobj)
+            silc_dlist_add(queued, ka);
+    silc_dlist_start(queued);
+    while ((ka = silc_dlist_get(queued)) != SILC_LIST_END) {
+        silc_dlist_del(pyclient->key_agreements, ka);
+        _pysilc_keyagr_report(pyclient, ka->client_entry,
+                              SILC_KEY_AGREEMENT_ABORTED);
+        _pysilc_keyagr_free(ka);
+    }
+    silc_dlist_uninit(queued);
+
+    silc_client_abort_key_agreement(pyclient->silcobj, pyclient->silcconn,
+                                    user->silcobj);
+    Py_RETURN_NONE;
+}
+
+static PyObject *pysilc_client_del_private_message_key(PyObject *self,
+                                                       PyObject *args)
+{
+    PySilcClient *pyclient = (PySilcClient *)self;
+    PySilcUser *user;
+
+    if (!PyArg_ParseTuple(args, "O!", &PySilcUser_Type, &user))
+        return NULL;
+    if (!pyclient->silcobj || !pyclient->silcconn || !user->silcobj) {
+        PyErr_SetString(PyExc_RuntimeError, "SILC Client Not Connected");
+        return NULL;
+    }
+    return PyBool_FromLong(
+        silc_client_del_private_message_key(pyclient->silcobj,
+                                            pyclient->silcconn,
+                                            user->silcobj));
+}
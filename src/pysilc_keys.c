@@ -0,0 +1,391 @@
+/*
+ *
+ * PySilc - Python SILC Toolkit Bindings
+ *
+ * Copyright (c) 2006, Alastair Tse <alastair@liquidx.net>
+ * Copyright (c) 2007, Martynas Venckus <martynas@altroot.org>
+ * All rights reserved.
+ *
+ * This program is free software; you can redistributed it and/or modify
+ * it under the terms of the BSD License. See LICENSE in the distribution
+ * for details or http://www.liquidx.net/pysilc/.
+ *
+ */
+
+#include "pysilc.h"
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static int _pysilc_parse_passphrase(PyObject *passphrase_obj, char **passphrase)
+{
+    if (passphrase_obj == Py_None) {
+        *passphrase = NULL;
+    }
+    else if (PyString_Check(passphrase_obj)) {
+        *passphrase = PyString_AsString(passphrase_obj);
+    }
+    else {
+        PyErr_SetString(PyExc_TypeError, "passphrase should either be None or String Type");
+        return -1;
+    }
+    return 0;
+}
+
+static char *_pysilc_strdup(const char *str)
+{
+    return str ? strdup(str) : NULL;
+}
+
+/* ---------------- asynchronous key jobs ------------- */
+
+typedef struct _PySilcKeys_Job
+{
+    int create;                 // create a new pair, otherwise load it
+    char *pkcs_name;
+    char *pub_filename;
+    char *prv_filename;
+    char *pub_identifier;
+    char *passphrase;
+    SilcUInt32 key_length;
+    PyObject *callback;
+} PySilcKeys_Job;
+
+static void _pysilc_keys_job_free(PySilcKeys_Job *job)
+{
+    free(job->pkcs_name);
+    free(job->pub_filename);
+    free(job->prv_filename);
+    free(job->pub_identifier);
+    if (job->passphrase) {
+        memset(job->passphrase, 0, strlen(job->passphrase));
+        free(job->passphrase);
+    }
+    free(job);
+}
+
+static void *_pysilc_keys_job_run(void *context)
+{
+    PySilcKeys_Job *job = (PySilcKeys_Job *)context;
+    PyObject *keys = NULL, *args = NULL, *result = NULL;
+    PyGILState_STATE gstate;
+    SilcPublicKey public_key;
+    SilcPrivateKey private_key;
+    SilcBool success;
+
+    // runs without the GIL, key generation may take seconds
+    if (job->create)
+        success = silc_create_key_pair(job->pkcs_name, job->key_length,
+                                       job->pub_filename, job->prv_filename,
+                                       job->pub_identifier, job->passphrase,
+                                       &public_key, &private_key, FALSE);
+    else
+        success = silc_load_key_pair(job->pub_filename, job->prv_filename,
+                                     job->passphrase, &public_key,
+                                     &private_key);
+
+    gstate = PyGILState_Ensure();
+
+    if (success && (keys = PySilcKeys_New(public_key, private_key)))
+        args = Py_BuildValue("(OO)", keys, Py_None);
+    else
+        args = Py_BuildValue("(Os)", Py_None, job->create ?
+                             "Unable to generate keys." :
+                             "Unable to load keys.");
+    if (args && (result = PyObject_CallObject(job->callback, args)) == 0)
+        PyErr_Print();
+
+    Py_XDECREF(keys);
+    Py_XDECREF(args);
+    Py_XDECREF(result);
+    Py_DECREF(job->callback);
+    PyGILState_Release(gstate);
+
+    _pysilc_keys_job_free(job);
+    return NULL;
+}
+
+static PyObject *_pysilc_keys_job_start(PySilcKeys_Job *job)
+{
+    pthread_t thread;
+    pthread_attr_t attr;
+    int error;
+
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    Py_INCREF(job->callback);
+    error = pthread_create(&thread, &attr, _pysilc_keys_job_run, job);
+    pthread_attr_destroy(&attr);
+
+    if (error) {
+        Py_DECREF(job->callback);
+        _pysilc_keys_job_free(job);
+        PyErr_SetString(PyExc_RuntimeError, "Unable to start key thread.");
+        return NULL;
+    }
+
+    Py_RETURN_NONE;
+}
+
+static PyObject *pysilc_create_key_pair_async(PyObject *mod, PyObject *args, PyObject *kwds)
+{
+    PyObject *callback, *passphrase_obj = Py_None;
+    char *pkcs_name = NULL;
+    char *pub_filename, *prv_filename;
+    char *passphrase = NULL;
+    char *pub_identifier = NULL;
+    SilcUInt32 key_length = 2048;
+    PySilcKeys_Job *job;
+
+    static char *kwlist[] = {"callback", "public_filename", "private_filename", "identifier", "passphrase", "pkcs_name", "key_length", NULL};
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "Oss|zOzI", kwlist,
+            &callback, &pub_filename, &prv_filename, &pub_identifier,
+            &passphrase_obj, &pkcs_name, &key_length))
+        return NULL;
+
+    if (!PyCallable_Check(callback)) {
+        PyErr_SetString(PyExc_TypeError, "callback should be callable");
+        return NULL;
+    }
+    // a worker thread can not prompt on the terminal, None means none
+    if (passphrase_obj == Py_None)
+        passphrase = "";
+    else if (_pysilc_parse_passphrase(passphrase_obj, &passphrase) < 0)
+        return NULL;
+
+    if (!(job = calloc(1, sizeof(PySilcKeys_Job))))
+        return PyErr_NoMemory();
+
+    job->create = 1;
+    job->pkcs_name = _pysilc_strdup(pkcs_name);
+    job->pub_filename = _pysilc_strdup(pub_filename);
+    job->prv_filename = _pysilc_strdup(prv_filename);
+    job->pub_identifier = _pysilc_strdup(pub_identifier);
+    job->passphrase = _pysilc_strdup(passphrase);
+    job->key_length = key_length;
+    job->callback = callback;
+
+    return _pysilc_keys_job_start(job);
+}
+
+static PyObject *pysilc_load_key_pair_async(PyObject *mod, PyObject *args, PyObject *kwds)
+{
+    PyObject *callback, *passphrase_obj;
+    char *pub_filename, *prv_filename;
+    char *passphrase = NULL;
+    PySilcKeys_Job *job;
+
+    static char *kwlist[] = {"callback", "public_filename", "private_filename", "passphrase", NULL};
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "OssO", kwlist,
+            &callback, &pub_filename, &prv_filename, &passphrase_obj))
+        return NULL;
+
+    if (!PyCallable_Check(callback)) {
+        PyErr_SetString(PyExc_TypeError, "callback should be callable");
+        return NULL;
+    }
+    // a worker thread can not prompt on the terminal
+    if (passphrase_obj == Py_None) {
+        PyErr_SetString(PyExc_TypeError, "passphrase should be String Type");
+        return NULL;
+    }
+    if (_pysilc_parse_passphrase(passphrase_obj, &passphrase) < 0)
+        return NULL;
+
+    if (!(job = calloc(1, sizeof(PySilcKeys_Job))))
+        return PyErr_NoMemory();
+
+    job->pub_filename = _pysilc_strdup(pub_filename);
+    job->prv_filename = _pysilc_strdup(prv_filename);
+    job->passphrase = _pysilc_strdup(passphrase);
+    job->callback = callback;
+
+    return _pysilc_keys_job_start(job);
+}
+
+/* ---------------- in-memory key import and export ------------- */
+
+#define PYSILC_KEY_FILE_BEGIN "-----BEGIN SILC"
+
+// The toolkit reads and writes key files by name only, so buffers go
+// through an anonymous memory backed file that never touches the disk.
+static int _pysilc_keys_memfile(char *path, size_t path_len)
+{
+    int fd;
+#ifdef MFD_CLOEXEC
+    fd = memfd_create("pysilc-key", MFD_CLOEXEC);
+#else
+    char template[] = "/dev/shm/pysilc-key-XXXXXX";
+    fd = mkstemp(template);
+    if (fd >= 0)
+        unlink(template);
+#endif
+    if (fd >= 0)
+        snprintf(path, path_len, "/proc/self/fd/%d", fd);
+    return fd;
+}
+
+static int _pysilc_keys_memfile_write(const unsigned char *data, SilcUInt32 len,
+                                      char *path, size_t path_len)
+{
+    int fd = _pysilc_keys_memfile(path, path_len);
+    if (fd < 0)
+        return -1;
+    if (write(fd, data, len) != (ssize_t)len) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static PyObject *_pysilc_keys_memfile_read(int fd)
+{
+    PyObject *data;
+    struct stat st;
+
+    if (fstat(fd, &st) < 0)
+        return PyErr_SetFromErrno(PyExc_IOError);
+    if (!(data = PyString_FromStringAndSize(NULL, st.st_size)))
+        return NULL;
+    if (pread(fd, PyString_AS_STRING(data), st.st_size, 0) != st.st_size) {
+        Py_DECREF(data);
+        return PyErr_SetFromErrno(PyExc_IOError);
+    }
+    return data;
+}
+
+static SilcBool _pysilc_keys_decode_public(const unsigned char *data, SilcUInt32 len,
+                                           SilcPublicKey *public_key)
+{
+    char path[64];
+    SilcBool result;
+    int fd;
+
+    // raw encoding as returned by silc_pkcs_public_key_encode
+    if (len < strlen(PYSILC_KEY_FILE_BEGIN) ||
+        memcmp(data, PYSILC_KEY_FILE_BEGIN, strlen(PYSILC_KEY_FILE_BEGIN)))
+        return silc_pkcs_public_key_alloc(SILC_PKCS_SILC, (unsigned char *)data,
+                                          len, public_key);
+
+    if ((fd = _pysilc_keys_memfile_write(data, len, path, sizeof(path))) < 0)
+        return FALSE;
+    result = silc_pkcs_load_public_key(path, public_key);
+    close(fd);
+    return result;
+}
+
+static SilcBool _pysilc_keys_decode_private(const unsigned char *data, SilcUInt32 len,
+                                            const char *passphrase,
+                                            SilcPrivateKey *private_key)
+{
+    char path[64];
+    SilcBool result;
+    int fd;
+
+    if ((fd = _pysilc_keys_memfile_write(data, len, path, sizeof(path))) < 0)
+        return FALSE;
+    result = silc_pkcs_load_private_key(path, (unsigned char *)passphrase,
+                                        passphrase ? strlen(passphrase) : 0,
+                                        private_key);
+    close(fd);
+    return result;
+}
+
+static PyObject *pysilc_keys_from_bytes(PyObject *cls, PyObject *args, PyObject *kwds)
+{
+    PyObject *passphrase_obj = Py_None;
+    unsigned char *public, *private;
+    int public_len, private_len;
+    char *passphrase = NULL;
+    SilcPublicKey public_key = NULL;
+    SilcPrivateKey private_key = NULL;
+    SilcBool result;
+
+    static char *kwlist[] = {"public", "private", "passphrase", NULL};
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "s#s#|O", kwlist,
+            &public, &public_len, &private, &private_len,
+            &passphrase_obj))
+        return NULL;
+
+    if (_pysilc_parse_passphrase(passphrase_obj, &passphrase) < 0)
+        return NULL;
+
+    Py_BEGIN_ALLOW_THREADS
+    result = _pysilc_keys_decode_public(public, public_len, &public_key) &&
+        _pysilc_keys_decode_private(private, private_len, passphrase,
+                                    &private_key);
+    Py_END_ALLOW_THREADS
+
+    if (!result) {
+        if (public_key)
+            silc_pkcs_public_key_free(public_key);
+        PyErr_SetString(PyExc_RuntimeError, "Unable to load keys.");
+        return NULL;
+    }
+
+    return PySilcKeys_New(public_key, private_key);
+}
+
+static PyObject *pysilc_keys_export_public(PyObject *self)
+{
+    PySilcKeys *pykeys = (PySilcKeys *)self;
+    PyObject *data = NULL;
+    char path[64];
+    SilcBool result;
+    int fd;
+
+    if ((fd = _pysilc_keys_memfile(path, sizeof(path))) < 0)
+        return PyErr_SetFromErrno(PyExc_IOError);
+
+    result = silc_pkcs_save_public_key(path, pykeys->public,
+                                       SILC_PKCS_FILE_BASE64);
+    if (result)
+        data = _pysilc_keys_memfile_read(fd);
+    else
+        PyErr_SetString(PyExc_RuntimeError, "Unable to export public key.");
+    close(fd);
+    return data;
+}
+
+static PyObject *pysilc_keys_export_private(PyObject *self, PyObject *args, PyObject *kwds)
+{
+    PySilcKeys *pykeys = (PySilcKeys *)self;
+    PyObject *passphrase_obj = Py_None, *data = NULL;
+    char *passphrase = NULL;
+    char path[64];
+    SilcBool result;
+    SilcRng rng;
+    int fd;
+
+    static char *kwlist[] = {"passphrase", NULL};
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "|O", kwlist, &passphrase_obj))
+        return NULL;
+    if (_pysilc_parse_passphrase(passphrase_obj, &passphrase) < 0)
+        return NULL;
+
+    if ((fd = _pysilc_keys_memfile(path, sizeof(path))) < 0)
+        return PyErr_SetFromErrno(PyExc_IOError);
+
+    rng = silc_rng_alloc();
+    silc_rng_init(rng);
+
+    Py_BEGIN_ALLOW_THREADS
+    result = silc_pkcs_save_private_key(path, pykeys->private,
+                                        (unsigned char *)passphrase,
+                                        passphrase ? strlen(passphrase) : 0,
+                                        SILC_PKCS_FILE_BIN, rng);
+    Py_END_ALLOW_THREADS
+
+    silc_rng_free(rng);
+    if (result)
+        data = _pysilc_keys_memfile_read(fd);
+    else
+        PyErr_SetString(PyExc_RuntimeError, "Unable to export private key.");
+    close(fd);
+    return data;
+}
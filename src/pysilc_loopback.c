@@ -0,0 +1,291 @@
+/*
+ *
+ * PySilc - Python SILC Toolkit Bindings
+ *
+ * Copyright (c) 2006, Alastair Tse <alastair@liquidx.net>
+ * Copyright (c) 2007, Martynas Venckus <martynas@altroot.org>
+ * All rights reserved.
+ *
+ * This program is free software; you can redistributed it and/or modify
+ * it under the terms of the BSD License. See LICENSE in the distribution
+ * for details or http://www.liquidx.net/pysilc/.
+ *
+ */
+
+#include "pysilc.h"
+
+/*
+ * Loopback load generator. Stands in for the server and the toolkit
+ * connection: events are made up from a fixed set of fake client and
+ * channel entries and handed to the same toolkit callbacks the client
+ * library calls, so everything from the callback entry to the Python
+ * method is measured without a network or a server.
+ */
+
+#define PYSILC_LOOPBACK_MAX_EVENTS 8
+
+typedef enum {
+    PYSILC_LOOPBACK_CHANNEL_MESSAGE,
+    PYSILC_LOOPBACK_PRIVATE_MESSAGE,
+    PYSILC_LOOPBACK_JOIN,
+    PYSILC_LOOPBACK_LEAVE,
+    PYSILC_LOOPBACK_WHOIS,
+} PySilcLoopbackEvent;
+
+static const char *_pysilc_loopback_names[] = {
+    "channel_message",
+    "private_message",
+    "join",
+    "leave",
+    "whois",
+    NULL,
+};
+
+typedef struct _PySilcLoopback {
+    struct SilcClientStruct client;     // only application is set
+    SilcUInt32 user_count;
+    SilcUInt32 channel_count;
+    struct SilcClientEntryStruct *users;
+    struct SilcChannelEntryStruct *channels;
+    char *channel_names;
+    struct _PySilcLoopback *retired;    // earlier sizes, wrappers may remain
+} PySilcLoopback;
+
+#define PYSILC_LOOPBACK_NAME_LEN 32
+
+static void _pysilc_loopback_free_one(PySilcLoopback *loopback)
+{
+    free(loopback->users);
+    free(loopback->channels);
+    free(loopback->channel_names);
+    free(loopback);
+}
+
+static void _pysilc_loopback_free(PySilcClient *pyclient)
+{
+    PySilcLoopback *loopback = pyclient->loopback, *retired;
+
+    while (loopback) {
+        retired = loopback->retired;
+        _pysilc_loopback_free_one(loopback);
+        loopback = retired;
+    }
+    pyclient->loopback = NULL;
+}
+
+static void _pysilc_loopback_id(SilcIPAddress *ip, SilcUInt32 index)
+{
+    SILC_PUT32_MSB(index, ip->data);
+    ip->data_len = 4;
+}
+
+/* The entries are kept until the client goes away, as callbacks may
+   hold on to the wrappers; a run asking for a different number of them
+   gets new ones and the old are retired, not freed. */
+static PySilcLoopback *_pysilc_loopback_alloc(PySilcClient *pyclient,
+                                              SilcUInt32 users,
+                                              SilcUInt32 channels)
+{
+    PySilcLoopback *loopback = pyclient->loopback;
+    SilcClientEntry user;
+    SilcChannelEntry channel;
+    SilcUInt32 i;
+
+    if (loopback && loopback->user_count == users &&
+        loopback->channel_count == channels)
+        return loopback;
+
+    if (!(loopback = calloc(1, sizeof(*loopback))))
+        return NULL;
+    loopback->users = calloc(users, sizeof(*loopback->users));
+    loopback->channels = calloc(channels, sizeof(*loopback->channels));
+    loopback->channel_names = calloc(channels, PYSILC_LOOPBACK_NAME_LEN);
+    if (!loopback->users || !loopback->channels || !loopback->channel_names) {
+        _pysilc_loopback_free_one(loopback);
+        return NULL;
+    }
+    loopback->retired = pyclient->loopback;
+    pyclient->loopback = loopback;
+
+    loopback->client.application = pyclient;
+    loopback->user_count = users;
+    loopback->channel_count = channels;
+    for (i = 0; i < users; i++) {
+        user = &loopback->users[i];
+        snprintf(user->nickname, sizeof(user->nickname), "user%u", i);
+        snprintf(user->username, sizeof(user->username), "user%u", i);
+        snprintf(user->hostname, sizeof(user->hostname), "loopback");
+        snprintf(user->server, sizeof(user->server), "loopback");
+        user->realname = "Loopback User";
+        _pysilc_loopback_id(&user->id.ip, i);
+    }
+    for (i = 0; i < channels; i++) {
+        channel = &loopback->channels[i];
+        channel->channel_name = loopback->channel_names +
+                                i * PYSILC_LOOPBACK_NAME_LEN;
+        snprintf(channel->channel_name, PYSILC_LOOPBACK_NAME_LEN,
+                 "#loopback%u", i);
+        _pysilc_loopback_id(&channel->id.ip, i);
+        channel->id.port = 706;
+    }
+    return loopback;
+}
+
+static void _pysilc_loopback_notify(SilcClient client, SilcNotifyType type,
+                                    SilcClientEntry user,
+                                    SilcChannelEntry channel)
+{
+    _pysilc_client_callback_notify(client, NULL, type, user, channel);
+}
+
+static void _pysilc_loopback_reply(SilcClient client, SilcCommand command,
+                                   ...)
+{
+    va_list va;
+
+    va_start(va, command);
+    _pysilc_client_callback_command_reply(client, NULL, command,
+                                          SILC_STATUS_OK, SILC_STATUS_OK, va);
+    va_end(va);
+}
+
+static void _pysilc_loopback_dispatch(PySilcLoopback *loopback,
+                                      PySilcLoopbackEvent event,
+                                      SilcUInt32 n, unsigned char *message,
+                                      SilcUInt32 message_len)
+{
+    SilcClient client = &loopback->client;
+    SilcClientEntry user = &loopback->users[n % loopback->user_count];
+    SilcChannelEntry channel = &loopback->channels[n % loopback->channel_count];
+
+    switch (event) {
+    case PYSILC_LOOPBACK_CHANNEL_MESSAGE:
+        _pysilc_client_callback_channel_message(client, NULL, user, channel,
+                                                NULL, NULL, 0, message,
+                                                message_len);
+        break;
+    case PYSILC_LOOPBACK_PRIVATE_MESSAGE:
+        _pysilc_client_callback_private_message(client, NULL, user, NULL, 0,
+                                                message, message_len);
+        break;
+    case PYSILC_LOOPBACK_JOIN:
+        _pysilc_loopback_notify(client, SILC_NOTIFY_TYPE_JOIN, user, channel);
+        break;
+    case PYSILC_LOOPBACK_LEAVE:
+        _pysilc_loopback_notify(client, SILC_NOTIFY_TYPE_LEAVE, user, channel);
+        break;
+    case PYSILC_LOOPBACK_WHOIS:
+        _pysilc_loopback_reply(client, SILC_COMMAND_WHOIS, user,
+                               user->nickname, user->username,
+                               user->realname, NULL, (SilcUInt32)0,
+                               (SilcUInt32)0, NULL, NULL, NULL);
+        break;
+    }
+}
+
+static int _pysilc_loopback_parse(const char *spec,
+                                  PySilcLoopbackEvent *events)
+{
+    const char *end;
+    size_t len;
+    int count = 0, i;
+
+    while (*spec) {
+        end = strchr(spec, ',');
+        len = end ? (size_t)(end - spec) : strlen(spec);
+        for (i = 0; _pysilc_loopback_names[i]; i++)
+            if (strlen(_pysilc_loopback_names[i]) == len &&
+                !strncmp(_pysilc_loopback_names[i], spec, len))
+                break;
+        if (!_pysilc_loopback_names[i] ||
+            count == PYSILC_LOOPBACK_MAX_EVENTS)
+            return -1;
+        events[count++] = i;
+        if (!end)
+            break;
+        spec = end + 1;
+    }
+    return count;
+}
+
+static int _pysilc_loopback_compare(const void *a, const void *b)
+{
+    SilcUInt64 x = *(const SilcUInt64 *)a, y = *(const SilcUInt64 *)b;
+    return x < y ? -1 : x > y;
+}
+
+static PyObject *pysilc_client_loopback(PyObject *self, PyObject *args,
+                                        PyObject *kwds)
+{
+    PySilcClient *pyclient = (PySilcClient *)self;
+    PySilcLoopbackEvent events[PYSILC_LOOPBACK_MAX_EVENTS];
+    char *spec = "channel_message";
+    unsigned int count = 10000, size = 256, users = 16, channels = 4, i;
+    int event_count;
+    unsigned char *message;
+    PySilcLoopback *loopback;
+    SilcUInt64 *latency, start, elapsed, event_start;
+    PyObject *result;
+    double seconds;
+
+    static char *kwlist[] = {"events", "count", "size", "users", "channels", NULL};
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "|sIIII", kwlist, &spec,
+                                     &count, &size, &users, &channels))
+        return NULL;
+    if ((event_count = _pysilc_loopback_parse(spec, events)) <= 0) {
+        PyErr_SetString(PyExc_ValueError,
+                        "events should be a comma separated list of "
+                        "channel_message, private_message, join, leave "
+                        "and whois");
+        return NULL;
+    }
+    if (!count || !users || !channels) {
+        PyErr_SetString(PyExc_ValueError,
+                        "count, users and channels should be positive");
+        return NULL;
+    }
+
+    if (!(loopback = _pysilc_loopback_alloc(pyclient, users, channels)))
+        return PyErr_NoMemory();
+    if (!(latency = malloc(count * sizeof(*latency))))
+        return PyErr_NoMemory();
+    if (!(message = malloc(size + 1))) {
+        free(latency);
+        return PyErr_NoMemory();
+    }
+    memset(message, 'x', size);
+
+    start = _pysilc_stats_now();
+    for (i = 0; i < count; i++) {
+        event_start = _pysilc_stats_now();
+        _pysilc_loopback_dispatch(loopback, events[i % event_count], i,
+                                  message, size);
+        if (pyclient->queue)
+            _pysilc_queue_drain(pyclient, 0);
+        latency[i] = _pysilc_stats_now() - event_start;
+
+        // callbacks print their exceptions, but let ^C stop the run
+        if (!(i & 1023) && PyErr_CheckSignals() < 0) {
+            free(message);
+            free(latency);
+            return NULL;
+        }
+    }
+    elapsed = _pysilc_stats_now() - start;
+    free(message);
+
+    qsort(latency, count, sizeof(*latency), _pysilc_loopback_compare);
+    seconds = elapsed / 1e9;
+    result = Py_BuildValue("{s:s,s:I,s:I,s:d,s:d,s:d,s:d,s:d}",
+                           "events", spec,
+                           "count", count,
+                           "size", size,
+                           "seconds", seconds,
+                           "events_per_sec", seconds > 0 ? count / seconds : 0.0,
+                           "p50", latency[count / 2] / 1e9,
+                           "p99", latency[(SilcUInt64)count * 99 / 100] / 1e9,
+                           "max", latency[count - 1] / 1e9);
+    free(latency);
+    return result;
+}
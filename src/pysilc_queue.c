@@ -0,0 +1,577 @@
+/*
+ *
+ * PySilc - Python SILC Toolkit Bindings
+ *
+ * Copyright (c) 2006, Alastair Tse <alastair@liquidx.net>
+ * Copyright (c) 2007, Martynas Venckus <martynas@altroot.org>
+ * All rights reserved.
+ *
+ * This program is free software; you can redistributed it and/or modify
+ * it under the terms of the BSD License. See LICENSE in the distribution
+ * for details or http://www.liquidx.net/pysilc/.
+ *
+ */
+
+#include "pysilc.h"
+
+/*
+ * Prioritized dispatch. With prioritize_events() the Python calls for
+ * messages, notifies and command replies are not made from the toolkit
+ * callbacks but queued per priority class, and run_one() makes them
+ * once the scheduler has processed what arrived, highest class first.
+ * A private message that came in behind a burst of channel traffic is
+ * then answered first. So that a busy higher class cannot starve the
+ * others, every n-th call while several classes wait goes to the
+ * oldest event of a lower class, n being 1 / share.
+ *
+ * The arguments are built when the event arrives; the client and
+ * channel entries in them are referenced until the call is made.
+ *
+ * limit_events() bounds a class. When it is full a new event is dropped
+ * (QUEUE_DROP_NEWEST), replaces the oldest (QUEUE_DROP_OLDEST), does so
+ * only for every n-th new event (QUEUE_SAMPLE), or is taken and the
+ * socket is not read again until there is room (QUEUE_BLOCK), leaving
+ * the backlog to TCP and the server.
+ */
+
+typedef enum {
+    PYSILC_CLASS_PRIVATE_MESSAGE,
+    PYSILC_CLASS_COMMAND_REPLY,
+    PYSILC_CLASS_CHANNEL_MESSAGE,
+    PYSILC_CLASS_NOTIFY,
+    PYSILC_CLASS_MAX
+} PySilcEventClass;
+
+static const char *_pysilc_queue_class_names[PYSILC_CLASS_MAX] = {
+    "private_message", "command_reply", "channel_message", "notify",
+};
+
+typedef struct _PySilcQueueItem {
+    struct _PySilcQueueItem *next;
+    PySilcStatEvent event;
+    PyObject *callback, *args;
+    SilcClientConnection conn;      // NULL for loopback and replay
+    void **entries;                 // referenced users, then channels
+    SilcUInt32 users, channels;
+    SilcUInt64 seq;
+    SilcUInt64 entered;             // toolkit callback time, for stats
+} PySilcQueueItem;
+
+static const char *_pysilc_queue_policy_names[] = {
+    "block", "drop_oldest", "drop_newest", "sample",
+};
+
+typedef struct {
+    PySilcQueueItem *head, *tail;
+    SilcUInt32 count;
+    SilcUInt32 limit;               // 0 for unbounded
+    int policy;
+    SilcUInt32 sample;              // QUEUE_SAMPLE keeps one in this many
+    SilcUInt32 seen;                // events over the limit, for sampling
+    SilcUInt64 queued, dispatched, dropped;
+} PySilcQueueClass;
+
+typedef struct _PySilcQueue {
+    int order[PYSILC_CLASS_MAX];    // highest priority first
+    PySilcQueueClass classes[PYSILC_CLASS_MAX];
+    SilcUInt32 every;               // lower class turn, 0 for strict order
+    SilcUInt32 streak;
+    SilcUInt32 budget;              // calls per run_one, 0 for all
+    SilcUInt32 pending, max_pending;
+    SilcUInt64 seq;
+    SilcUInt64 promoted;            // calls given to a lower class
+    SilcUInt64 blocks;              // times reading was stopped
+} PySilcQueue;
+
+static int _pysilc_queue_class(PySilcStatEvent event)
+{
+    if (event == PYSILC_STAT_PRIVATE_MESSAGE)
+        return PYSILC_CLASS_PRIVATE_MESSAGE;
+    if (event == PYSILC_STAT_CHANNEL_MESSAGE)
+        return PYSILC_CLASS_CHANNEL_MESSAGE;
+    if ((event >= PYSILC_STAT_NOTIFY_NONE &&
+         event <= PYSILC_STAT_NOTIFY_WATCH) ||
+        (event >= PYSILC_STAT_NOTIFY_JOIN_BATCH &&
+         event <= PYSILC_STAT_NOTIFY_SIGNOFF_BATCH))
+        return PYSILC_CLASS_NOTIFY;
+    if (event >= PYSILC_STAT_COMMAND_REPLY_WHOIS &&
+        event <= PYSILC_STAT_COMMAND_REPLY_FAILED)
+        return PYSILC_CLASS_COMMAND_REPLY;
+    return -1;
+}
+
+/* Visits the entries of the users and channels in the arguments and in
+   the tuples and lists among them. With 'item' NULL only counts. */
+static void _pysilc_queue_entries(PySilcClient *pyclient,
+                                  PySilcQueueItem *item, PyObject *args,
+                                  SilcUInt32 *users, SilcUInt32 *channels,
+                                  int depth)
+{
+    PyObject *obj;
+    Py_ssize_t i, count;
+
+    if (!args || !(PyTuple_Check(args) || PyList_Check(args)))
+        return;
+    count = PySequence_Fast_GET_SIZE(args);
+    for (i = 0; i < count; i++) {
+        obj = PySequence_Fast_GET_ITEM(args, i);
+        if (PyObject_TypeCheck(obj, &PySilcUser_Type)) {
+            if (!((PySilcUser *)obj)->silcobj)
+                continue;
+            if (item) {
+                item->entries[item->users++] =
+                    silc_client_ref_client(pyclient->silcobj, item->conn,
+                                           ((PySilcUser *)obj)->silcobj);
+                PYSILC_LIVE_INC(PYSILC_LIVE_CLIENT_ENTRY_REF);
+            }
+            else
+                (*users)++;
+        }
+        else if (PyObject_TypeCheck(obj, &PySilcChannel_Type)) {
+            if (!((PySilcChannel *)obj)->silcobj)
+                continue;
+            if (item)
+                item->entries[*users + item->channels++] =
+                    silc_client_ref_channel(pyclient->silcobj, item->conn,
+                                            ((PySilcChannel *)obj)->silcobj);
+            else
+                (*channels)++;
+        }
+        else if (depth)
+            _pysilc_queue_entries(pyclient, item, obj, users, channels,
+                                  depth - 1);
+    }
+}
+
+static void _pysilc_queue_item_free(PySilcClient *pyclient,
+                                    PySilcQueueItem *item)
+{
+    SilcUInt32 i;
+
+    if (item->conn && pyclient->silcobj) {
+        for (i = 0; i < item->users; i++) {
+            silc_client_unref_client(pyclient->silcobj, item->conn,
+                                     item->entries[i]);
+            PYSILC_LIVE_DEC(PYSILC_LIVE_CLIENT_ENTRY_REF);
+        }
+        for (i = 0; i < item->channels; i++)
+            silc_client_unref_channel(pyclient->silcobj, item->conn,
+                                      item->entries[item->users + i]);
+    }
+    Py_XDECREF(item->callback);
+    Py_XDECREF(item->args);
+    free(item->entries);
+    free(item);
+}
+
+static PySilcQueueItem *_pysilc_queue_take(PySilcQueue *q, int cls)
+{
+    PySilcQueueClass *c = &q->classes[cls];
+    PySilcQueueItem *item = c->head;
+
+    if (!(c->head = item->next))
+        c->tail = NULL;
+    c->count--;
+    q->pending--;
+    return item;
+}
+
+/* Queues the call. Returns 1 if the limit of the class dropped it and
+   -1 if it could not be queued. */
+static int _pysilc_queue_push(PySilcClient *pyclient,
+                              SilcClientConnection conn, int cls,
+                              PySilcStatEvent event, PyObject *callback,
+                              PyObject *args)
+{
+    PySilcQueue *q = pyclient->queue;
+    PySilcQueueClass *c = &q->classes[cls];
+    PySilcQueueItem *item;
+    SilcUInt32 users = 0, channels = 0;
+
+    if (c->limit && c->count >= c->limit) {
+        switch (c->policy) {
+        case PYSILC_QUEUE_DROP_NEWEST:
+            c->dropped++;
+            return 1;
+        case PYSILC_QUEUE_SAMPLE:
+            if (++c->seen % c->sample) {
+                c->dropped++;
+                return 1;
+            }
+            // the sampled one takes the place of the oldest
+        case PYSILC_QUEUE_DROP_OLDEST:
+            c->dropped++;
+            _pysilc_queue_item_free(pyclient, _pysilc_queue_take(q, cls));
+            break;
+        default:
+            // taken, reading stops after this scheduler round
+            break;
+        }
+    }
+
+    if (!(item = calloc(1, sizeof(*item))))
+        return -1;
+    if (conn) {
+        _pysilc_queue_entries(pyclient, NULL, args, &users, &channels, 1);
+        if (users + channels &&
+            !(item->entries = malloc((users + channels) *
+                                     sizeof(*item->entries)))) {
+            free(item);
+            return -1;
+        }
+        item->conn = conn;
+        _pysilc_queue_entries(pyclient, item, args, &users, &channels, 1);
+    }
+    item->event = event;
+    item->callback = callback;
+    Py_INCREF(callback);
+    item->args = args;
+    Py_XINCREF(args);
+    item->seq = q->seq++;
+    item->entered = pyclient->stats_entered;
+
+    if (c->tail)
+        c->tail->next = item;
+    else
+        c->head = item;
+    c->tail = item;
+    c->count++;
+    c->queued++;
+    if (++q->pending > q->max_pending)
+        q->max_pending = q->pending;
+    return 0;
+}
+
+static PySilcQueueItem *_pysilc_queue_pop(PySilcQueue *q)
+{
+    int i, cls, top = -1, other = -1;
+
+    for (i = 0; i < PYSILC_CLASS_MAX; i++) {
+        cls = q->order[i];
+        if (!q->classes[cls].head)
+            continue;
+        if (top < 0)
+            top = cls;
+        else if (other < 0 ||
+                 q->classes[cls].head->seq < q->classes[other].head->seq)
+            other = cls;
+    }
+    if (top < 0)
+        return NULL;
+
+    // the lower classes' share, given to whichever waited longest
+    if (other < 0)
+        q->streak = 0;
+    else if (q->every && ++q->streak >= q->every) {
+        q->streak = 0;
+        q->promoted++;
+        top = other;
+    }
+
+    q->classes[top].dispatched++;
+    return _pysilc_queue_take(q, top);
+}
+
+/* Makes the queued calls, at most 'budget' of them unless 0. */
+static void _pysilc_queue_drain(PySilcClient *pyclient, SilcUInt32 budget)
+{
+    PySilcQueueItem *item;
+    PyObject *result;
+
+    // the handlers may reconfigure or turn off the queue
+    while (pyclient->queue && (item = _pysilc_queue_pop(pyclient->queue))) {
+        pyclient->stats_entered = item->entered;
+        if ((result = _pysilc_stats_call(pyclient, item->event,
+                                         item->callback, item->args)) == 0)
+            PyErr_Print();
+        Py_XDECREF(result);
+        _pysilc_queue_item_free(pyclient, item);
+        if (budget && !--budget)
+            break;
+    }
+}
+
+/* Calls the callback now, or queues the call for run_one(). */
+static PyObject *_pysilc_queue_call(PySilcClient *pyclient,
+                                    SilcClientConnection conn,
+                                    PySilcStatEvent event,
+                                    PyObject *callback, PyObject *args)
+{
+    int cls;
+
+    if (!pyclient->queue || (cls = _pysilc_queue_class(event)) < 0 ||
+        _pysilc_queue_push(pyclient, conn, cls, event, callback, args) < 0)
+        return _pysilc_stats_call(pyclient, event, callback, args);
+    Py_RETURN_NONE;
+}
+
+/* Stops or resumes reading the socket as QUEUE_BLOCK classes fill up and
+   drain. Called around each run_one(), as sending re-enables reading. */
+static void _pysilc_queue_backpressure(PySilcClient *pyclient)
+{
+    PySilcQueue *q = pyclient->queue;
+    SilcClientConnection conn = pyclient->silcconn;
+    SilcStream stream;
+    SilcSocket sock;
+    int i, blocked = 0;
+
+    for (i = 0; q && i < PYSILC_CLASS_MAX; i++)
+        if (q->classes[i].policy == PYSILC_QUEUE_BLOCK &&
+            q->classes[i].limit && q->classes[i].count >= q->classes[i].limit)
+            blocked = 1;
+
+    // a new connection starts out reading
+    if (!conn || !conn->stream ||
+        !(stream = silc_packet_stream_get_stream(conn->stream)) ||
+        !silc_socket_stream_get_info(stream, &sock, NULL, NULL, NULL)) {
+        pyclient->inbound_blocked = 0;
+        return;
+    }
+    if (!blocked && !pyclient->inbound_blocked)
+        return;
+    if (blocked && !pyclient->inbound_blocked)
+        q->blocks++;
+    silc_schedule_set_listen_fd(pyclient->silcobj->schedule, sock,
+                                blocked ? 0 : SILC_TASK_READ, FALSE);
+    pyclient->inbound_blocked = blocked;
+}
+
+/* Drops the queued calls, for the client going away. */
+static void _pysilc_queue_free(PySilcClient *pyclient)
+{
+    PySilcQueue *q = pyclient->queue;
+    PySilcQueueItem *item;
+
+    if (!q)
+        return;
+    while ((item = _pysilc_queue_pop(q)) != NULL)
+        _pysilc_queue_item_free(pyclient, item);
+    free(q);
+    pyclient->queue = NULL;
+    _pysilc_queue_backpressure(pyclient);
+}
+
+static PySilcQueue *_pysilc_queue_alloc(PySilcClient *pyclient)
+{
+    PySilcQueue *q;
+    int cls;
+
+    if (pyclient->queue)
+        return pyclient->queue;
+    if (!(q = calloc(1, sizeof(*q))))
+        return NULL;
+    for (cls = 0; cls < PYSILC_CLASS_MAX; cls++) {
+        q->order[cls] = cls;
+        q->classes[cls].policy = PYSILC_QUEUE_DROP_OLDEST;
+        q->classes[cls].sample = 1;
+    }
+    q->every = 5;
+    pyclient->queue = q;
+    return q;
+}
+
+static int _pysilc_queue_class_by_name(const char *name)
+{
+    int cls;
+
+    for (cls = 0; cls < PYSILC_CLASS_MAX; cls++)
+        if (!strcmp(name, _pysilc_queue_class_names[cls]))
+            return cls;
+    return -1;
+}
+
+static int _pysilc_queue_order(PyObject *order, int *classes)
+{
+    PyObject *seq, *item;
+    Py_ssize_t count, i;
+    int listed[PYSILC_CLASS_MAX] = {0}, n = 0, cls;
+
+    if (!(seq = PySequence_Fast(order, "order should be a sequence of "
+                                       "event class names")))
+        return -1;
+    count = PySequence_Fast_GET_SIZE(seq);
+    for (i = 0; i < count; i++) {
+        item = PySequence_Fast_GET_ITEM(seq, i);
+        if (!PyString_Check(item)) {
+            Py_DECREF(seq);
+            PyErr_SetString(PyExc_TypeError, "event classes should be strings");
+            return -1;
+        }
+        cls = _pysilc_queue_class_by_name(PyString_AS_STRING(item));
+        if (cls < 0 || listed[cls]) {
+            PyErr_Format(PyExc_ValueError, "unknown or repeated event class "
+                         "'%s'", PyString_AS_STRING(item));
+            Py_DECREF(seq);
+            return -1;
+        }
+        listed[cls] = 1;
+        classes[n++] = cls;
+    }
+    Py_DECREF(seq);
+
+    // the rest keep their default order below the listed ones
+    for (cls = 0; cls < PYSILC_CLASS_MAX; cls++)
+        if (!listed[cls])
+            classes[n++] = cls;
+    return 0;
+}
+
+static PyObject *pysilc_client_prioritize_events(PyObject *self,
+                                                 PyObject *args,
+                                                 PyObject *kwds)
+{
+    PySilcClient *pyclient = (PySilcClient *)self;
+    PyObject *order = NULL;
+    int classes[PYSILC_CLASS_MAX], cls;
+    unsigned int budget = 0;
+    double share = 0.2;
+    PySilcQueue *q;
+    static char *kwlist[] = {"order", "share", "budget", NULL};
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "|OdI", kwlist, &order,
+                                     &share, &budget))
+        return NULL;
+
+    if (order == Py_None) {
+        // what is queued is still delivered
+        _pysilc_queue_drain(pyclient, 0);
+        _pysilc_queue_free(pyclient);
+        Py_RETURN_NONE;
+    }
+    if (share < 0 || share >= 1) {
+        PyErr_SetString(PyExc_ValueError, "share should be at least 0 and "
+                                          "below 1");
+        return NULL;
+    }
+    if (order) {
+        if (_pysilc_queue_order(order, classes) < 0)
+            return NULL;
+    }
+    else {
+        for (cls = 0; cls < PYSILC_CLASS_MAX; cls++)
+            classes[cls] = cls;
+    }
+
+    if (!(q = _pysilc_queue_alloc(pyclient)))
+        return PyErr_NoMemory();
+    memcpy(q->order, classes, sizeof(q->order));
+    q->every = share > 0 ? (SilcUInt32)ceil(1 / share) : 0;
+    q->streak = 0;
+    q->budget = budget;
+    Py_RETURN_NONE;
+}
+
+static PyObject *pysilc_client_limit_events(PyObject *self, PyObject *args,
+                                            PyObject *kwds)
+{
+    PySilcClient *pyclient = (PySilcClient *)self;
+    PySilcQueueClass *c;
+    PySilcQueue *q;
+    char *name;
+    unsigned int limit, sample = 10;
+    int cls, policy = PYSILC_QUEUE_DROP_OLDEST;
+    static char *kwlist[] = {"event_class", "limit", "policy", "sample", NULL};
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "sI|iI", kwlist, &name,
+                                     &limit, &policy, &sample))
+        return NULL;
+    if ((cls = _pysilc_queue_class_by_name(name)) < 0) {
+        PyErr_Format(PyExc_ValueError, "unknown event class '%s'", name);
+        return NULL;
+    }
+    if (policy < PYSILC_QUEUE_BLOCK || policy > PYSILC_QUEUE_SAMPLE) {
+        PyErr_SetString(PyExc_ValueError, "policy should be QUEUE_BLOCK, "
+                        "QUEUE_DROP_OLDEST, QUEUE_DROP_NEWEST or QUEUE_SAMPLE");
+        return NULL;
+    }
+    if (!sample) {
+        PyErr_SetString(PyExc_ValueError, "sample should be at least 1");
+        return NULL;
+    }
+
+    // the default priorities unless prioritize_events() set others
+    if (!(q = _pysilc_queue_alloc(pyclient)))
+        return PyErr_NoMemory();
+    c = &q->classes[cls];
+    c->limit = limit;
+    c->policy = policy;
+    c->sample = sample;
+    c->seen = 0;
+
+    // a lowered limit applies to what already waits too
+    while (limit && c->count > limit && policy != PYSILC_QUEUE_BLOCK &&
+           policy != PYSILC_QUEUE_DROP_NEWEST) {
+        c->dropped++;
+        _pysilc_queue_item_free(pyclient, _pysilc_queue_take(q, cls));
+    }
+    Py_RETURN_NONE;
+}
+
+static PyObject *pysilc_client_events_pending(PyObject *self)
+{
+    PySilcClient *pyclient = (PySilcClient *)self;
+
+    return PyInt_FromLong(pyclient->queue ? pyclient->queue->pending : 0);
+}
+
+static PyObject *pysilc_client_event_queue_info(PyObject *self)
+{
+    PySilcClient *pyclient = (PySilcClient *)self;
+    PySilcQueue *q = pyclient->queue;
+    PyObject *info, *order = NULL, *classes = NULL, *value;
+    PySilcQueueClass *c;
+    int i;
+
+    if (!q)
+        Py_RETURN_NONE;
+    if (!(info = Py_BuildValue("{s:I,s:I,s:I,s:I,s:K,s:O,s:K}",
+                               "pending", q->pending,
+                               "max_pending", q->max_pending,
+                               "budget", q->budget,
+                               "lower_class_every", q->every,
+                               "promoted",
+                               (unsigned PY_LONG_LONG)q->promoted,
+                               "blocked",
+                               pyclient->inbound_blocked ? Py_True : Py_False,
+                               "blocks", (unsigned PY_LONG_LONG)q->blocks)))
+        return NULL;
+    if (!(order = PyList_New(PYSILC_CLASS_MAX)) || !(classes = PyDict_New()))
+        goto error;
+    for (i = 0; i < PYSILC_CLASS_MAX; i++) {
+        if (!(value = PyString_FromString(
+                          _pysilc_queue_class_names[q->order[i]])))
+            goto error;
+        PyList_SET_ITEM(order, i, value);
+
+        c = &q->classes[i];
+        if (!(value = Py_BuildValue("{s:I,s:K,s:K,s:K,s:I,s:s}",
+                                    "pending", c->count,
+                                    "queued", (unsigned PY_LONG_LONG)c->queued,
+                                    "dispatched",
+                                    (unsigned PY_LONG_LONG)c->dispatched,
+                                    "dropped",
+                                    (unsigned PY_LONG_LONG)c->dropped,
+                                    "limit", c->limit,
+                                    "policy",
+                                    _pysilc_queue_policy_names[c->policy])))
+            goto error;
+        if (PyDict_SetItemString(classes, _pysilc_queue_class_names[i],
+                                 value) < 0) {
+            Py_DECREF(value);
+            goto error;
+        }
+        Py_DECREF(value);
+    }
+    if (PyDict_SetItemString(info, "order", order) < 0 ||
+        PyDict_SetItemString(info, "classes", classes) < 0)
+        goto error;
+    Py_DECREF(order);
+    Py_DECREF(classes);
+    return info;
+
+error:
+    Py_XDECREF(order);
+    Py_XDECREF(classes);
+    Py_DECREF(info);
+    return NULL;
+}
@@ -0,0 +1,353 @@
+/*
+ *
+ * PySilc - Python SILC Toolkit Bindings
+ *
+ * Copyright (c) 2006, Alastair Tse <alastair@liquidx.net>
+ * Copyright (c) 2007, Martynas Venckus <martynas@altroot.org>
+ * All rights reserved.
+ *
+ * This program is free software; you can redistributed it and/or modify
+ * it under the terms of the BSD License. See LICENSE in the distribution
+ * for details or http://www.liquidx.net/pysilc/.
+ *
+ */
+
+#include "pysilc.h"
+
+/*
+ * Reconnect supervisor. Once enabled with auto_reconnect(), a lost
+ * connection is reconnected from the client scheduler: the same server
+ * at once, then the next candidate after each failure with a jittered
+ * exponential backoff. The channels the client was on are remembered
+ * with the passphrases they were joined with and are all rejoined as
+ * soon as the new connection is up, without waiting for each reply.
+ */
+
+typedef struct {
+    char *host;
+    int port;
+} PySilcReconnectServer;
+
+typedef struct {
+    char *name;
+    char *key;                      // passphrase given to JOIN, or NULL
+    int joined;                     // rejoined on reconnect
+} PySilcReconnectChannel;
+
+typedef struct _PySilcReconnect {
+    PySilcReconnectServer *servers;
+    SilcUInt32 server_count;
+    SilcUInt32 server;              // candidate to connect to next
+    SilcUInt32 attempt;             // failed attempts since last connected
+    SilcUInt32 delay_ms;            // first backoff step
+    SilcUInt32 max_delay_ms;
+    SilcDList channels;             // PySilcReconnectChannel
+    int reconnecting;               // the connection in progress is ours
+} PySilcReconnect;
+
+static SILC_TASK_CALLBACK(_pysilc_reconnect_task);
+
+static void _pysilc_reconnect_free_channel(PySilcReconnectChannel *chan)
+{
+    free(chan->name);
+    free(chan->key);
+    free(chan);
+}
+
+static void _pysilc_reconnect_free(PySilcClient *pyclient)
+{
+    PySilcReconnect *rc = pyclient->reconnect;
+    PySilcReconnectChannel *chan;
+    SilcUInt32 i;
+
+    if (!rc)
+        return;
+    if (pyclient->silcobj)
+        silc_schedule_task_del_by_all(pyclient->silcobj->schedule, 0,
+                                      _pysilc_reconnect_task, pyclient);
+    if (rc->channels) {
+        silc_dlist_start(rc->channels);
+        while ((chan = silc_dlist_get(rc->channels)) != SILC_LIST_END)
+            _pysilc_reconnect_free_channel(chan);
+        silc_dlist_uninit(rc->channels);
+    }
+    for (i = 0; i < rc->server_count; i++)
+        free(rc->servers[i].host);
+    free(rc->servers);
+    free(rc);
+    pyclient->reconnect = NULL;
+}
+
+static PySilcReconnectChannel *_pysilc_reconnect_find(PySilcReconnect *rc,
+                                                      const char *name)
+{
+    PySilcReconnectChannel *chan;
+
+    silc_dlist_start(rc->channels);
+    while ((chan = silc_dlist_get(rc->channels)) != SILC_LIST_END)
+        if (!strcasecmp(chan->name, name))
+            return chan;
+    return NULL;
+}
+
+static PySilcReconnectChannel *_pysilc_reconnect_add(PySilcReconnect *rc,
+                                                     const char *name)
+{
+    PySilcReconnectChannel *chan;
+
+    if ((chan = _pysilc_reconnect_find(rc, name)) != NULL)
+        return chan;
+    if (!(chan = calloc(1, sizeof(*chan))))
+        return NULL;
+    if (!(chan->name = strdup(name))) {
+        free(chan);
+        return NULL;
+    }
+    silc_dlist_add(rc->channels, chan);
+    return chan;
+}
+
+/* A JOIN is being sent; keeps its passphrase for the rejoin. */
+static void _pysilc_reconnect_joining(PySilcClient *pyclient,
+                                      const char *name, const char *key)
+{
+    PySilcReconnectChannel *chan;
+
+    if (!pyclient->reconnect || !name || !key)
+        return;
+    if (!(chan = _pysilc_reconnect_add(pyclient->reconnect, name)))
+        return;
+    free(chan->key);
+    chan->key = strdup(key);
+}
+
+/* Picks the passphrase out of a "JOIN <channel> [<passphrase>] ..."
+   command line given to command_call(). */
+static void _pysilc_reconnect_command(PySilcClient *pyclient,
+                                      const char *line)
+{
+    char *copy, *name, *key, *save = NULL;
+
+    if (!pyclient->reconnect || strncasecmp(line, "JOIN ", 5))
+        return;
+    if (!(copy = strdup(line + 5)))
+        return;
+    name = strtok_r(copy, " ", &save);
+    key = name ? strtok_r(NULL, " ", &save) : NULL;
+    if (key && key[0] != '-')
+        _pysilc_reconnect_joining(pyclient, name, key);
+    free(copy);
+}
+
+static void _pysilc_reconnect_joined(PySilcClient *pyclient, const char *name)
+{
+    PySilcReconnectChannel *chan;
+
+    if (!pyclient->reconnect || !name)
+        return;
+    if ((chan = _pysilc_reconnect_add(pyclient->reconnect, name)) != NULL)
+        chan->joined = 1;
+}
+
+static void _pysilc_reconnect_left(PySilcClient *pyclient, const char *name)
+{
+    PySilcReconnectChannel *chan;
+
+    if (!pyclient->reconnect || !name)
+        return;
+    if ((chan = _pysilc_reconnect_find(pyclient->reconnect, name)) != NULL) {
+        silc_dlist_del(pyclient->reconnect->channels, chan);
+        _pysilc_reconnect_free_channel(chan);
+    }
+}
+
+/* Remembers the channels the connection is already on, which come
+   with no JOIN reply: those joined before auto_reconnect() and those of
+   a resumed session. */
+static void _pysilc_reconnect_joined_all(PySilcClient *pyclient,
+                                         SilcClientConnection conn)
+{
+    SilcChannelEntry channel;
+    SilcChannelUser chu;
+    SilcHashTableList htl;
+
+    if (!conn || !conn->local_entry || !conn->local_entry->channels)
+        return;
+    silc_hash_table_list(conn->local_entry->channels, &htl);
+    while (silc_hash_table_get(&htl, (void *)&channel, (void *)&chu))
+        _pysilc_reconnect_joined(pyclient, channel->channel_name);
+    silc_hash_table_list_reset(&htl);
+}
+
+/* Called when a connection is up. Rejoins everything after our own
+   reconnects; a resumed session still has its channels. */
+static void _pysilc_reconnect_connected(PySilcClient *pyclient,
+                                        SilcClientConnection conn,
+                                        int resumed)
+{
+    PySilcReconnect *rc = pyclient->reconnect;
+    PySilcReconnectChannel *chan;
+
+    if (!rc)
+        return;
+    rc->attempt = 0;
+    if (resumed) {
+        rc->reconnecting = 0;
+        _pysilc_reconnect_joined_all(pyclient, conn);
+        return;
+    }
+    if (!rc->reconnecting)
+        return;
+    rc->reconnecting = 0;
+
+    // the replies come back in any order, nothing waits on them
+    silc_dlist_start(rc->channels);
+    while ((chan = silc_dlist_get(rc->channels)) != SILC_LIST_END)
+        if (chan->joined)
+            silc_client_command_call(pyclient->silcobj, conn, NULL, "JOIN",
+                                     chan->name, chan->key, NULL);
+}
+
+/* Called when the connection is lost or could not be made. Returns
+   TRUE if another attempt is scheduled. */
+static int _pysilc_reconnect_lost(PySilcClient *pyclient)
+{
+    PySilcReconnect *rc = pyclient->reconnect;
+    SilcUInt64 delay = 0;
+    SilcUInt32 shift;
+
+    if (!rc || !pyclient->silcobj)
+        return 0;
+
+    // a dropped connection is retried at once on the same server, each
+    // failure after that moves on and waits twice as long as the last
+    if (rc->attempt) {
+        rc->server = (rc->server + 1) % rc->server_count;
+        shift = rc->attempt - 1 < 20 ? rc->attempt - 1 : 20;
+        delay = (SilcUInt64)rc->delay_ms << shift;
+        if (delay > rc->max_delay_ms)
+            delay = rc->max_delay_ms;
+        // half fixed, half random so restarted clients spread out
+        delay = delay / 2 +
+                silc_rng_get_rn32(pyclient->silcobj->rng) % (delay / 2 + 1);
+    }
+    rc->attempt++;
+
+    silc_schedule_task_del_by_all(pyclient->silcobj->schedule, 0,
+                                  _pysilc_reconnect_task, pyclient);
+    silc_schedule_task_add_timeout(pyclient->silcobj->schedule,
+                                   _pysilc_reconnect_task, pyclient,
+                                   delay / 1000, (delay % 1000) * 1000);
+    return 1;
+}
+
+static SILC_TASK_CALLBACK(_pysilc_reconnect_task)
+{
+    PySilcClient *pyclient = (PySilcClient *)context;
+    PySilcReconnect *rc = pyclient->reconnect;
+    PySilcReconnectServer *server;
+
+    if (!rc || pyclient->silcconn)
+        return;
+
+    server = &rc->servers[rc->server];
+    rc->reconnecting = 1;
+    if (!silc_client_connect_to_server(pyclient->silcobj, &pyclient->params,
+                                       pyclient->keys->public,
+                                       pyclient->keys->private,
+                                       server->host, server->port,
+                                       pyclient->conncallback, NULL))
+        _pysilc_reconnect_lost(pyclient);
+}
+
+static int _pysilc_reconnect_servers(PySilcReconnect *rc, PyObject *servers)
+{
+    PyObject *seq, *item;
+    char *host;
+    int port;
+    Py_ssize_t count, i;
+
+    if (!(seq = PySequence_Fast(servers, "servers should be a sequence")))
+        return -1;
+    count = PySequence_Fast_GET_SIZE(seq);
+    if (!count) {
+        PyErr_SetString(PyExc_ValueError, "servers should not be empty");
+        goto error;
+    }
+    if (!(rc->servers = calloc(count, sizeof(*rc->servers)))) {
+        PyErr_NoMemory();
+        goto error;
+    }
+
+    for (i = 0; i < count; i++) {
+        item = PySequence_Fast_GET_ITEM(seq, i);
+        port = 706;
+        if (PyString_Check(item))
+            host = PyString_AS_STRING(item);
+        else if (!PyTuple_Check(item)) {
+            PyErr_SetString(PyExc_TypeError, "servers should be host names "
+                            "or (host, port) tuples");
+            goto error;
+        } else if (!PyArg_ParseTuple(item, "s|i;servers should be host names "
+                                     "or (host, port) tuples", &host, &port))
+            goto error;
+        if (!(rc->servers[i].host = strdup(host))) {
+            PyErr_NoMemory();
+            goto error;
+        }
+        rc->servers[i].port = port;
+        rc->server_count++;
+    }
+    Py_DECREF(seq);
+    return 0;
+
+error:
+    Py_DECREF(seq);
+    return -1;
+}
+
+static PyObject *pysilc_client_auto_reconnect(PyObject *self, PyObject *args,
+                                              PyObject *kwds)
+{
+    PySilcClient *pyclient = (PySilcClient *)self;
+    PySilcReconnect *rc;
+    PyObject *servers;
+    double delay = 1.0, max_delay = 60.0;
+    static char *kwlist[] = {"servers", "delay", "max_delay", NULL};
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "O|dd", kwlist, &servers,
+                                     &delay, &max_delay))
+        return NULL;
+    if (!pyclient->silcobj) {
+        PyErr_SetString(PyExc_RuntimeError, "SILC Client Not Initialised");
+        return NULL;
+    }
+    if (delay < 0 || max_delay < delay) {
+        PyErr_SetString(PyExc_ValueError,
+                        "delay should be positive and at most max_delay");
+        return NULL;
+    }
+
+    _pysilc_reconnect_free(pyclient);
+    if (servers == Py_None)
+        Py_RETURN_NONE;
+
+    if (!(rc = calloc(1, sizeof(*rc))))
+        return PyErr_NoMemory();
+    pyclient->reconnect = rc;
+    if (!(rc->channels = silc_dlist_init())) {
+        _pysilc_reconnect_free(pyclient);
+        return PyErr_NoMemory();
+    }
+    if (_pysilc_reconnect_servers(rc, servers) < 0) {
+        _pysilc_reconnect_free(pyclient);
+        return NULL;
+    }
+    rc->delay_ms = (SilcUInt32)(delay * 1000);
+    rc->max_delay_ms = (SilcUInt32)(max_delay * 1000);
+
+    // channels joined before the supervisor was enabled
+    _pysilc_reconnect_joined_all(pyclient, pyclient->silcconn);
+
+    Py_RETURN_NONE;
+}
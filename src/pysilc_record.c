@@ -0,0 +1,899 @@
+/*
+ *
+ * PySilc - Python SILC Toolkit Bindings
+ *
+ * Copyright (c) 2006, Alastair Tse <alastair@liquidx.net>
+ * Copyright (c) 2007, Martynas Venckus <martynas@altroot.org>
+ * All rights reserved.
+ *
+ * This program is free software; you can redistributed it and/or modify
+ * it under the terms of the BSD License. See LICENSE in the distribution
+ * for details or http://www.liquidx.net/pysilc/.
+ *
+ */
+
+#include "pysilc.h"
+#include <stdio.h>
+#include <time.h>
+
+/*
+ * Recording and replay of the events the toolkit delivers. The packets
+ * are decrypted and parsed inside the toolkit, so what is recorded is
+ * each event as it reached the callbacks: the entries it refers to and
+ * its arguments. Replay rebuilds those entries and calls the same
+ * callbacks, so the Python code sees the recorded traffic again.
+ *
+ * File layout, integers in network byte order:
+ *
+ *   "PYSILCR1"
+ *   records of: u8 kind, u32 usec since the previous record, u32 length,
+ *               length bytes of arguments
+ *
+ * Strings are a u32 length, including the terminating NUL, and the
+ * bytes; NULL is length 0. Entries are the encoded ID followed by their
+ * names and mode.
+ */
+
+#define PYSILC_RECORD_MAGIC       "PYSILCR1"
+#define PYSILC_RECORD_MAGIC_LEN   8
+#define PYSILC_RECORD_HEADER_LEN  9
+#define PYSILC_RECORD_MAX_LEN     (64 * 1024 * 1024)
+
+#define PYSILC_RECORD_MESSAGE     1
+#define PYSILC_RECORD_NOTIFY      2
+#define PYSILC_RECORD_REPLY       3
+
+typedef struct _PySilcRecord {
+    FILE *fp;
+    SilcUInt64 last;            // time of the previous record
+    SilcUInt64 count;
+    unsigned char *data;        // arguments of the record being built
+    SilcUInt32 len;
+    SilcUInt32 size;
+    int failed;
+} PySilcRecord;
+
+typedef struct _PySilcReplay {
+    struct SilcClientStruct client;     // only application is set
+    SilcHashTable users;                // SilcClientID -> client entry
+    SilcHashTable channels;             // SilcChannelID -> channel entry
+    struct _PySilcReplay *retired;      // earlier replays, wrappers may remain
+} PySilcReplay;
+
+typedef struct {
+    const unsigned char *data;
+    SilcUInt32 len;
+    int failed;
+} PySilcReplayReader;
+
+/* Recording */
+
+static void _pysilc_record_put(PySilcRecord *record, const void *data,
+                               SilcUInt32 len)
+{
+    unsigned char *grown;
+    SilcUInt32 size;
+
+    if (record->failed)
+        return;
+    if (record->len + len > record->size) {
+        size = record->size ? record->size : 256;
+        while (size < record->len + len)
+            size *= 2;
+        if (!(grown = realloc(record->data, size))) {
+            record->failed = 1;
+            return;
+        }
+        record->data = grown;
+        record->size = size;
+    }
+    memcpy(record->data + record->len, data, len);
+    record->len += len;
+}
+
+static void _pysilc_record_u32(PySilcRecord *record, SilcUInt32 value)
+{
+    unsigned char data[4];
+
+    SILC_PUT32_MSB(value, data);
+    _pysilc_record_put(record, data, 4);
+}
+
+static void _pysilc_record_data(PySilcRecord *record,
+                                const unsigned char *data, SilcUInt32 len)
+{
+    _pysilc_record_u32(record, len);
+    _pysilc_record_put(record, data, len);
+}
+
+static void _pysilc_record_string(PySilcRecord *record, const char *string)
+{
+    _pysilc_record_data(record, (const unsigned char *)string,
+                        string ? strlen(string) + 1 : 0);
+}
+
+static void _pysilc_record_id(PySilcRecord *record, const void *id,
+                              SilcIdType type)
+{
+    unsigned char data[PYSILC_ID_MAX_LEN];
+    SilcUInt32 len = 0;
+
+    if (!silc_id_id2str(id, type, data, sizeof(data), &len))
+        len = 0;
+    _pysilc_record_data(record, data, len);
+}
+
+static void _pysilc_record_user(PySilcRecord *record, SilcClientEntry user)
+{
+    if (!user) {
+        _pysilc_record_data(record, NULL, 0);
+        return;
+    }
+    _pysilc_record_id(record, &user->id, SILC_ID_CLIENT);
+    _pysilc_record_string(record, user->nickname);
+    _pysilc_record_string(record, user->username);
+    _pysilc_record_string(record, user->hostname);
+    _pysilc_record_string(record, user->realname);
+    _pysilc_record_u32(record, user->mode);
+}
+
+static void _pysilc_record_channel(PySilcRecord *record,
+                                   SilcChannelEntry channel)
+{
+    if (!channel) {
+        _pysilc_record_data(record, NULL, 0);
+        return;
+    }
+    _pysilc_record_id(record, &channel->id, SILC_ID_CHANNEL);
+    _pysilc_record_string(record, channel->channel_name);
+    _pysilc_record_string(record, channel->topic);
+    _pysilc_record_u32(record, channel->mode);
+}
+
+static void _pysilc_record_write(PySilcClient *pyclient, unsigned char kind)
+{
+    PySilcRecord *record = pyclient->record;
+    unsigned char header[PYSILC_RECORD_HEADER_LEN];
+    SilcUInt64 now = _pysilc_stats_now(), usec;
+
+    usec = record->last ? (now - record->last) / 1000 : 0;
+    if (usec > 0xffffffff)
+        usec = 0xffffffff;
+    record->last = now;
+
+    header[0] = kind;
+    SILC_PUT32_MSB((SilcUInt32)usec, header + 1);
+    SILC_PUT32_MSB(record->len, header + 5);
+    if (!record->failed &&
+        (fwrite(header, sizeof(header), 1, record->fp) != 1 ||
+         (record->len && fwrite(record->data, record->len, 1,
+                                record->fp) != 1)))
+        record->failed = 1;
+    if (!record->failed)
+        record->count++;
+    record->len = 0;
+}
+
+static void _pysilc_record_message(PySilcClient *pyclient,
+                                   SilcClientEntry sender,
+                                   SilcChannelEntry channel,
+                                   SilcMessageFlags flags,
+                                   const unsigned char *message,
+                                   SilcUInt32 message_len)
+{
+    PySilcRecord *record = pyclient->record;
+
+    _pysilc_record_u32(record, flags);
+    _pysilc_record_user(record, sender);
+    _pysilc_record_channel(record, channel);
+    _pysilc_record_data(record, message, message_len);
+    _pysilc_record_write(pyclient, PYSILC_RECORD_MESSAGE);
+}
+
+/* Records the notify arguments in the order the notify callback reads
+   them. Notifies that cannot be replayed are not recorded. */
+static void _pysilc_record_notify(PySilcClient *pyclient, SilcNotifyType type,
+                                  va_list va)
+{
+    PySilcRecord *record = pyclient->record;
+    SilcIdType idtype;
+    va_list args;
+    void *entry;
+
+    va_copy(args, va);
+    _pysilc_record_u32(record, type);
+    switch (type) {
+    case SILC_NOTIFY_TYPE_JOIN:
+    case SILC_NOTIFY_TYPE_LEAVE:
+        _pysilc_record_user(record, va_arg(args, SilcClientEntry));
+        _pysilc_record_channel(record, va_arg(args, SilcChannelEntry));
+        break;
+    case SILC_NOTIFY_TYPE_SIGNOFF:
+        _pysilc_record_user(record, va_arg(args, SilcClientEntry));
+        _pysilc_record_string(record, va_arg(args, char *));
+        _pysilc_record_channel(record, va_arg(args, SilcChannelEntry));
+        break;
+    case SILC_NOTIFY_TYPE_NICK_CHANGE:
+        _pysilc_record_user(record, va_arg(args, SilcClientEntry));
+        _pysilc_record_string(record, va_arg(args, char *));
+        _pysilc_record_string(record, va_arg(args, char *));
+        break;
+    case SILC_NOTIFY_TYPE_TOPIC_SET:
+        idtype = va_arg(args, int);
+        entry = va_arg(args, void *);
+        _pysilc_record_u32(record, idtype);
+        if (idtype == SILC_ID_CLIENT)
+            _pysilc_record_user(record, entry);
+        else if (idtype == SILC_ID_CHANNEL)
+            _pysilc_record_channel(record, entry);
+        _pysilc_record_string(record, va_arg(args, char *));
+        _pysilc_record_channel(record, va_arg(args, SilcChannelEntry));
+        break;
+    case SILC_NOTIFY_TYPE_KICKED:
+        _pysilc_record_user(record, va_arg(args, SilcClientEntry));
+        _pysilc_record_string(record, va_arg(args, char *));
+        _pysilc_record_user(record, va_arg(args, SilcClientEntry));
+        _pysilc_record_channel(record, va_arg(args, SilcChannelEntry));
+        break;
+    default:
+        record->len = 0;
+        va_end(args);
+        return;
+    }
+    va_end(args);
+    _pysilc_record_write(pyclient, PYSILC_RECORD_NOTIFY);
+}
+
+static void _pysilc_record_reply(PySilcClient *pyclient, SilcCommand command,
+                                 SilcStatus status, SilcStatus error,
+                                 va_list va)
+{
+    PySilcRecord *record = pyclient->record;
+    SilcChannelEntry channel;
+    SilcChannelUser user_channel;
+    SilcClientEntry user;
+    SilcHashTableList htl;
+    va_list args;
+
+    va_copy(args, va);
+    _pysilc_record_u32(record, command);
+    _pysilc_record_u32(record, status);
+    _pysilc_record_u32(record, error);
+    if (status == SILC_STATUS_OK) {
+        switch (command) {
+        case SILC_COMMAND_WHOIS:
+            _pysilc_record_user(record, va_arg(args, SilcClientEntry));
+            _pysilc_record_string(record, va_arg(args, char *));
+            _pysilc_record_string(record, va_arg(args, char *));
+            _pysilc_record_string(record, va_arg(args, char *));
+            va_arg(args, void *);
+            _pysilc_record_u32(record, va_arg(args, SilcUInt32));
+            _pysilc_record_u32(record, va_arg(args, SilcUInt32));
+            break;
+        case SILC_COMMAND_LEAVE:
+            _pysilc_record_channel(record, va_arg(args, SilcChannelEntry));
+            break;
+        case SILC_COMMAND_USERS:
+            channel = va_arg(args, SilcChannelEntry);
+            _pysilc_record_channel(record, channel);
+            if (!channel || !channel->user_list) {
+                _pysilc_record_u32(record, 0);
+                break;
+            }
+            _pysilc_record_u32(record,
+                               silc_hash_table_count(channel->user_list));
+            silc_hash_table_list(channel->user_list, &htl);
+            while (silc_hash_table_get(&htl, (void *)&user,
+                                       (void *)&user_channel)) {
+                _pysilc_record_user(record, user);
+                _pysilc_record_u32(record, user_channel->mode);
+            }
+            silc_hash_table_list_reset(&htl);
+            break;
+        default:
+            record->len = 0;
+            va_end(args);
+            return;
+        }
+    }
+    va_end(args);
+    _pysilc_record_write(pyclient, PYSILC_RECORD_REPLY);
+}
+
+static int _pysilc_record_close(PySilcClient *pyclient)
+{
+    PySilcRecord *record = pyclient->record;
+    int failed;
+
+    if (!record)
+        return 0;
+    failed = record->failed | ferror(record->fp);
+    failed |= fclose(record->fp);
+    free(record->data);
+    free(record);
+    pyclient->record = NULL;
+    return failed;
+}
+
+static PyObject *pysilc_client_record_start(PyObject *self, PyObject *args)
+{
+    PySilcClient *pyclient = (PySilcClient *)self;
+    PySilcRecord *record;
+    char *filename;
+
+    if (!PyArg_ParseTuple(args, "s", &filename))
+        return NULL;
+    if (!(record = calloc(1, sizeof(*record))))
+        return PyErr_NoMemory();
+    if (!(record->fp = fopen(filename, "wb")) ||
+        fwrite(PYSILC_RECORD_MAGIC, PYSILC_RECORD_MAGIC_LEN, 1,
+               record->fp) != 1) {
+        PyErr_SetFromErrnoWithFilename(PyExc_IOError, filename);
+        if (record->fp)
+            fclose(record->fp);
+        free(record);
+        return NULL;
+    }
+
+    _pysilc_record_close(pyclient);
+    pyclient->record = record;
+    Py_RETURN_NONE;
+}
+
+static PyObject *pysilc_client_record_stop(PyObject *self)
+{
+    PySilcClient *pyclient = (PySilcClient *)self;
+    SilcUInt64 count;
+
+    if (!pyclient->record) {
+        PyErr_SetString(PyExc_RuntimeError, "Recording Not Started");
+        return NULL;
+    }
+    count = pyclient->record->count;
+    if (_pysilc_record_close(pyclient)) {
+        PyErr_SetString(PyExc_IOError, "Unable to write the recording");
+        return NULL;
+    }
+    return PyLong_FromUnsignedLongLong(count);
+}
+
+/* Replay */
+
+static void _pysilc_replay_user_destructor(void *key, void *context,
+                                           void *user_context)
+{
+    SilcClientEntry user = (SilcClientEntry)context;
+
+    free(user->realname);
+    free(user);
+}
+
+static void _pysilc_replay_channel_destructor(void *key, void *context,
+                                              void *user_context)
+{
+    SilcChannelEntry channel = (SilcChannelEntry)context;
+
+    if (channel->user_list)
+        silc_hash_table_free(channel->user_list);
+    free(channel->channel_name);
+    free(channel->topic);
+    free(channel);
+}
+
+static void _pysilc_replay_free_one(PySilcReplay *replay)
+{
+    // channels first, their user lists point to the users
+    if (replay->channels)
+        silc_hash_table_free(replay->channels);
+    if (replay->users)
+        silc_hash_table_free(replay->users);
+    free(replay);
+}
+
+static void _pysilc_replay_free(PySilcClient *pyclient)
+{
+    PySilcReplay *replay = pyclient->replay, *retired;
+
+    while (replay) {
+        retired = replay->retired;
+        _pysilc_replay_free_one(replay);
+        replay = retired;
+    }
+    pyclient->replay = NULL;
+}
+
+/* Entries are kept after the replay, as callbacks may hold on to the
+   wrappers; those of earlier replays are retired, not freed, and go
+   with the client. */
+static PySilcReplay *_pysilc_replay_alloc(PySilcClient *pyclient)
+{
+    PySilcReplay *replay;
+
+    if (!(replay = calloc(1, sizeof(*replay))))
+        return NULL;
+    replay->client.application = pyclient;
+    replay->users = silc_hash_table_alloc(0, silc_hash_id,
+                                          SILC_32_TO_PTR(SILC_ID_CLIENT),
+                                          silc_hash_id_compare,
+                                          SILC_32_TO_PTR(SILC_ID_CLIENT),
+                                          _pysilc_replay_user_destructor,
+                                          NULL, TRUE);
+    replay->channels = silc_hash_table_alloc(0, silc_hash_id,
+                                             SILC_32_TO_PTR(SILC_ID_CHANNEL),
+                                             silc_hash_id_compare,
+                                             SILC_32_TO_PTR(SILC_ID_CHANNEL),
+                                             _pysilc_replay_channel_destructor,
+                                             NULL, TRUE);
+    if (!replay->users || !replay->channels) {
+        _pysilc_replay_free_one(replay);
+        return NULL;
+    }
+    replay->retired = pyclient->replay;
+    pyclient->replay = replay;
+    return replay;
+}
+
+static SilcUInt32 _pysilc_replay_u32(PySilcReplayReader *reader)
+{
+    SilcUInt32 value;
+
+    if (reader->failed || reader->len < 4) {
+        reader->failed = 1;
+        return 0;
+    }
+    SILC_GET32_MSB(value, reader->data);
+    reader->data += 4;
+    reader->len -= 4;
+    return value;
+}
+
+static const unsigned char *_pysilc_replay_data(PySilcReplayReader *reader,
+                                                SilcUInt32 *len)
+{
+    const unsigned char *data;
+
+    *len = _pysilc_replay_u32(reader);
+    if (reader->failed || reader->len < *len) {
+        reader->failed = 1;
+        *len = 0;
+        return NULL;
+    }
+    data = reader->data;
+    reader->data += *len;
+    reader->len -= *len;
+    return data;
+}
+
+static char *_pysilc_replay_string(PySilcReplayReader *reader)
+{
+    const unsigned char *data;
+    SilcUInt32 len;
+
+    data = _pysilc_replay_data(reader, &len);
+    if (!len)
+        return NULL;
+    if (data[len - 1] != '\0') {
+        reader->failed = 1;
+        return NULL;
+    }
+    return (char *)data;
+}
+
+static void _pysilc_replay_name(char *name, size_t size, const char *value)
+{
+    snprintf(name, size, "%s", value ? value : "");
+}
+
+static SilcClientEntry _pysilc_replay_user(PySilcReplay *replay,
+                                           PySilcReplayReader *reader)
+{
+    SilcClientEntry user;
+    const unsigned char *id_data;
+    SilcUInt32 id_len;
+    SilcClientID id;
+    char *nickname, *username, *hostname, *realname;
+    SilcUInt32 mode;
+    void *found;
+
+    id_data = _pysilc_replay_data(reader, &id_len);
+    if (!id_len)
+        return NULL;
+    nickname = _pysilc_replay_string(reader);
+    username = _pysilc_replay_string(reader);
+    hostname = _pysilc_replay_string(reader);
+    realname = _pysilc_replay_string(reader);
+    mode = _pysilc_replay_u32(reader);
+    if (reader->failed ||
+        !silc_id_str2id(id_data, id_len, SILC_ID_CLIENT, &id, sizeof(id))) {
+        reader->failed = 1;
+        return NULL;
+    }
+
+    if (silc_hash_table_find(replay->users, &id, NULL, &found))
+        user = (SilcClientEntry)found;
+    else {
+        if (!(user = calloc(1, sizeof(*user)))) {
+            reader->failed = 1;
+            return NULL;
+        }
+        user->id = id;
+        silc_hash_table_add(replay->users, &user->id, user);
+    }
+
+    // the names may have changed since the entry was first seen
+    _pysilc_replay_name(user->nickname, sizeof(user->nickname), nickname);
+    _pysilc_replay_name(user->username, sizeof(user->username), username);
+    _pysilc_replay_name(user->hostname, sizeof(user->hostname), hostname);
+    if (!user->realname || !realname || strcmp(user->realname, realname)) {
+        free(user->realname);
+        user->realname = realname ? strdup(realname) : NULL;
+    }
+    user->mode = mode;
+    return user;
+}
+
+static SilcChannelEntry _pysilc_replay_channel(PySilcReplay *replay,
+                                               PySilcReplayReader *reader)
+{
+    SilcChannelEntry channel;
+    const unsigned char *id_data;
+    SilcUInt32 id_len;
+    SilcChannelID id;
+    char *name, *topic;
+    SilcUInt32 mode;
+    void *found;
+
+    id_data = _pysilc_replay_data(reader, &id_len);
+    if (!id_len)
+        return NULL;
+    name = _pysilc_replay_string(reader);
+    topic = _pysilc_replay_string(reader);
+    mode = _pysilc_replay_u32(reader);
+    if (reader->failed ||
+        !silc_id_str2id(id_data, id_len, SILC_ID_CHANNEL, &id, sizeof(id))) {
+        reader->failed = 1;
+        return NULL;
+    }
+
+    if (silc_hash_table_find(replay->channels, &id, NULL, &found))
+        channel = (SilcChannelEntry)found;
+    else {
+        if (!(channel = calloc(1, sizeof(*channel)))) {
+            reader->failed = 1;
+            return NULL;
+        }
+        channel->id = id;
+        silc_hash_table_add(replay->channels, &channel->id, channel);
+    }
+
+    if (!channel->channel_name || strcmp(channel->channel_name,
+                                         name ? name : "")) {
+        free(channel->channel_name);
+        channel->channel_name = strdup(name ? name : "");
+    }
+    free(channel->topic);
+    channel->topic = topic ? strdup(topic) : NULL;
+    channel->mode = mode;
+    return channel;
+}
+
+static void _pysilc_replay_channel_user_destructor(void *key, void *context,
+                                                   void *user_context)
+{
+    free(context);
+}
+
+/* Rebuilds the user list of a channel as the USERS reply had it. */
+static void _pysilc_replay_users(PySilcReplay *replay,
+                                 PySilcReplayReader *reader,
+                                 SilcChannelEntry channel)
+{
+    SilcChannelUser user_channel;
+    SilcClientEntry user;
+    SilcUInt32 count, i;
+
+    count = _pysilc_replay_u32(reader);
+    if (channel->user_list)
+        silc_hash_table_free(channel->user_list);
+    channel->user_list = silc_hash_table_alloc(0, silc_hash_ptr, NULL, NULL,
+                                               NULL,
+                                               _pysilc_replay_channel_user_destructor,
+                                               NULL, TRUE);
+    if (!channel->user_list) {
+        reader->failed = 1;
+        return;
+    }
+    for (i = 0; i < count && !reader->failed; i++) {
+        user = _pysilc_replay_user(replay, reader);
+        if (!user || !(user_channel = calloc(1, sizeof(*user_channel)))) {
+            reader->failed = 1;
+            return;
+        }
+        user_channel->client = user;
+        user_channel->channel = channel;
+        user_channel->mode = _pysilc_replay_u32(reader);
+        silc_hash_table_replace(channel->user_list, user, user_channel);
+    }
+}
+
+static void _pysilc_replay_reply(PySilcReplay *replay, SilcCommand command,
+                                 SilcStatus status, SilcStatus error, ...)
+{
+    va_list va;
+
+    va_start(va, error);
+    _pysilc_client_callback_command_reply(&replay->client, NULL, command,
+                                          status, error, va);
+    va_end(va);
+}
+
+static int _pysilc_replay_notify(PySilcReplay *replay,
+                                 PySilcReplayReader *reader)
+{
+    SilcClient client = &replay->client;
+    SilcNotifyType type = _pysilc_replay_u32(reader);
+    SilcClientEntry user, other;
+    SilcChannelEntry channel;
+    SilcIdType idtype;
+    void *entry = NULL;
+    char *string, *other_string;
+
+    switch (type) {
+    case SILC_NOTIFY_TYPE_JOIN:
+    case SILC_NOTIFY_TYPE_LEAVE:
+        user = _pysilc_replay_user(replay, reader);
+        channel = _pysilc_replay_channel(replay, reader);
+        if (reader->failed)
+            return -1;
+        _pysilc_client_callback_notify(client, NULL, type, user, channel);
+        break;
+    case SILC_NOTIFY_TYPE_SIGNOFF:
+        user = _pysilc_replay_user(replay, reader);
+        string = _pysilc_replay_string(reader);
+        channel = _pysilc_replay_channel(replay, reader);
+        if (reader->failed)
+            return -1;
+        _pysilc_client_callback_notify(client, NULL, type, user, string,
+                                       channel);
+        break;
+    case SILC_NOTIFY_TYPE_NICK_CHANGE:
+        user = _pysilc_replay_user(replay, reader);
+        string = _pysilc_replay_string(reader);
+        other_string = _pysilc_replay_string(reader);
+        if (reader->failed)
+            return -1;
+        _pysilc_client_callback_notify(client, NULL, type, user, string,
+                                       other_string);
+        break;
+    case SILC_NOTIFY_TYPE_TOPIC_SET:
+        idtype = _pysilc_replay_u32(reader);
+        if (idtype == SILC_ID_CLIENT)
+            entry = _pysilc_replay_user(replay, reader);
+        else if (idtype == SILC_ID_CHANNEL)
+            entry = _pysilc_replay_channel(replay, reader);
+        string = _pysilc_replay_string(reader);
+        channel = _pysilc_replay_channel(replay, reader);
+        if (reader->failed)
+            return -1;
+        _pysilc_client_callback_notify(client, NULL, type, (int)idtype, entry,
+                                       string, channel);
+        break;
+    case SILC_NOTIFY_TYPE_KICKED:
+        user = _pysilc_replay_user(replay, reader);
+        string = _pysilc_replay_string(reader);
+        other = _pysilc_replay_user(replay, reader);
+        channel = _pysilc_replay_channel(replay, reader);
+        if (reader->failed)
+            return -1;
+        _pysilc_client_callback_notify(client, NULL, type, user, string,
+                                       other, channel);
+        break;
+    default:
+        return -1;
+    }
+    return 0;
+}
+
+static int _pysilc_replay_command_reply(PySilcReplay *replay,
+                                        PySilcReplayReader *reader)
+{
+    SilcCommand command = _pysilc_replay_u32(reader);
+    SilcStatus status = _pysilc_replay_u32(reader);
+    SilcStatus error = _pysilc_replay_u32(reader);
+    SilcClientEntry user;
+    SilcChannelEntry channel;
+    char *nickname, *username, *realname;
+    SilcUInt32 mode, idle;
+
+    if (reader->failed)
+        return -1;
+    if (status != SILC_STATUS_OK) {
+        _pysilc_replay_reply(replay, command, status, error);
+        return 0;
+    }
+
+    switch (command) {
+    case SILC_COMMAND_WHOIS:
+        user = _pysilc_replay_user(replay, reader);
+        nickname = _pysilc_replay_string(reader);
+        username = _pysilc_replay_string(reader);
+        realname = _pysilc_replay_string(reader);
+        mode = _pysilc_replay_u32(reader);
+        idle = _pysilc_replay_u32(reader);
+        if (reader->failed)
+            return -1;
+        _pysilc_replay_reply(replay, command, status, error, user, nickname,
+                             username, realname, NULL, mode, idle, NULL,
+                             NULL, NULL);
+        break;
+    case SILC_COMMAND_LEAVE:
+        channel = _pysilc_replay_channel(replay, reader);
+        if (reader->failed)
+            return -1;
+        _pysilc_replay_reply(replay, command, status, error, channel);
+        break;
+    case SILC_COMMAND_USERS:
+        channel = _pysilc_replay_channel(replay, reader);
+        if (!channel)
+            return -1;
+        _pysilc_replay_users(replay, reader, channel);
+        if (reader->failed)
+            return -1;
+        _pysilc_replay_reply(replay, command, status, error, channel);
+        break;
+    default:
+        return -1;
+    }
+    return 0;
+}
+
+static int _pysilc_replay_message(PySilcReplay *replay,
+                                  PySilcReplayReader *reader)
+{
+    SilcMessageFlags flags = _pysilc_replay_u32(reader);
+    SilcClientEntry sender = _pysilc_replay_user(replay, reader);
+    SilcChannelEntry channel = _pysilc_replay_channel(replay, reader);
+    const unsigned char *message;
+    SilcUInt32 message_len;
+
+    message = _pysilc_replay_data(reader, &message_len);
+    if (reader->failed || !sender)
+        return -1;
+
+    // signatures cannot be verified again without the payload
+    flags &= ~SILC_MESSAGE_FLAG_SIGNED;
+    if (channel)
+        _pysilc_client_callback_channel_message(&replay->client, NULL, sender,
+                                                channel, NULL, NULL, flags,
+                                                message, message_len);
+    else
+        _pysilc_client_callback_private_message(&replay->client, NULL, sender,
+                                                NULL, flags, message,
+                                                message_len);
+    return 0;
+}
+
+static void _pysilc_replay_sleep(SilcUInt64 until)
+{
+    struct timespec ts;
+    SilcUInt64 now = _pysilc_stats_now();
+
+    if (until <= now)
+        return;
+    ts.tv_sec = (until - now) / 1000000000;
+    ts.tv_nsec = (until - now) % 1000000000;
+    Py_BEGIN_ALLOW_THREADS
+    nanosleep(&ts, NULL);
+    Py_END_ALLOW_THREADS
+}
+
+static PyObject *pysilc_client_replay(PyObject *self, PyObject *args,
+                                      PyObject *kwds)
+{
+    PySilcClient *pyclient = (PySilcClient *)self;
+    unsigned char header[PYSILC_RECORD_HEADER_LEN], *data = NULL;
+    SilcUInt32 len, size = 0, usec;
+    SilcUInt64 start, elapsed, offset = 0, events = 0, skipped = 0;
+    PySilcReplayReader reader;
+    PySilcReplay *replay;
+    double speed = 0.0, seconds;
+    char *filename;
+    int failed = 0, status;
+    FILE *fp;
+
+    static char *kwlist[] = {"filename", "speed", NULL};
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "s|d", kwlist,
+                                     &filename, &speed))
+        return NULL;
+    if (speed < 0) {
+        PyErr_SetString(PyExc_ValueError, "speed should not be negative");
+        return NULL;
+    }
+
+    if (!(fp = fopen(filename, "rb")))
+        return PyErr_SetFromErrnoWithFilename(PyExc_IOError, filename);
+    if (fread(header, PYSILC_RECORD_MAGIC_LEN, 1, fp) != 1 ||
+        memcmp(header, PYSILC_RECORD_MAGIC, PYSILC_RECORD_MAGIC_LEN)) {
+        fclose(fp);
+        PyErr_SetString(PyExc_ValueError, "Not a pysilc recording");
+        return NULL;
+    }
+    if (!(replay = _pysilc_replay_alloc(pyclient))) {
+        fclose(fp);
+        return PyErr_NoMemory();
+    }
+
+    start = _pysilc_stats_now();
+    while (fread(header, sizeof(header), 1, fp) == 1) {
+        SILC_GET32_MSB(usec, header + 1);
+        SILC_GET32_MSB(len, header + 5);
+        if (len > PYSILC_RECORD_MAX_LEN) {
+            failed = 1;
+            break;
+        }
+        if (len > size) {
+            free(data);
+            if (!(data = malloc(len))) {
+                fclose(fp);
+                return PyErr_NoMemory();
+            }
+            size = len;
+        }
+        if (len && fread(data, len, 1, fp) != 1) {
+            failed = 1;
+            break;
+        }
+
+        // speed 0 replays as fast as the callbacks go
+        offset += usec;
+        if (speed > 0)
+            _pysilc_replay_sleep(start + (SilcUInt64)(offset * 1000 / speed));
+
+        reader.data = data;
+        reader.len = len;
+        reader.failed = 0;
+        switch (header[0]) {
+        case PYSILC_RECORD_MESSAGE:
+            status = _pysilc_replay_message(replay, &reader);
+            break;
+        case PYSILC_RECORD_NOTIFY:
+            status = _pysilc_replay_notify(replay, &reader);
+            break;
+        case PYSILC_RECORD_REPLY:
+            status = _pysilc_replay_command_reply(replay, &reader);
+            break;
+        default:
+            status = -1;
+            break;
+        }
+        if (status < 0)
+            skipped++;
+        else
+            events++;
+        // no scheduler runs here to make the prioritized calls
+        if (pyclient->queue)
+            _pysilc_queue_drain(pyclient, 0);
+
+        if (!(events & 1023) && PyErr_CheckSignals() < 0) {
+            free(data);
+            fclose(fp);
+            return NULL;
+        }
+    }
+    elapsed = _pysilc_stats_now() - start;
+    failed |= ferror(fp);
+    fclose(fp);
+    free(data);
+
+    if (failed) {
+        PyErr_SetString(PyExc_ValueError, "Truncated or corrupt recording");
+        return NULL;
+    }
+    seconds = elapsed / 1e9;
+    return Py_BuildValue("{s:K,s:K,s:d,s:d}",
+                         "events", events,
+                         "skipped", skipped,
+                         "seconds", seconds,
+                         "events_per_sec", seconds > 0 ? events / seconds : 0.0);
+}
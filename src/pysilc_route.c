@@ -0,0 +1,168 @@
+/*
+ *
+ * PySilc - Python SILC Toolkit Bindings
+ *
+ * Copyright (c) 2006, Alastair Tse <alastair@liquidx.net>
+ * Copyright (c) 2007, Martynas Venckus <martynas@altroot.org>
+ * All rights reserved.
+ *
+ * This program is free software; you can redistributed it and/or modify
+ * it under the terms of the BSD License. See LICENSE in the distribution
+ * for details or http://www.liquidx.net/pysilc/.
+ *
+ */
+
+#include "pysilc.h"
+
+/*
+ * Message routing. on_channel_message() and on_private_message() give a
+ * channel or a user a handler of its own, looked up by channel or client
+ * id in the message callbacks, so bots need no dispatch on the channel
+ * name in Python. Messages of channels and users without a handler go to
+ * channel_message and private_message as before; with those unset they
+ * never reach Python at all.
+ */
+
+typedef struct _PySilcRoutes {
+    SilcHashTable channels;     // SilcChannelID -> handler
+    SilcHashTable users;        // SilcClientID -> handler
+} PySilcRoutes;
+
+static void _pysilc_route_destructor(void *key, void *context,
+                                     void *user_context)
+{
+    silc_free(key);
+    Py_DECREF((PyObject *)context);
+}
+
+static PySilcRoutes *_pysilc_route_init(PySilcClient *pyclient)
+{
+    PySilcRoutes *routes;
+
+    if (pyclient->routes)
+        return pyclient->routes;
+    if (!(routes = calloc(1, sizeof(*routes))))
+        return NULL;
+    routes->channels = silc_hash_table_alloc(0, silc_hash_id,
+                                             SILC_32_TO_PTR(SILC_ID_CHANNEL),
+                                             silc_hash_id_compare,
+                                             SILC_32_TO_PTR(SILC_ID_CHANNEL),
+                                             _pysilc_route_destructor,
+                                             NULL, TRUE);
+    routes->users = silc_hash_table_alloc(0, silc_hash_id,
+                                          SILC_32_TO_PTR(SILC_ID_CLIENT),
+                                          silc_hash_id_compare,
+                                          SILC_32_TO_PTR(SILC_ID_CLIENT),
+                                          _pysilc_route_destructor,
+                                          NULL, TRUE);
+    if (!routes->channels || !routes->users) {
+        if (routes->channels)
+            silc_hash_table_free(routes->channels);
+        if (routes->users)
+            silc_hash_table_free(routes->users);
+        free(routes);
+        return NULL;
+    }
+    pyclient->routes = routes;
+    return routes;
+}
+
+static void _pysilc_route_free(PySilcClient *pyclient)
+{
+    PySilcRoutes *routes = pyclient->routes;
+
+    if (!routes)
+        return;
+    pyclient->routes = NULL;
+    silc_hash_table_free(routes->channels);
+    silc_hash_table_free(routes->users);
+    free(routes);
+}
+
+/* The handler of the channel, borrowed, or NULL. */
+static PyObject *_pysilc_route_channel(PySilcClient *pyclient,
+                                       SilcChannelEntry channel)
+{
+    PyObject *handler;
+
+    if (!pyclient->routes || !channel ||
+        !silc_hash_table_find(pyclient->routes->channels, &channel->id,
+                              NULL, (void **)&handler))
+        return NULL;
+    return handler;
+}
+
+/* The handler of the sender, borrowed, or NULL. */
+static PyObject *_pysilc_route_user(PySilcClient *pyclient,
+                                    SilcClientEntry sender)
+{
+    PyObject *handler;
+
+    if (!pyclient->routes || !sender ||
+        !silc_hash_table_find(pyclient->routes->users, &sender->id,
+                              NULL, (void **)&handler))
+        return NULL;
+    return handler;
+}
+
+/* Sets or, with None, removes the handler under a copy of the id. */
+static PyObject *_pysilc_route_set(SilcHashTable table, void *id,
+                                   SilcUInt32 id_len, PyObject *handler)
+{
+    void *key;
+
+    if (handler != Py_None && !PyCallable_Check(handler)) {
+        PyErr_SetString(PyExc_TypeError, "handler should be callable or None");
+        return NULL;
+    }
+
+    silc_hash_table_del(table, id);
+    if (handler == Py_None)
+        Py_RETURN_NONE;
+
+    if (!(key = silc_memdup(id, id_len)))
+        return PyErr_NoMemory();
+    Py_INCREF(handler);
+    silc_hash_table_add(table, key, handler);
+    Py_RETURN_NONE;
+}
+
+static PyObject *pysilc_client_on_channel_message(PyObject *self,
+                                                  PyObject *args)
+{
+    PySilcClient *pyclient = (PySilcClient *)self;
+    PySilcChannel *channel;
+    PyObject *handler;
+
+    if (!PyArg_ParseTuple(args, "O!O", &PySilcChannel_Type, &channel,
+                          &handler))
+        return NULL;
+    if (!channel->silcobj) {
+        PyErr_SetString(PyExc_RuntimeError, "SilcChannel has no entry");
+        return NULL;
+    }
+    if (!_pysilc_route_init(pyclient))
+        return PyErr_NoMemory();
+    return _pysilc_route_set(pyclient->routes->channels,
+                             &channel->silcobj->id,
+                             sizeof(channel->silcobj->id), handler);
+}
+
+static PyObject *pysilc_client_on_private_message(PyObject *self,
+                                                  PyObject *args)
+{
+    PySilcClient *pyclient = (PySilcClient *)self;
+    PySilcUser *user;
+    PyObject *handler;
+
+    if (!PyArg_ParseTuple(args, "O!O", &PySilcUser_Type, &user, &handler))
+        return NULL;
+    if (!user->silcobj) {
+        PyErr_SetString(PyExc_RuntimeError, "SilcUser has no entry");
+        return NULL;
+    }
+    if (!_pysilc_route_init(pyclient))
+        return PyErr_NoMemory();
+    return _pysilc_route_set(pyclient->routes->users, &user->silcobj->id,
+                             sizeof(user->silcobj->id), handler);
+}
@@ -0,0 +1,178 @@
+/*
+ *
+ * PySilc - Python SILC Toolkit Bindings
+ *
+ * Copyright (c) 2006, Alastair Tse <alastair@liquidx.net>
+ * Copyright (c) 2007, Martynas Venckus <martynas@altroot.org>
+ * All rights reserved.
+ *
+ * This program is free software; you can redistributed it and/or modify
+ * it under the terms of the BSD License. See LICENSE in the distribution
+ * for details or http://www.liquidx.net/pysilc/.
+ *
+ */
+
+#include "pysilc.h"
+
+// Bound on the signer key cache. When full it is simply emptied, as the
+// keys are re-learnt from the next signed message of each sender.
+#define PYSILC_SIGNER_CACHE_MAX 4096
+
+static void _pysilc_signer_cache_destructor(void *key, void *context,
+                                            void *user_context)
+{
+    silc_free(key);
+    silc_pkcs_public_key_free((SilcPublicKey)context);
+}
+
+static int _pysilc_signed_init(PySilcClient *pyclient)
+{
+    if (!silc_hash_alloc((unsigned char *)"sha1", &pyclient->sign_hash))
+        return -1;
+
+    // maps client id to the public key that verified its last message
+    pyclient->signer_keys = silc_hash_table_alloc(0, silc_hash_id,
+                                                  SILC_32_TO_PTR(SILC_ID_CLIENT),
+                                                  silc_hash_id_compare,
+                                                  SILC_32_TO_PTR(SILC_ID_CLIENT),
+                                                  _pysilc_signer_cache_destructor,
+                                                  NULL, TRUE);
+    if (!pyclient->signer_keys)
+        return -1;
+    return 0;
+}
+
+static void _pysilc_signed_free(PySilcClient *pyclient)
+{
+    if (pyclient->signer_keys)
+        silc_hash_table_free(pyclient->signer_keys);
+    if (pyclient->sign_hash)
+        silc_hash_free(pyclient->sign_hash);
+    pyclient->signer_keys = NULL;
+    pyclient->sign_hash = NULL;
+}
+
+static void _pysilc_signer_cache_add(PySilcClient *pyclient,
+                                     SilcClientEntry sender,
+                                     SilcPublicKey public_key)
+{
+    SilcClientID *id;
+
+    if (silc_hash_table_count(pyclient->signer_keys) >= PYSILC_SIGNER_CACHE_MAX) {
+        silc_hash_table_free(pyclient->signer_keys);
+        pyclient->signer_keys = NULL;
+        if (_pysilc_signed_init(pyclient) < 0) {
+            silc_pkcs_public_key_free(public_key);
+            return;
+        }
+    }
+
+    if (!(id = silc_malloc(sizeof(*id)))) {
+        silc_pkcs_public_key_free(public_key);
+        return;
+    }
+    *id = sender->id;
+    silc_hash_table_replace(pyclient->signer_keys, id, public_key);
+}
+
+/* Whether a key the sender supplied itself is trusted: by the trust
+   store under the sender's nickname, or else by verify_public_key. */
+static int _pysilc_signed_key_trusted(PySilcClient *pyclient,
+                                      SilcClientEntry sender,
+                                      SilcPublicKey public_key)
+{
+    PyObject *callback = NULL, *args = NULL, *result = NULL;
+    unsigned char fingerprint[PYSILC_TRUST_HASH_LEN];
+    const char *name = sender->nickname;
+    int status = PYSILC_TRUST_UNKNOWN, trusted = 0;
+
+    if (_pysilc_public_key_fingerprint(public_key, fingerprint) < 0)
+        return 0;
+
+    if (pyclient->trust_store &&
+        PyObject_TypeCheck(pyclient->trust_store, &PySilcTrustStore_Type)) {
+        status = _pysilc_trust_lookup((PySilcTrustStore *)pyclient->trust_store,
+                                      name, fingerprint);
+        if (status == PYSILC_TRUST_TRUSTED)
+            return 1;
+    }
+
+    // unlike server keys, nothing is trusted by default
+    callback = PyObject_GetAttrString((PyObject *)pyclient, "verify_public_key");
+    if (!callback || !PyCallable_Check(callback))
+        goto cleanup;
+    if (!(args = Py_BuildValue("(siis#i)", name, 0, SILC_CONN_CLIENT,
+                               fingerprint, PYSILC_TRUST_HASH_LEN, status)))
+        goto cleanup;
+    if ((result = _pysilc_stats_call(pyclient, PYSILC_STAT_VERIFY_PUBLIC_KEY,
+                                     callback, args)) == 0) {
+        PyErr_Print();
+        goto cleanup;
+    }
+    trusted = PyObject_IsTrue(result) == 1;
+
+cleanup:
+    PyErr_Clear();
+    Py_XDECREF(callback);
+    Py_XDECREF(args);
+    Py_XDECREF(result);
+    return trusted;
+}
+
+/* Verifies a signed message and returns the pysilc flag bits to add to
+   the message flags. Keys are looked for in order: the cache, the client
+   entry and finally the key carried in the signature payload, which is
+   the only one that has to be decoded. A payload key is only cached
+   once it is known to be the sender's. */
+static SilcUInt32 _pysilc_signed_verify(PySilcClient *pyclient,
+                                        SilcClientEntry sender,
+                                        SilcMessagePayload payload,
+                                        SilcMessageFlags flags)
+{
+    SilcPublicKey public_key = NULL;
+    const unsigned char *pk_data;
+    SilcUInt32 pk_data_len;
+    void *cached;
+
+    if (!(flags & SILC_MESSAGE_FLAG_SIGNED) || !pyclient->verify_signatures ||
+        !payload || !sender || !pyclient->signer_keys)
+        return 0;
+
+    if (silc_hash_table_find(pyclient->signer_keys, &sender->id, NULL, &cached) &&
+        silc_message_signed_verify(payload, (SilcPublicKey)cached,
+                                   pyclient->sign_hash) == SILC_AUTH_OK)
+        return PYSILC_MESSAGE_SIGNATURE_VERIFIED;
+
+    if (sender->public_key &&
+        silc_message_signed_verify(payload, sender->public_key,
+                                   pyclient->sign_hash) == SILC_AUTH_OK)
+        return PYSILC_MESSAGE_SIGNATURE_VERIFIED;
+
+    public_key = silc_message_signed_get_public_key(payload, &pk_data,
+                                                    &pk_data_len);
+    if (!public_key)
+        return PYSILC_MESSAGE_SIGNATURE_FAILED;
+
+    // the key in the payload must be the one the sender registered with
+    if (sender->public_key &&
+        !silc_pkcs_public_key_compare(public_key, sender->public_key)) {
+        silc_pkcs_public_key_free(public_key);
+        return PYSILC_MESSAGE_SIGNATURE_FAILED;
+    }
+
+    if (silc_message_signed_verify(payload, public_key,
+                                   pyclient->sign_hash) != SILC_AUTH_OK) {
+        silc_pkcs_public_key_free(public_key);
+        return PYSILC_MESSAGE_SIGNATURE_FAILED;
+    }
+
+    // a key the message brings along proves nothing on its own
+    if (!sender->public_key &&
+        !_pysilc_signed_key_trusted(pyclient, sender, public_key)) {
+        silc_pkcs_public_key_free(public_key);
+        return PYSILC_MESSAGE_SIGNATURE_UNVERIFIED;
+    }
+
+    _pysilc_signer_cache_add(pyclient, sender, public_key);
+    return PYSILC_MESSAGE_SIGNATURE_VERIFIED;
+}
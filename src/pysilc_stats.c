@@ -0,0 +1,231 @@
+/*
+ *
+ * PySilc - Python SILC Toolkit Bindings
+ *
+ * Copyright (c) 2006, Alastair Tse <alastair@liquidx.net>
+ * Copyright (c) 2007, Martynas Venckus <martynas@altroot.org>
+ * All rights reserved.
+ *
+ * This program is free software; you can redistributed it and/or modify
+ * it under the terms of the BSD License. See LICENSE in the distribution
+ * for details or http://www.liquidx.net/pysilc/.
+ *
+ */
+
+#include "pysilc.h"
+#include <time.h>
+
+/*
+ * Callback statistics. Every Python callback goes through
+ * _pysilc_stats_call, which costs two clock reads and a few additions
+ * per call, so collection is left on by default.
+ */
+
+static const char *_pysilc_stats_names[PYSILC_STAT_MAX] = {
+    "running", "connected", "disconnected", "failure", "say", "command",
+    "channel_message", "private_message", "notify_none", "notify_invite",
+    "notify_join", "notify_leave", "notify_signoff", "notify_topic_set",
+    "notify_nick_change", "notify_cmode_change", "notify_cumode_change",
+    "notify_motd", "notify_channel_change", "notify_server_signoff",
+    "notify_kicked", "notify_killed", "notify_error", "notify_watch",
+    "command_reply_whois", "command_reply_whowas", "command_reply_identify",
+    "command_reply_nick", "command_reply_list", "command_reply_topic",
+    "command_reply_invite", "command_reply_kill", "command_reply_info",
+    "command_reply_stats", "command_reply_ping", "command_reply_oper",
+    "command_reply_join", "command_reply_motd", "command_reply_cmode",
+    "command_reply_cumode", "command_reply_kick", "command_reply_ban",
+    "command_reply_detach", "command_reply_watch", "command_reply_silcoper",
+    "command_reply_leave", "command_reply_users", "command_reply_service",
+    "command_reply_failed", "verify_public_key", "ask_passphrase",
+    "key_agreement", "key_agreement_completed", "ftp", "file_monitor",
+    "file_ask_name", "notify_join_batch", "notify_leave_batch",
+    "notify_signoff_batch",
+};
+
+static SilcUInt64 _pysilc_stats_now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (SilcUInt64)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+// called on entry of every toolkit callback
+static void _pysilc_stats_enter(PySilcClient *pyclient)
+{
+    if (pyclient->stats_enabled || pyclient->trace)
+        pyclient->stats_entered = _pysilc_stats_now();
+}
+
+static void _pysilc_trace_record(PySilcClient *pyclient,
+                                 PySilcStatEvent event, SilcUInt64 entered,
+                                 SilcUInt64 start, SilcUInt64 end, int error);
+
+static int _pysilc_stats_bucket(SilcUInt64 ns)
+{
+    SilcUInt64 usec = ns / 1000;
+    int bucket = 0;
+
+    while (usec && bucket < PYSILC_STAT_BUCKETS - 1) {
+        usec >>= 1;
+        bucket++;
+    }
+    return bucket;
+}
+
+/* Calls a Python callback and accounts it to 'event'. Returns the result
+   of the call like PyObject_CallObject; callers still print the error. */
+static PyObject *_pysilc_stats_call(PySilcClient *pyclient,
+                                    PySilcStatEvent event,
+                                    PyObject *callback, PyObject *args)
+{
+    PySilcStat *stat = &pyclient->stats[event];
+    SilcUInt64 entered, start, elapsed;
+    PyObject *result;
+
+    if (!pyclient->stats_enabled && !pyclient->trace)
+        return PyObject_CallObject(callback, args);
+
+    entered = pyclient->stats_entered;
+    start = _pysilc_stats_now();
+
+    result = PyObject_CallObject(callback, args);
+
+    // a later callback from the same event starts counting from here
+    pyclient->stats_entered = _pysilc_stats_now();
+    elapsed = pyclient->stats_entered - start;
+
+    if (pyclient->trace)
+        _pysilc_trace_record(pyclient, event, entered, start,
+                             pyclient->stats_entered, result == NULL);
+    if (!pyclient->stats_enabled)
+        return result;
+
+    if (entered && start > entered)
+        stat->native_ns += start - entered;
+
+    stat->calls++;
+    if (!result)
+        stat->errors++;
+    stat->python_ns += elapsed;
+    if (elapsed > stat->python_max_ns)
+        stat->python_max_ns = elapsed;
+    stat->histogram[_pysilc_stats_bucket(elapsed)]++;
+    pyclient->stats_python_ns += elapsed;
+    return result;
+}
+
+static PyObject *_pysilc_stats_event(PySilcStat *stat)
+{
+    PyObject *histogram, *item;
+    int i, last;
+
+    // trailing empty buckets are left out
+    for (last = PYSILC_STAT_BUCKETS - 1; last > 0; last--)
+        if (stat->histogram[last])
+            break;
+    if (!(histogram = PyList_New(last + 1)))
+        return NULL;
+    for (i = 0; i <= last; i++) {
+        if (!(item = PyLong_FromUnsignedLong(stat->histogram[i]))) {
+            Py_DECREF(histogram);
+            return NULL;
+        }
+        PyList_SET_ITEM(histogram, i, item);
+    }
+
+    return Py_BuildValue("{s:K,s:K,s:d,s:d,s:d,s:N}",
+                         "calls", (unsigned PY_LONG_LONG)stat->calls,
+                         "errors", (unsigned PY_LONG_LONG)stat->errors,
+                         "python_time", stat->python_ns / 1e9,
+                         "python_max", stat->python_max_ns / 1e9,
+                         "native_time", stat->native_ns / 1e9,
+                         "histogram", histogram);
+}
+
+static PyObject *pysilc_client_stats(PyObject *self, PyObject *args,
+                                     PyObject *kwds)
+{
+    PySilcClient *pyclient = (PySilcClient *)self;
+    PyObject *stats, *event;
+    int i, reset = 0;
+    SilcUInt64 native;
+
+    static char *kwlist[] = {"reset", NULL};
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "|i", kwlist, &reset))
+        return NULL;
+    if (!(stats = PyDict_New()))
+        return NULL;
+
+    for (i = 0; i < PYSILC_STAT_MAX; i++) {
+        if (!pyclient->stats[i].calls)
+            continue;
+        if (!(event = _pysilc_stats_event(&pyclient->stats[i])) ||
+            PyDict_SetItemString(stats, _pysilc_stats_names[i], event) < 0) {
+            Py_XDECREF(event);
+            Py_DECREF(stats);
+            return NULL;
+        }
+        Py_DECREF(event);
+    }
+
+    native = pyclient->stats_loop_ns > pyclient->stats_python_ns ?
+             pyclient->stats_loop_ns - pyclient->stats_python_ns : 0;
+    if (!(event = Py_BuildValue("{s:K,s:d,s:d}",
+                                "calls",
+                                (unsigned PY_LONG_LONG)pyclient->stats_loop_calls,
+                                "time", pyclient->stats_loop_ns / 1e9,
+                                "native_time", native / 1e9)) ||
+        PyDict_SetItemString(stats, "loop", event) < 0) {
+        Py_XDECREF(event);
+        Py_DECREF(stats);
+        return NULL;
+    }
+    Py_DECREF(event);
+
+    if (reset) {
+        memset(pyclient->stats, 0, sizeof(pyclient->stats));
+        pyclient->stats_loop_calls = 0;
+        pyclient->stats_loop_ns = 0;
+        pyclient->stats_python_ns = 0;
+    }
+    return stats;
+}
+
+static PyObject *pysilc_live_objects(PyObject *mod)
+{
+#ifdef PYSILC_ACCOUNTING
+    static const char *names[PYSILC_LIVE_MAX] = {
+        "SilcUser", "SilcChannel", "SilcID", "SilcKeys",
+        "SilcChannelPrivateKey", "client_entry_refs",
+    };
+    PyObject *live, *count;
+    int i;
+
+    if (!(live = PyDict_New()))
+        return NULL;
+    for (i = 0; i < PYSILC_LIVE_MAX; i++) {
+        if (!(count = PyInt_FromLong(pysilc_live[i])) ||
+            PyDict_SetItemString(live, names[i], count) < 0) {
+            Py_XDECREF(count);
+            Py_DECREF(live);
+            return NULL;
+        }
+        Py_DECREF(count);
+    }
+#ifdef Py_REF_DEBUG
+    if (!(count = PyInt_FromSsize_t(_Py_GetRefTotal())) ||
+        PyDict_SetItemString(live, "refs", count) < 0) {
+        Py_XDECREF(count);
+        Py_DECREF(live);
+        return NULL;
+    }
+    Py_DECREF(count);
+#endif
+    return live;
+#else
+    PyErr_SetString(PyExc_RuntimeError,
+                    "pysilc was built without PYSILC_ACCOUNTING");
+    return NULL;
+#endif
+}
@@ -0,0 +1,185 @@
+/*
+ *
+ * PySilc - Python SILC Toolkit Bindings
+ *
+ * Copyright (c) 2006, Alastair Tse <alastair@liquidx.net>
+ * Copyright (c) 2007, Martynas Venckus <martynas@altroot.org>
+ * All rights reserved.
+ *
+ * This program is free software; you can redistributed it and/or modify
+ * it under the terms of the BSD License. See LICENSE in the distribution
+ * for details or http://www.liquidx.net/pysilc/.
+ *
+ */
+
+#include "pysilc.h"
+#include <stdio.h>
+
+/*
+ * Callback tracing. While enabled every Python callback appends one
+ * fixed-size record to a ring buffer; nothing is formatted until
+ * trace_dump. When disabled the cost is the NULL check of client->trace.
+ *
+ * The toolkit reads and decrypts packets inside run_one before it calls
+ * us, so the read and decrypt times are bounded by the run_one start and
+ * the callback entry.
+ */
+
+#define PYSILC_TRACE_DEFAULT_SIZE 65536
+#define PYSILC_TRACE_MAX_SIZE     (16 * 1024 * 1024)
+
+typedef struct {
+    SilcUInt64 loop;        // run_one started, the packet is read after this
+    SilcUInt64 entered;     // toolkit delivered the decrypted event
+    SilcUInt64 start;       // arguments built, Python callback called
+    SilcUInt64 end;         // Python callback returned
+    SilcUInt16 event;
+    SilcUInt16 error;
+} PySilcTraceRecord;
+
+typedef struct _PySilcTrace {
+    SilcUInt32 size;
+    SilcUInt32 next;
+    SilcUInt64 total;       // records ever written
+    PySilcTraceRecord records[1];
+} PySilcTrace;
+
+static void _pysilc_trace_record(PySilcClient *pyclient,
+                                 PySilcStatEvent event, SilcUInt64 entered,
+                                 SilcUInt64 start, SilcUInt64 end, int error)
+{
+    PySilcTrace *trace = pyclient->trace;
+    PySilcTraceRecord *record = &trace->records[trace->next];
+
+    record->loop = pyclient->stats_loop_started;
+    record->entered = entered ? entered : start;
+    record->start = start;
+    record->end = end;
+    record->event = event;
+    record->error = error;
+
+    if (++trace->next == trace->size)
+        trace->next = 0;
+    trace->total++;
+}
+
+static void _pysilc_trace_free(PySilcClient *pyclient)
+{
+    free(pyclient->trace);
+    pyclient->trace = NULL;
+}
+
+static PyObject *pysilc_client_trace_start(PyObject *self, PyObject *args,
+                                           PyObject *kwds)
+{
+    PySilcClient *pyclient = (PySilcClient *)self;
+    unsigned int size = PYSILC_TRACE_DEFAULT_SIZE;
+    PySilcTrace *trace;
+
+    static char *kwlist[] = {"size", NULL};
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "|I", kwlist, &size))
+        return NULL;
+    if (!size || size > PYSILC_TRACE_MAX_SIZE) {
+        PyErr_SetString(PyExc_ValueError, "trace size out of range");
+        return NULL;
+    }
+
+    trace = calloc(1, sizeof(PySilcTrace) +
+                      (size - 1) * sizeof(PySilcTraceRecord));
+    if (!trace)
+        return PyErr_NoMemory();
+    trace->size = size;
+
+    _pysilc_trace_free(pyclient);
+    pyclient->trace = trace;
+    Py_RETURN_NONE;
+}
+
+static PyObject *pysilc_client_trace_stop(PyObject *self)
+{
+    _pysilc_trace_free((PySilcClient *)self);
+    Py_RETURN_NONE;
+}
+
+static void _pysilc_trace_span(FILE *fp, int *first, const char *name,
+                               const char *cat, SilcUInt64 from,
+                               SilcUInt64 to, SilcUInt64 base,
+                               const char *extra)
+{
+    if (from < base)
+        from = base;
+    if (to < from)
+        to = from;
+    fprintf(fp, "%s\n{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\","
+            "\"pid\":1,\"tid\":1,\"ts\":%.3f,\"dur\":%.3f%s}",
+            *first ? "" : ",", name, cat, (from - base) / 1e3,
+            (to - from) / 1e3, extra);
+    *first = 0;
+}
+
+static PyObject *pysilc_client_trace_dump(PyObject *self, PyObject *args)
+{
+    PySilcClient *pyclient = (PySilcClient *)self;
+    PySilcTraceRecord *records, *r;
+    SilcUInt32 count, first_index, i;
+    SilcUInt64 base, loop = 0;
+    int first = 1, failed;
+    char *filename;
+    FILE *fp;
+
+    if (!PyArg_ParseTuple(args, "s", &filename))
+        return NULL;
+    if (!pyclient->trace) {
+        PyErr_SetString(PyExc_RuntimeError, "Tracing Not Started");
+        return NULL;
+    }
+
+    // copy oldest first, so recording can go on while the file is written
+    count = pyclient->trace->total < pyclient->trace->size ?
+            (SilcUInt32)pyclient->trace->total : pyclient->trace->size;
+    first_index = count < pyclient->trace->size ? 0 : pyclient->trace->next;
+    if (!(records = malloc((count ? count : 1) * sizeof(*records))))
+        return PyErr_NoMemory();
+    for (i = 0; i < count; i++)
+        records[i] = pyclient->trace->records[(first_index + i) %
+                                              pyclient->trace->size];
+
+    Py_BEGIN_ALLOW_THREADS
+    if ((fp = fopen(filename, "w")) != NULL) {
+        // prioritized calls are recorded out of arrival order, so the
+        // first record need not hold the earliest time
+        base = 0;
+        for (i = 0; i < count; i++) {
+            r = &records[i];
+            if (r->loop && (!base || r->loop < base))
+                base = r->loop;
+            if (r->entered && (!base || r->entered < base))
+                base = r->entered;
+        }
+        fprintf(fp, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[");
+        for (i = 0; i < count; i++) {
+            r = &records[i];
+            // one read span per run_one, before its first callback
+            if (r->loop && r->loop != loop && r->loop <= r->entered)
+                _pysilc_trace_span(fp, &first, "read", "native", r->loop,
+                                   r->entered, base, "");
+            loop = r->loop;
+            _pysilc_trace_span(fp, &first, "decode", "native", r->entered,
+                               r->start, base, "");
+            _pysilc_trace_span(fp, &first, _pysilc_stats_names[r->event],
+                               "python", r->start, r->end, base,
+                               r->error ? ",\"args\":{\"error\":true}" : "");
+        }
+        fprintf(fp, "\n]}\n");
+        failed = ferror(fp) | fclose(fp);
+    }
+    else
+        failed = 1;
+    Py_END_ALLOW_THREADS
+
+    free(records);
+    if (failed)
+        return PyErr_SetFromErrnoWithFilename(PyExc_IOError, filename);
+    return PyInt_FromLong(count);
+}
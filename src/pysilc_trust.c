@@ -0,0 +1,423 @@
+/*
+ *
+ * PySilc - Python SILC Toolkit Bindings
+ *
+ * Copyright (c) 2006, Alastair Tse <alastair@liquidx.net>
+ * Copyright (c) 2007, Martynas Venckus <martynas@altroot.org>
+ * All rights reserved.
+ *
+ * This program is free software; you can redistributed it and/or modify
+ * it under the terms of the BSD License. See LICENSE in the distribution
+ * for details or http://www.liquidx.net/pysilc/.
+ *
+ */
+
+#include "pysilc.h"
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/*
+ * Trust store file layout, all integers MSB first:
+ *
+ *   "PYSILCTS"                      8 bytes magic
+ *   version                         4 bytes
+ *   record count                    4 bytes
+ *   records                         count * 40 bytes
+ *
+ * Each record is the SHA-1 of the name (host or user) followed by the
+ * SHA-1 fingerprint of the encoded public key. Records are sorted so a
+ * lookup is a binary search over the mapped file and nothing is copied.
+ */
+
+#define PYSILC_TRUST_MAGIC       "PYSILCTS"
+#define PYSILC_TRUST_VERSION     1
+#define PYSILC_TRUST_HEADER_LEN  16
+#define PYSILC_TRUST_HASH_LEN    20
+#define PYSILC_TRUST_RECORD_LEN  (PYSILC_TRUST_HASH_LEN * 2)
+
+static void _pysilc_trust_unmap(PySilcTrustStore *store)
+{
+    if (store->map)
+        munmap(store->map, store->map_len);
+    store->map = NULL;
+    store->map_len = 0;
+    store->records = NULL;
+    store->count = 0;
+}
+
+/* Maps the current file in place of the mapped one. On failure the old
+   mapping stays, so a bad rewrite does not forget every key. */
+static int _pysilc_trust_map(PySilcTrustStore *store)
+{
+    struct stat st;
+    unsigned char *map;
+    SilcUInt32 version, count;
+    int fd;
+
+    if ((fd = open(store->path, O_RDONLY)) < 0) {
+        // a missing store is an empty store
+        if (errno == ENOENT) {
+            _pysilc_trust_unmap(store);
+            store->mtime = 0;
+            store->ino = 0;
+            return 0;
+        }
+        PyErr_SetFromErrnoWithFilename(PyExc_IOError, store->path);
+        return -1;
+    }
+    if (fstat(fd, &st) < 0) {
+        close(fd);
+        PyErr_SetFromErrnoWithFilename(PyExc_IOError, store->path);
+        return -1;
+    }
+    if (st.st_size == 0) {
+        close(fd);
+        _pysilc_trust_unmap(store);
+        store->mtime = st.st_mtime;
+        store->ino = st.st_ino;
+        return 0;
+    }
+
+    map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        PyErr_SetFromErrnoWithFilename(PyExc_IOError, store->path);
+        return -1;
+    }
+
+    if (st.st_size < PYSILC_TRUST_HEADER_LEN ||
+        memcmp(map, PYSILC_TRUST_MAGIC, 8)) {
+        munmap(map, st.st_size);
+        PyErr_Format(PyExc_ValueError, "%s is not a trust store", store->path);
+        return -1;
+    }
+    SILC_GET32_MSB(version, map + 8);
+    SILC_GET32_MSB(count, map + 12);
+    if (version != PYSILC_TRUST_VERSION ||
+        PYSILC_TRUST_HEADER_LEN + (off_t)count * PYSILC_TRUST_RECORD_LEN > st.st_size) {
+        munmap(map, st.st_size);
+        PyErr_Format(PyExc_ValueError, "%s is corrupt or of unknown version",
+                     store->path);
+        return -1;
+    }
+
+    _pysilc_trust_unmap(store);
+    store->mtime = st.st_mtime;
+    store->ino = st.st_ino;
+    store->map = map;
+    store->map_len = st.st_size;
+    store->records = map + PYSILC_TRUST_HEADER_LEN;
+    store->count = count;
+    return 0;
+}
+
+// Picks up a store rewritten by another process. Writers replace the file
+// with rename(), so a changed inode or mtime means a new version.
+static int _pysilc_trust_refresh(PySilcTrustStore *store)
+{
+    struct stat st;
+
+    if (stat(store->path, &st) < 0)
+        return store->map ? _pysilc_trust_map(store) : 0;
+    if (st.st_ino == store->ino && st.st_mtime == store->mtime)
+        return 0;
+    return _pysilc_trust_map(store);
+}
+
+static void _pysilc_trust_hash_name(PySilcTrustStore *store, const char *name,
+                                    unsigned char *digest)
+{
+    silc_hash_make(store->sha1, (const unsigned char *)name, strlen(name),
+                   digest);
+}
+
+static int _pysilc_trust_lookup(PySilcTrustStore *store, const char *name,
+                                const unsigned char *fingerprint)
+{
+    unsigned char name_hash[PYSILC_TRUST_HASH_LEN];
+    const unsigned char *record;
+    SilcUInt32 low = 0, high, mid;
+    int found_name = 0;
+
+    if (_pysilc_trust_refresh(store) < 0)
+        PyErr_Clear(); // keep using what is mapped
+    if (!store->count)
+        return PYSILC_TRUST_UNKNOWN;
+
+    _pysilc_trust_hash_name(store, name, name_hash);
+
+    // lower bound of name_hash
+    high = store->count;
+    while (low < high) {
+        mid = low + (high - low) / 2;
+        record = store->records + mid * PYSILC_TRUST_RECORD_LEN;
+        if (memcmp(record, name_hash, PYSILC_TRUST_HASH_LEN) < 0)
+            low = mid + 1;
+        else
+            high = mid;
+    }
+
+    for (; low < store->count; low++) {
+        record = store->records + low * PYSILC_TRUST_RECORD_LEN;
+        if (memcmp(record, name_hash, PYSILC_TRUST_HASH_LEN))
+            break;
+        found_name = 1;
+        if (!memcmp(record + PYSILC_TRUST_HASH_LEN, fingerprint,
+                    PYSILC_TRUST_HASH_LEN))
+            return PYSILC_TRUST_TRUSTED;
+    }
+
+    return found_name ? PYSILC_TRUST_MISMATCH : PYSILC_TRUST_UNKNOWN;
+}
+
+static int _pysilc_trust_record_cmp(const void *a, const void *b)
+{
+    return memcmp(a, b, PYSILC_TRUST_RECORD_LEN);
+}
+
+static int _pysilc_trust_write(PySilcTrustStore *store, const unsigned char *add)
+{
+    SilcUInt32 count = store->count, i, unique;
+    unsigned char *buf, *records;
+    size_t len;
+    char *tmp;
+    int fd, error = 0;
+
+    len = PYSILC_TRUST_HEADER_LEN + (count + 1) * PYSILC_TRUST_RECORD_LEN;
+    if (!(buf = malloc(len)) || !(tmp = malloc(strlen(store->path) + 8))) {
+        free(buf);
+        PyErr_NoMemory();
+        return -1;
+    }
+    records = buf + PYSILC_TRUST_HEADER_LEN;
+
+    memcpy(records, store->records, count * PYSILC_TRUST_RECORD_LEN);
+    memcpy(records + count * PYSILC_TRUST_RECORD_LEN, add, PYSILC_TRUST_RECORD_LEN);
+    count++;
+    qsort(records, count, PYSILC_TRUST_RECORD_LEN, _pysilc_trust_record_cmp);
+    for (i = 1, unique = 1; i < count; i++) {
+        if (memcmp(records + (unique - 1) * PYSILC_TRUST_RECORD_LEN,
+                   records + i * PYSILC_TRUST_RECORD_LEN,
+                   PYSILC_TRUST_RECORD_LEN))
+            memmove(records + unique++ * PYSILC_TRUST_RECORD_LEN,
+                    records + i * PYSILC_TRUST_RECORD_LEN,
+                    PYSILC_TRUST_RECORD_LEN);
+    }
+
+    memcpy(buf, PYSILC_TRUST_MAGIC, 8);
+    SILC_PUT32_MSB(PYSILC_TRUST_VERSION, buf + 8);
+    SILC_PUT32_MSB(unique, buf + 12);
+    len = PYSILC_TRUST_HEADER_LEN + unique * PYSILC_TRUST_RECORD_LEN;
+
+    // readers keep their old mapping until they notice the rename
+    sprintf(tmp, "%s.XXXXXX", store->path);
+    if ((fd = mkstemp(tmp)) < 0) {
+        error = 1;
+    }
+    else {
+        if (write(fd, buf, len) != (ssize_t)len || fsync(fd) < 0)
+            error = 1;
+        fchmod(fd, 0644);
+        close(fd);
+        if (error || rename(tmp, store->path) < 0) {
+            error = 1;
+            unlink(tmp);
+        }
+    }
+    if (error)
+        PyErr_SetFromErrnoWithFilename(PyExc_IOError, store->path);
+
+    free(tmp);
+    free(buf);
+    if (error)
+        return -1;
+    return _pysilc_trust_map(store);
+}
+
+/* ---------------- python type ------------- */
+
+static int PySilcTrustStore_Init(PyObject *self, PyObject *args, PyObject *kwds)
+{
+    PySilcTrustStore *store = (PySilcTrustStore *)self;
+    char *path;
+    static char *kwlist[] = {"path", NULL};
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "s", kwlist, &path))
+        return -1;
+
+    if (!store->sha1 && !silc_hash_alloc((unsigned char *)"sha1", &store->sha1)) {
+        PyErr_SetString(PyExc_RuntimeError, "Unable to allocate SHA-1");
+        return -1;
+    }
+
+    _pysilc_trust_unmap(store);
+    free(store->path);
+    if (!(store->path = strdup(path))) {
+        PyErr_NoMemory();
+        return -1;
+    }
+    return _pysilc_trust_map(store);
+}
+
+static void PySilcTrustStore_Del(PyObject *object)
+{
+    PySilcTrustStore *store = (PySilcTrustStore *)object;
+    _pysilc_trust_unmap(store);
+    if (store->sha1)
+        silc_hash_free(store->sha1);
+    free(store->path);
+    object->ob_type->tp_free(object);
+}
+
+static int _pysilc_trust_check_fingerprint(int len)
+{
+    if (len != PYSILC_TRUST_HASH_LEN) {
+        PyErr_SetString(PyExc_ValueError, "fingerprint should be 20 bytes");
+        return -1;
+    }
+    return 0;
+}
+
+static PyObject *pysilc_trust_store_lookup(PyObject *self, PyObject *args)
+{
+    PySilcTrustStore *store = (PySilcTrustStore *)self;
+    unsigned char *fingerprint;
+    char *name;
+    int len;
+
+    if (!PyArg_ParseTuple(args, "ss#", &name, &fingerprint, &len))
+        return NULL;
+    if (_pysilc_trust_check_fingerprint(len) < 0)
+        return NULL;
+    if (!store->path) {
+        PyErr_SetString(PyExc_RuntimeError, "Trust store not initialised");
+        return NULL;
+    }
+
+    return PyInt_FromLong(_pysilc_trust_lookup(store, name, fingerprint));
+}
+
+static PyObject *pysilc_trust_store_add(PyObject *self, PyObject *args)
+{
+    PySilcTrustStore *store = (PySilcTrustStore *)self;
+    unsigned char record[PYSILC_TRUST_RECORD_LEN];
+    unsigned char *fingerprint;
+    char *name;
+    int len;
+
+    if (!PyArg_ParseTuple(args, "ss#", &name, &fingerprint, &len))
+        return NULL;
+    if (_pysilc_trust_check_fingerprint(len) < 0)
+        return NULL;
+    if (!store->path) {
+        PyErr_SetString(PyExc_RuntimeError, "Trust store not initialised");
+        return NULL;
+    }
+
+    if (_pysilc_trust_refresh(store) < 0)
+        return NULL;
+    _pysilc_trust_hash_name(store, name, record);
+    memcpy(record + PYSILC_TRUST_HASH_LEN, fingerprint, PYSILC_TRUST_HASH_LEN);
+    if (_pysilc_trust_write(store, record) < 0)
+        return NULL;
+
+    Py_RETURN_NONE;
+}
+
+static PyObject *pysilc_trust_store_reload(PyObject *self)
+{
+    PySilcTrustStore *store = (PySilcTrustStore *)self;
+    if (!store->path) {
+        PyErr_SetString(PyExc_RuntimeError, "Trust store not initialised");
+        return NULL;
+    }
+    if (_pysilc_trust_map(store) < 0)
+        return NULL;
+    Py_RETURN_NONE;
+}
+
+static Py_ssize_t PySilcTrustStore_Len(PyObject *self)
+{
+    return ((PySilcTrustStore *)self)->count;
+}
+
+/* ---------------- public key verification ------------- */
+
+static int _pysilc_public_key_fingerprint(SilcPublicKey public_key,
+                                          unsigned char *fingerprint)
+{
+    unsigned char *pk;
+    SilcUInt32 pk_len;
+    SilcHash sha1;
+
+    if (!(pk = silc_pkcs_public_key_encode(public_key, &pk_len)))
+        return -1;
+    if (!silc_hash_alloc((unsigned char *)"sha1", &sha1)) {
+        silc_free(pk);
+        return -1;
+    }
+    silc_hash_make(sha1, pk, pk_len, fingerprint);
+    silc_hash_free(sha1);
+    silc_free(pk);
+    return 0;
+}
+
+static void _pysilc_client_callback_verify_key(SilcClient client,
+                                               SilcClientConnection conn,
+                                               SilcConnectionType conn_type,
+                                               SilcPublicKey public_key,
+                                               SilcVerifyPublicKey completion,
+                                               void *context)
+{
+    PySilcClient *pyclient = (PySilcClient *)client->application;
+    PyObject *callback = NULL, *args = NULL, *result = NULL;
+    unsigned char fingerprint[PYSILC_TRUST_HASH_LEN];
+    const char *name = conn && conn->remote_host ? conn->remote_host : "";
+    int status = PYSILC_TRUST_UNKNOWN;
+    SilcBool verified = FALSE;
+
+    if (!pyclient || _pysilc_public_key_fingerprint(public_key, fingerprint) < 0) {
+        completion(FALSE, context);
+        return;
+    }
+    _pysilc_stats_enter(pyclient);
+
+    // the common path, no Python involved
+    if (pyclient->trust_store &&
+        PyObject_TypeCheck(pyclient->trust_store, &PySilcTrustStore_Type)) {
+        status = _pysilc_trust_lookup((PySilcTrustStore *)pyclient->trust_store,
+                                      name, fingerprint);
+        if (status == PYSILC_TRUST_TRUSTED) {
+            completion(TRUE, context);
+            return;
+        }
+    }
+
+    callback = PyObject_GetAttrString((PyObject *)pyclient, "verify_public_key");
+    if (!callback || !PyCallable_Check(callback)) {
+        PyErr_Clear();
+        // without a store or a callback, keep accepting every key
+        verified = !pyclient->trust_store || pyclient->trust_store == Py_None;
+        goto cleanup;
+    }
+
+    if (!(args = Py_BuildValue("(siis#i)", name, conn ? conn->remote_port : 0,
+                               conn_type, fingerprint, PYSILC_TRUST_HASH_LEN,
+                               status)))
+        goto cleanup;
+    if ((result = _pysilc_stats_call(pyclient, PYSILC_STAT_VERIFY_PUBLIC_KEY,
+                                     callback, args)) == 0) {
+        PyErr_Print();
+        goto cleanup;
+    }
+    verified = PyObject_IsTrue(result) == 1;
+
+cleanup:
+    PyErr_Clear();
+    Py_XDECREF(callback);
+    Py_XDECREF(args);
+    Py_XDECREF(result);
+    completion(verified, context);
+}
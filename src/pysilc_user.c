@@ -23,14 +23,24 @@ static PyObject *PySilcUser_New(SilcClientEntry user)
     pyuser->silcobj = user;             // TODO: maybe we need to do a clone?
     pyuser->silcobj->context = pyuser;  // TODO: self ref should be weak ref?
     PyObject_Init((PyObject *)pyuser, &PySilcUser_Type);
+    PYSILC_LIVE_INC(PYSILC_LIVE_USER);
     return (PyObject *)pyuser;
 }
 static void PySilcUser_Del(PyObject *object)
 {
     ((PySilcUser *)object)->silcobj = NULL;
+    PYSILC_LIVE_DEC(PYSILC_LIVE_USER);
     PyObject_Del(object);
 }
 
+/* A new reference to the current id of the entry. Not kept, as a NICK
+   change gives the client a new id which the toolkit updates in place. */
+static PySilcID *_pysilc_user_get_id(PySilcUser *pyuser)
+{
+    return (PySilcID *)PySilcID_FromId(&(pyuser->silcobj->id),
+                                       SILC_ID_CLIENT);
+}
+
 static PyObject *PySilcUser_GetAttr(PyObject *self, PyObject *name)
 {
     // expose the following attributes as readonly
@@ -41,7 +51,7 @@ static PyObject *PySilcUser_GetAttr(PyObject *self, PyObject *name)
     // - char *realname
     // - unsigned char *fingerprint;
     //
-    // - 64/160 bit user id
+    // - SilcID user_id
     // - unsigned int mode
     // - (TODO) attrs;
     // - (TODO) public_key;
@@ -149,9 +159,11 @@ static PyObject *PySilcUser_GetAttr(PyObject *self, PyObject *name)
     if (PyObject_Cmp(temp, name, &result) == -1)
         goto cleanup;
     if (result == 0) {
-        char buf[224];
-        memcpy(&buf, &(pyuser->silcobj->id), 224);
-        value = PyString_FromStringAndSize(buf, 224);
+        value = (PyObject *)_pysilc_user_get_id(pyuser);
+        if (!value) {
+            Py_DECREF(temp);
+            return NULL;
+        }
         goto cleanup;
     }
 
@@ -187,23 +199,44 @@ static PyObject *PySilcUser_Str(PyObject *self)
     return PyObject_Str(self);
 }
 
-static int PySilcUser_Compare(PyObject *self, PyObject *other)
+static long PySilcUser_Hash(PyObject *self)
 {
-    if (!PyObject_IsInstance(other, (PyObject *)&PySilcUser_Type)) {
-        PyErr_SetString(PyExc_TypeError, "Can only compare with SilcUser.");
+    PySilcUser *pyuser = (PySilcUser *)self;
+    PySilcID *id;
+    long hash;
+
+    if (!pyuser->silcobj)
+        return _Py_HashPointer(self);
+    if (!(id = _pysilc_user_get_id(pyuser)))
         return -1;
+    hash = id->hash;
+    Py_DECREF(id);
+    return hash;
+}
+
+static PyObject *PySilcUser_RichCompare(PyObject *self, PyObject *other, int op)
+{
+    PySilcID *id, *other_id;
+    PyObject *result;
+
+    if (!PyObject_TypeCheck(other, &PySilcUser_Type)) {
+        Py_INCREF(Py_NotImplemented);
+        return Py_NotImplemented;
     }
 
-    int result = 0;
-    PyObject *user_name = PyObject_GetAttrString(self, "user_name");
-    PyObject *other_name = PyObject_GetAttrString(self, "user_name");
-    if (!user_name || !other_name) {
-        PyErr_SetString(PyExc_RuntimeError, "Does not have user name");
-        return -1;
+    if (!((PySilcUser *)self)->silcobj || !((PySilcUser *)other)->silcobj) {
+        PyErr_SetString(PyExc_RuntimeError, "Does not have user id");
+        return NULL;
+    }
+    if (!(id = _pysilc_user_get_id((PySilcUser *)self)))
+        return NULL;
+    if (!(other_id = _pysilc_user_get_id((PySilcUser *)other))) {
+        Py_DECREF(id);
+        return NULL;
     }
 
-    result = PyObject_Compare(user_name, other_name);
-    Py_DECREF(user_name);
-    Py_DECREF(other_name);
+    result = _pysilc_id_richcompare(id, other_id, op);
+    Py_DECREF(id);
+    Py_DECREF(other_id);
     return result;
 }
@@ -1,5 +1,8 @@
 import time
 import os
+import errno
+import fcntl
+import select
 import socket
 import re
 
@@ -17,6 +20,10 @@ import silc
 #    I presume SupyBot assumes this.
 
 SILC_KEY_NAME = "silckey"
+SILC_DETACH_NAME = "silcdetach"
+
+def detach_file():
+    return os.path.join(conf.supybot.directories.conf(), SILC_DETACH_NAME)
 
 def strip_leading_hash(supybot_channel_name):
     return supybot_channel_name[1:]
@@ -73,6 +80,19 @@ class SupySilcClient(silc.SilcClient):
         drivers.log.info("SILC: Connected to server.")
         self.parent.connected = True
         self.irc.driver = self.parent
+        if self.resumed:
+            self.resume_channels()
+
+    def resume_channels(self):
+        # the session kept its channels, tell supybot about them from
+        # the toolkit state instead of joining and asking for USERS
+        for channel in self.joined_channels():
+            users = self.channel_users(channel)
+            self._cache_channel(channel)
+            for user in users:
+                self._cache_user(user)
+            drivers.log.info('SILC: Resumed on %s', channel.channel_name)
+            self._feed_join(channel.channel_name, channel.topic, users)
 
     def disconnected(self, msg):
         drivers.log.info('SILC: Disconnected from server.')
@@ -89,21 +109,18 @@ class SupySilcClient(silc.SilcClient):
         self._cache_channel(channel)
         self._cache_user(sender)
 
-        ircemu = ':%s!%s@%s PRIVMSG #%s :%s' % (sender.nickname, sender.username,
-                                               sender.hostname, channel.channel_name,
-                                               msg)
-        ircmsg = drivers.parseMsg(ircemu)
-        self.irc.feedMsg(ircmsg)
+        # built directly, there is nothing to parse
+        self.irc.feedMsg(ircmsgs.IrcMsg(prefix=silc.irc_prefix(sender),
+                                        command='PRIVMSG',
+                                        args=(silc.irc_channel(channel), msg)))
 
     def private_message(self, sender, flags, msg):
         drivers.log.info('SILC: Private Message: [%s] %s', sender, msg)
         self._cache_user(sender)
 
-        ircemu = ':%s!%s@%s PRIVMSG %s :%s' % (sender.nickname, sender.username,
-                                               sender.hostname, self.username,
-                                               msg)
-        ircmsg = drivers.parseMsg(ircemu)
-        if ircmsg: self.irc.feedMsg(ircmsg)
+        self.irc.feedMsg(ircmsgs.IrcMsg(prefix=silc.irc_prefix(sender),
+                                        command='PRIVMSG',
+                                        args=(self.username, msg)))
 
     def notify_none(self, msg):
         drivers.log.info('SILC: Notify (None): %s', msg)
@@ -112,11 +129,9 @@ class SupySilcClient(silc.SilcClient):
         self._cache_user(joiner)
         drivers.log.info('SILC: Notify (Join): %s %s', joiner, channel)
 
-        ircemu = ':%s!n=%s@%s JOIN #%s' % (joiner.nickname, joiner.username,
-                                           joiner.hostname,
-                                           channel.channel_name)
-        ircmsg = drivers.parseMsg(ircemu)
-        if ircmsg: self.irc.feedMsg(ircmsg)
+        self.irc.feedMsg(ircmsgs.IrcMsg(prefix=silc.irc_prefix(joiner, 'n='),
+                                        command='JOIN',
+                                        args=(silc.irc_channel(channel),)))
 
     def notify_invite(self, channel, channel_name, inviter):
         self._cache_channel(channel)
@@ -128,21 +143,17 @@ class SupySilcClient(silc.SilcClient):
         self._cache_channel(channel)
         drivers.log.info('SILC: Notify (Leave): %s %s', leaver, channel.channel_name)
 
-        ircemu = ':%s!n=%s@%s PART #%s :' % (leaver.nickname, leaver.username,
-                                           leaver.hostname,
-                                           channel.channel_name)
-        ircmsg = drivers.parseMsg(ircemu)
-        if ircmsg: self.irc.feedMsg(ircmsg)
+        self.irc.feedMsg(ircmsgs.IrcMsg(prefix=silc.irc_prefix(leaver, 'n='),
+                                        command='PART',
+                                        args=(silc.irc_channel(channel), '')))
 
 
     def notify_signoff(self, user, msg, channel):
         self._cache_user(user)
         drivers.log.info('SILC: Notify (Signoff): %s', user)
 
-        ircemu = ':%s!n=%s@%s QUIT :' % (user.nickname, user.username,
-                                           user.hostname)
-        ircmsg = drivers.parseMsg(ircemu)
-        if ircmsg: self.irc.feedMsg(ircmsg)
+        self.irc.feedMsg(ircmsgs.IrcMsg(prefix=silc.irc_prefix(user, 'n='),
+                                        command='QUIT', args=('',)))
 
     def notify_topic_set(self, changer_type, changer, channel, topic):
         self._cache_user(changer)
@@ -193,11 +204,10 @@ class SupySilcClient(silc.SilcClient):
         self._cache_user(kicker)
         self._cache_channel(channel)
         drivers.log.info('SILC: Notify (Kick):', kicked, reason, kicker, channel)
-        ircemu = ':%s!n=%s@%s KICK #%s %s' % \
-                 (kicker.nickname, kicker.username, kicker.hostname,
-                  channel.channel_name, kicked.nickname)
-        ircmsg = drivers.parseMsg(ircemu)
-        if ircmsg: self.irc.feedMsg(ircmsg)
+        self.irc.feedMsg(ircmsgs.IrcMsg(prefix=silc.irc_prefix(kicker, 'n='),
+                                        command='KICK',
+                                        args=(silc.irc_channel(channel),
+                                              kicked.nickname)))
 
     def notify_killed(self, killed, reason, killer, channel):
         self._cache_user(kicked)
@@ -263,9 +273,11 @@ class SupySilcClient(silc.SilcClient):
 
     def command_reply_join(self, channel, channel_name, topic, hmac_name, mode, user_limit, users):
         self._cache_channel(channel)
-        myself = self.user()
-
         drivers.log.info('SILC: Reply (Join)', channel, topic, users)
+        self._feed_join(channel_name, topic, users)
+
+    def _feed_join(self, channel_name, topic, users):
+        myself = self.user()
         ircemu = ':%s!%s@%s JOIN :#%s' % (myself.nickname,
                                           myself.username,
                                           myself.hostname,
@@ -335,8 +347,14 @@ class SupySilcClient(silc.SilcClient):
         self._cache_channel(channel)
         drivers.log.info('SILC: Reply (Ban):', channel)
 
-    def command_reply_detach(self):
+    def command_reply_detach(self, detach_data):
+        # the next start resumes this session, see SilcDriver.reconnect
         drivers.log.info('SILC: Reply (Detach)')
+        f = open(detach_file(), 'wb')
+        try:
+            f.write(detach_data)
+        finally:
+            f.close()
 
     def command_reply_watch(self):
         drivers.log.info('SILC: Reply (Watch)')
@@ -383,6 +401,31 @@ class SupySilcClient(silc.SilcClient):
 
 
 class SilcDriver(drivers.IrcDriver, drivers.ServersMixin):
+    # the key exchange takes several round trips on sockets we cannot
+    # select on, so poll quicker until connected
+    CONNECT_POLL = 0.05
+
+    # set to resume the session on the next start instead of rejoining
+    # every channel; off by default, as the server keeps a detached
+    # session and its nickname until it expires
+    detachOnQuit = False
+
+    # longest idle time before the server is PINGed, see keepalive_info()
+    keepaliveMax = 300
+
+    # netsplit joins and quits are collected this many seconds so a join
+    # and leave of the same user cancel out; 0 passes each one on
+    notifyWindow = 0.5
+
+    # private messages, then command replies, then channel traffic; the
+    # rest of a burst waits for the next loop so commands get in first
+    eventBudget = 32
+
+    # calls waiting per class before channel traffic and notifies are
+    # dropped, oldest first; private messages and command replies are
+    # never dropped, the connection is read slower instead
+    eventLimit = 2000
+
     def __init__(self, irc):
         self.__parent = super(SilcDriver, self)
         self.__parent.__init__(irc)
@@ -391,10 +434,64 @@ class SilcDriver(drivers.IrcDriver, drivers.ServersMixin):
         self.connected = False
         self.silc = SupySilcClient(irc, self)
 
+        # written to when a message is queued, so run() wakes up at once
+        self.wakeup_r, self.wakeup_w = os.pipe()
+        for fd in (self.wakeup_r, self.wakeup_w):
+            flags = fcntl.fcntl(fd, fcntl.F_GETFL)
+            fcntl.fcntl(fd, fcntl.F_SETFL, flags | os.O_NONBLOCK)
+        self._wakeOnQueue('queueMsg')
+        self._wakeOnQueue('sendMsg')
+
+    def _wakeOnQueue(self, name):
+        method = getattr(self.irc, name)
+        def queue(msg):
+            result = method(msg)
+            self.wakeup()
+            return result
+        setattr(self.irc, name, queue)
+
+    def wakeup(self):
+        try:
+            os.write(self.wakeup_w, 'x')
+        except OSError, e:
+            # a full pipe already wakes us up
+            if e.errno != errno.EAGAIN:
+                raise
+
+    def _drainWakeups(self):
+        try:
+            while os.read(self.wakeup_r, 4096):
+                pass
+        except OSError, e:
+            if e.errno != errno.EAGAIN:
+                raise
+
     def run(self):
+        timeout = conf.supybot.drivers.poll()
+        fds = [self.wakeup_r]
+        if self.connected:
+            try:
+                fds.append(self.silc.fileno())
+            except RuntimeError:
+                timeout = min(timeout, self.CONNECT_POLL)
+        elif self.running:
+            timeout = min(timeout, self.CONNECT_POLL)
+        if self.silc.events_pending():
+            timeout = 0
+
+        # wait for the server or for supybot, the timeout keeps the
+        # toolkit timers (keepalive, rekey) running
+        try:
+            ready = select.select(fds, [], [], timeout)[0]
+        except select.error, e:
+            if e.args[0] != errno.EINTR:
+                raise
+            ready = []
+        if self.wakeup_r in ready:
+            self._drainWakeups()
+
         try:
             self.silc.run_one()
-            time.sleep(conf.supybot.drivers.poll())
         except:
             import traceback
             traceback.print_exc()
@@ -402,24 +499,60 @@ class SilcDriver(drivers.IrcDriver, drivers.ServersMixin):
 
         self.checkIrcForMsgs()
 
+    def die(self):
+        os.close(self.wakeup_r)
+        os.close(self.wakeup_w)
+        self.__parent.die()
+
     def reconnect(self):
         drivers.log.info('SilcDriver: Logging into server')
         host, port = self.__parent._getNextServer()
-        self.silc.connect_to_server(host, port)
+        detach_data = None
+        if os.path.exists(detach_file()):
+            # used once, a stale session would fail every reconnect
+            f = open(detach_file(), 'rb')
+            try:
+                detach_data = f.read()
+            finally:
+                f.close()
+            os.remove(detach_file())
+            drivers.log.info('SilcDriver: Resuming detached session')
+        # lost connections are reconnected and the channels rejoined
+        # by the client itself from now on
+        self.silc.auto_reconnect([(host, port)])
+        self.silc.coalesce_notifies(self.notifyWindow)
+        self.silc.prioritize_events(budget = self.eventBudget)
+        for event_class in ('channel_message', 'notify'):
+            self.silc.limit_events(event_class, self.eventLimit,
+                                   silc.QUEUE_DROP_OLDEST)
+        for event_class in ('private_message', 'command_reply'):
+            self.silc.limit_events(event_class, self.eventLimit,
+                                   silc.QUEUE_BLOCK)
+        self.silc.connect_to_server(host, port, detach_data,
+                                    adaptive_keepalive = self.keepaliveMax)
 
     def checkIrcForMsgs(self):
         # convert irc messages into silc command equivalents and send it off.
 
-        if self.connected:
+        # everything queued is sent now, takeMsg returns None when the
+        # queue is empty or supybot's flood control holds messages back
+        while self.connected:
             msg = self.irc.takeMsg()
-            if msg:
-                drivers.log.info('IRC MSG: %s', repr(msg))
-                handler = 'do_' + msg.command
-                handler = getattr(self, handler, None)
-                if handler:
-                    handler(msg)
-                else:
-                    drivers.log.info('!! MSG UNKNOWN: %s', msg.command)
+            if not msg:
+                break
+            # the common commands are sent natively, the do_ handlers
+            # cover the rest and what irc_send turns down
+            if self.silc.irc_send(msg.command, msg.args):
+                if msg.command == 'NICK':
+                    self.welcome()
+                continue
+            drivers.log.info('IRC MSG: %s', repr(msg))
+            handler = 'do_' + msg.command
+            handler = getattr(self, handler, None)
+            if handler:
+                handler(msg)
+            else:
+                drivers.log.info('!! MSG UNKNOWN: %s', msg.command)
 
     def do_PRIVMSG(self, msg):
         if msg.args[0][0] == '#':
@@ -438,7 +571,9 @@ class SilcDriver(drivers.IrcDriver, drivers.ServersMixin):
 
     def do_NICK(self, msg):
         self.silc.command_call('NICK %s' % msg.args[0])
+        self.welcome()
 
+    def welcome(self):
         ircemu =self.makeEmulatedIrcMsg('001', 'Welcome')
         ircmsg = drivers.parseMsg(ircemu)
         self.irc.feedMsg(ircmsg)
@@ -474,7 +609,12 @@ class SilcDriver(drivers.IrcDriver, drivers.ServersMixin):
             self.silc.command_call('TOPIC %s' % strip_leading_hash(msg.args[0]))
 
     def do_QUIT(self, msg):
-        self.silc.command_call('QUIT %s' % msg.args[0])
+        self.silc.auto_reconnect(None)
+        if self.detachOnQuit:
+            # keep the session on the server for the next start
+            self.silc.command_call('DETACH')
+        else:
+            self.silc.command_call('QUIT %s' % msg.args[0])
 
     def do_NAMES(self, msg):
         self.silc.command_call('USERS %s' % strip_leading_hash(msg.args[0]))